@@ -1,201 +1,1441 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <bitset>
 #include <unordered_map>
 #include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <charconv>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Object_Format.h"
+#include "Assembly_to_Binary.h"
+
+// Assembly_to_Binary.h is the interface. The using-directive stays inside
+// the namespace, so nothing outside this file sees it.
+namespace atob {
 
 using namespace std;
 
-// Mapping for opcodes
-unordered_map<string, string> opcodeMap = {
-    {"MOV", "0000"},
-    {"ADD", "0001"},
-    {"SUB", "0010"},
-    {"CMP", "0011"},
-    {"JMP", "0100"},
-    {"CALL", "0101"},
-    {"RET", "0110"},
-    {"PUSH", "0111"},
-    {"POP", "1000"},
-    {"DEC", "1001"},
-    {"MUL", "1010"},
-    {"JE", "1011"}  // Jump if Equal
+// Instruction word layout (32 bits):
+//   [31:28] opcode  [27:24] rd  [23:20] rs1  [19:16] rs2          register form
+//   [31:28] opcode  [27:24] rd  [23:8]  imm16 / branch target     immediate form
+//   [31:28] opcode  [27:24] rd  [23:20] rs1  [15:8] shift amount  SHL/SRL with MODE_IMM
+//   [7:0]   mode: MODE_IMM when [23:8] holds an immediate operand
+// Branch targets are byte addresses (instruction index * 4).
+// MOV and CMP immediates are sign-extended. MOV also has MODE_HI
+// (rd = imm16 << 16) and MODE_LO (replace the low half of rd), which LI
+// uses for 32-bit constants. Only CMP sets the flag JE tests; SLT sets a
+// register to 1 if rs1 < rs2 (signed), else 0. SRL shifts in zeros.
+// Opcode 0xF (SYS) is a call into the loader; the linker emits SYS BIND in
+// PLT entries (Object_Format.h).
+const uint32_t MODE_IMM = 0x01;
+const uint32_t MODE_HI = 0x02;
+const uint32_t MODE_LO = 0x03;
+
+// Mnemonics and register names are looked up through perfect hash tables
+// built at compile time: one hash, one slot, one compare, no allocation.
+struct Keyword {
+    string_view name;
+    uint32_t value;
 };
 
-// Register mapping
-unordered_map<string, string> regMap = {
-    {"R0", "0000"},
-    {"R1", "0001"},
-    {"R2", "0010"},
-    {"R3", "0011"},
-    {"R4", "0100"},
-    {"R5", "0101"},
-    {"R6", "0110"},
-    {"R7", "0111"}
+constexpr uint32_t keywordHash(string_view name, uint32_t seed) {
+    uint32_t h = seed;
+    for (char c : name) h = (h ^ (uint8_t)c) * 16777619u;
+    return h ^ (h >> 16);
+}
+
+// Slots must be a power of two. The constructor searches for a seed that
+// places every key in its own slot; static_assert on ok() catches failure.
+template <size_t N, size_t Slots>
+class PerfectHash {
+public:
+    constexpr explicit PerfectHash(const Keyword (&keys)[N]) : seed(0), table{} {
+        for (uint32_t s = 1; s < 10000 && seed == 0; s++) {
+            if (tryBuild(keys, s)) seed = s;
+        }
+    }
+
+    constexpr bool ok() const { return seed != 0; }
+
+    bool find(string_view name, uint32_t& value) const {
+        const Keyword& k = table[keywordHash(name, seed) & (Slots - 1)];
+        if (k.name.empty() || k.name != name) return false;
+        value = k.value;
+        return true;
+    }
+
+private:
+    uint32_t seed;
+    Keyword table[Slots];
+
+    constexpr bool tryBuild(const Keyword (&keys)[N], uint32_t s) {
+        for (Keyword& k : table) k = Keyword{};
+        for (const Keyword& key : keys) {
+            Keyword& slot = table[keywordHash(key.name, s) & (Slots - 1)];
+            if (!slot.name.empty()) return false;
+            slot = key;
+        }
+        return true;
+    }
 };
 
-// Label resolution map (for storing label addresses)
-unordered_map<string, int> labelMap;
-
-// Function to convert a single assembly instruction to binary
-string convertToBinary(const string& line, bool& isLabel) {
-    stringstream ss(line);
-    string instruction;
-    ss >> instruction;
-    isLabel = false;
-
-    // If the instruction is a label, mark it and return an empty string
-    if (instruction.back() == ':') {
-        isLabel = true;
-        return "";
-    }
-
-    if (opcodeMap.find(instruction) != opcodeMap.end()) {
-        string opcode = opcodeMap[instruction];
-        string dest, src1, src2, label;
-
-        if (instruction == "MOV") {
-            ss >> dest >> src1;
-            cout << "MOV instruction: dest = " << dest << ", src1 = " << src1 << endl;
-            if (isdigit(src1[0])) {  // If the second operand is an immediate value
-                string imm = bitset<16>(stoi(src1)).to_string();  // Assuming a 16-bit immediate value
-                string binaryInstr = opcode + regMap[dest] + imm;  // Combine parts into one binary string
-                return binaryInstr + "00000000";  // Pad to 32 bits (8 bits padding for 16-bit immediate)
-            }
-            return opcode + regMap[dest] + regMap[src1] + "0000";  // If src1 is a register
-        }
-        else if (instruction == "ADD" || instruction == "SUB" || instruction == "MUL") {
-            ss >> dest >> src1 >> src2;
-            string result = opcode + regMap[dest] + regMap[src1] + regMap[src2];
-            cout << instruction << " instruction binary: " << result << endl;  // Debug print
-            return result;
-        }
-        else if (instruction == "CMP") {
-            ss >> dest >> src1;
-            string result = opcode + regMap[dest] + regMap[src1] + "0000";  // CMP takes 2 operands, padding with zeros
-            cout << "CMP instruction binary: " << result << endl;  // Debug print
-            return result;
-        }
-        else if (instruction == "JMP" || instruction == "JE") {
-            ss >> label;
-            string result = opcode + "0000" + "0000000000000000";  // Placeholder for label
-            cout << instruction << " instruction binary (label placeholder): " << result << endl;  // Debug print
-            return result;
-        }
-        else if (instruction == "CALL") {
-            ss >> label;
-            string result = opcode + "0000" + "0000" + "0001";  // CALL instruction (simplified)
-            cout << "CALL instruction binary: " << result << endl;  // Debug print
-            return result;
-        }
-        else if (instruction == "RET") {
-            string result = opcode + "0000" + "0000" + "0000";  // RET instruction format (simplified)
-            cout << "RET instruction binary: " << result << endl;  // Debug print
-            return result;
-        }
-        else if (instruction == "PUSH" || instruction == "POP") {
-            ss >> dest;
-            string result = opcode + regMap[dest] + "0000" + "0000";  // PUSH/POP with register (simplified)
-            cout << instruction << " instruction binary: " << result << endl;  // Debug print
-            return result;
-        }
-        else if (instruction == "DEC") {
-            ss >> dest;
-            string result = opcode + regMap[dest] + "0000" + "0000";  // DEC with register (simplified)
-            cout << "DEC instruction binary: " << result << endl;  // Debug print
-            return result;
-        }
-    }
-    return "";  // Return empty if instruction not recognized
-}
-
-int main() {
-    // Read the assembly code from a file
-    ifstream asmFile("input.asm");
-    if (!asmFile) {
-        cerr << "Error opening assembly file" << endl;
-        return 1;
+// Opcodes
+constexpr Keyword MNEMONICS[] = {
+    {"MOV", 0x0},
+    {"ADD", 0x1},
+    {"SUB", 0x2},
+    {"CMP", 0x3},
+    {"JMP", 0x4},
+    {"CALL", 0x5},
+    {"RET", 0x6},
+    {"PUSH", 0x7},
+    {"POP", 0x8},
+    {"DEC", 0x9},
+    {"MUL", 0xA},
+    {"JE", 0xB},  // Jump if Equal
+    {"SHL", 0xC},
+    {"SLT", 0xD},  // Set if Less Than
+    {"SRL", 0xE},  // Shift Right Logical
+    // Pseudo-instructions, expanded by assembleLine
+    {"LI", 0x10},    // LI rd, imm32
+    {"MOVE", 0x11},  // MOVE rd, rs
+    {"CLR", 0x12},   // CLR rd
+    {"BEQZ", 0x13}   // BEQZ rs, label
+};
+
+// Registers
+constexpr Keyword REGISTERS[] = {
+    {"R0", 0x0},
+    {"R1", 0x1},
+    {"R2", 0x2},
+    {"R3", 0x3},
+    {"R4", 0x4},
+    {"R5", 0x5},
+    {"R6", 0x6},
+    {"R7", 0x7}
+};
+
+constexpr PerfectHash<size(MNEMONICS), 32> opcodeTable(MNEMONICS);
+constexpr PerfectHash<size(REGISTERS), 16> registerTable(REGISTERS);
+static_assert(opcodeTable.ok() && registerTable.ok(), "no perfect hash seed found");
+
+// OpcodeValue and the AssembledProgram types are in Assembly_to_Binary.h
+
+inline uint32_t encodeReg(uint32_t op, uint32_t rd, uint32_t rs1 = 0, uint32_t rs2 = 0) {
+    return (op << 28) | (rd << 24) | (rs1 << 20) | (rs2 << 16);
+}
+
+inline uint32_t encodeImm(uint32_t op, uint32_t rd, uint32_t imm16, uint32_t mode) {
+    return (op << 28) | (rd << 24) | ((imm16 & 0xFFFF) << 8) | mode;
+}
+
+inline uint32_t encodeShift(uint32_t op, uint32_t rd, uint32_t rs1, uint32_t amount) {
+    return (op << 28) | (rd << 24) | (rs1 << 20) | ((amount & 0x1F) << 8) | MODE_IMM;
+}
+
+static void reportError(AssembledProgram& prog, int line, const string& message) {
+    prog.diagnostics.push_back({line, message});
+}
+
+// Tokens are views into the source line, split on whitespace and commas.
+const size_t MAX_TOKENS = 8;
+
+struct TokenList {
+    string_view tok[MAX_TOKENS];
+    size_t count = 0;
+};
+
+inline bool isSeparator(char c) {
+    return c == ' ' || c == ',' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static void tokenize(string_view text, TokenList& out) {
+    size_t i = 0, n = text.size();
+    out.count = 0;
+    while (i < n) {
+        while (i < n && isSeparator(text[i])) i++;
+        size_t start = i;
+        while (i < n && !isSeparator(text[i])) i++;
+        if (i > start) {
+            if (out.count == MAX_TOKENS) {  // too many operands; keep the count honest
+                out.count++;
+                return;
+            }
+            out.tok[out.count++] = text.substr(start, i - start);
+        }
+    }
+}
+
+// Same syntax as strtol base 0: decimal, 0x hex or leading-0 octal.
+static bool parseNumber(string_view token, int64_t& value) {
+    if (token.empty() || !(isdigit((unsigned char)token[0]) || token[0] == '-')) return false;
+    bool negative = token[0] == '-';
+    string_view digits = negative ? token.substr(1) : token;
+    int base = 10;
+    if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        base = 16;
+        digits.remove_prefix(2);
+    } else if (digits.size() > 1 && digits[0] == '0') {
+        base = 8;
+    }
+    if (digits.empty() || digits[0] == '-' || digits[0] == '+') return false;
+    int64_t v = 0;
+    auto [end, ec] = from_chars(digits.data(), digits.data() + digits.size(), v, base);
+    if (ec != errc() || end != digits.data() + digits.size()) return false;
+    value = negative ? -v : v;
+    return true;
+}
+
+// 16-bit immediates and branch targets, signed or unsigned.
+static bool parseImmediate(string_view token, int32_t& value) {
+    int64_t v;
+    if (!parseNumber(token, v) || v < -32768 || v > 0xFFFF) return false;
+    value = (int32_t)v;
+    return true;
+}
+
+// LI operands: any value representable in 32 bits, signed or unsigned.
+static bool parseLongImmediate(string_view token, int64_t& value) {
+    return parseNumber(token, value) && value >= INT32_MIN && value <= (int64_t)UINT32_MAX;
+}
+
+static bool lookupReg(AssembledProgram& prog, int line, string_view token, uint32_t& reg) {
+    if (registerTable.find(token, reg)) return true;
+    reportError(prog, line, "unknown register '" + string(token) + "'");
+    return false;
+}
+
+// Encode a branch target: resolved immediately for labels already seen,
+// otherwise a fixup is recorded against the word about to be emitted.
+static uint32_t branchTarget(AssembledProgram& prog, int line, string_view label) {
+    int32_t address;
+    if (parseImmediate(label, address)) return (uint32_t)address;
+    string name(label);
+    auto it = prog.labels.find(name);
+    if (it != prog.labels.end()) {
+        prog.localRefs.push_back(prog.words.size());
+        return it->second;
+    }
+    prog.fixups.push_back({prog.words.size(), std::move(name), line});
+    return 0;
+}
+
+inline string_view trim(string_view s) {
+    while (!s.empty() && isSeparator(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isSeparator(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+void defineLabel(string_view name, int line, AssembledProgram& prog) {
+    string label(name);
+    uint32_t address = (uint32_t)prog.words.size() * 4;
+    if (prog.labels.emplace(label, address).second) {
+        prog.definitions.push_back({std::move(label), address, line});
+    } else {
+        reportError(prog, line, "duplicate label '" + label + "'");
+    }
+}
+
+// Text operands are range-checked as they are parsed; these checks are for
+// instructions built in memory.
+static bool checkReg(AssembledProgram& prog, int line, int reg, uint32_t& out) {
+    if (reg < 0 || reg > 15) {
+        reportError(prog, line, "bad register operand");
+        return false;
+    }
+    out = (uint32_t)reg;
+    return true;
+}
+
+static bool checkImm(AssembledProgram& prog, int line, int64_t value, int64_t low, int64_t high) {
+    if (value >= low && value <= high) return true;
+    reportError(prog, line, "immediate " + to_string(value) + " out of range");
+    return false;
+}
+
+bool assembleInstruction(const Instruction& in, int line, AssembledProgram& prog) {
+    uint32_t word = 0, rd = 0, rs1 = 0, rs2 = 0;
+    switch (in.opcode) {
+    case OP_MOV:
+    case OP_CMP:
+        if (!checkReg(prog, line, in.rd, rd)) return false;
+        if (in.rs1 < 0) {
+            if (!checkImm(prog, line, in.imm, -32768, 0xFFFF)) return false;
+            word = encodeImm(in.opcode, rd, (uint32_t)in.imm, MODE_IMM);
+        } else {
+            if (!checkReg(prog, line, in.rs1, rs1)) return false;
+            word = encodeReg(in.opcode, rd, rs1);
+        }
+        break;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_SLT:
+        if (!checkReg(prog, line, in.rd, rd) || !checkReg(prog, line, in.rs1, rs1) ||
+            !checkReg(prog, line, in.rs2, rs2)) return false;
+        word = encodeReg(in.opcode, rd, rs1, rs2);
+        break;
+    case OP_JMP:
+    case OP_JE:
+    case OP_CALL:
+        word = encodeImm(in.opcode, 0, branchTarget(prog, line, in.target), 0);
+        break;
+    case OP_SHL:
+    case OP_SRL:
+        if (!checkReg(prog, line, in.rd, rd) || !checkReg(prog, line, in.rs1, rs1)) return false;
+        if (in.rs2 < 0) {
+            if (in.imm < 0 || in.imm > 31) {
+                reportError(prog, line, "shift amount out of range");
+                return false;
+            }
+            word = encodeShift(in.opcode, rd, rs1, (uint32_t)in.imm);
+        } else {
+            if (!checkReg(prog, line, in.rs2, rs2)) return false;
+            word = encodeReg(in.opcode, rd, rs1, rs2);
+        }
+        break;
+    case OP_RET:
+        word = encodeReg(in.opcode, 0);
+        break;
+    case PSEUDO_LI: {
+        // One MOV if the value sign-extends from 16 bits, else high then low half
+        if (!checkReg(prog, line, in.rd, rd) || !checkImm(prog, line, in.imm, INT32_MIN, UINT32_MAX)) return false;
+        uint32_t v = (uint32_t)in.imm;
+        if ((int32_t)v >= -32768 && (int32_t)v <= 32767) {
+            word = encodeImm(OP_MOV, rd, v, MODE_IMM);
+        } else {
+            word = encodeImm(OP_MOV, rd, v >> 16, MODE_HI);
+            if ((v & 0xFFFF) != 0) {
+                prog.words.push_back(word);
+                word = encodeImm(OP_MOV, rd, v, MODE_LO);
+            }
+        }
+        break;
+    }
+    case PSEUDO_MOVE:
+        if (!checkReg(prog, line, in.rd, rd) || !checkReg(prog, line, in.rs1, rs1)) return false;
+        word = encodeReg(OP_MOV, rd, rs1);
+        break;
+    case PSEUDO_CLR:
+        if (!checkReg(prog, line, in.rd, rd)) return false;
+        word = encodeImm(OP_MOV, rd, 0, MODE_IMM);
+        break;
+    case PSEUDO_BEQZ:
+        if (!checkReg(prog, line, in.rd, rd)) return false;
+        prog.words.push_back(encodeImm(OP_CMP, rd, 0, MODE_IMM));
+        word = encodeImm(OP_JE, 0, branchTarget(prog, line, in.target), 0);
+        break;
+    case OP_PUSH:
+    case OP_POP:
+    case OP_DEC:
+        if (!checkReg(prog, line, in.rd, rd)) return false;
+        word = encodeReg(in.opcode, rd);
+        break;
+    default:
+        reportError(prog, line, "bad opcode " + to_string(in.opcode));
+        return false;
+    }
+
+    prog.words.push_back(word);
+    return true;
+}
+
+// Assemble one source line (label and/or instruction) into prog.
+// Returns true if an instruction word was emitted.
+bool assembleLine(string_view text, int line, AssembledProgram& prog) {
+    text = text.substr(0, text.find_first_of("#;"));  // strip comments
+
+    // Leading "label:" defines the current address
+    size_t colon = text.find(':');
+    if (colon != string_view::npos) {
+        defineLabel(trim(text.substr(0, colon)), line, prog);
+        text = text.substr(colon + 1);
+    }
+
+    TokenList t;
+    tokenize(text, t);
+    if (t.count == 0) return false;
+    const string_view* tok = t.tok;
+
+    uint32_t opcode;
+    if (!opcodeTable.find(tok[0], opcode)) {
+        reportError(prog, line, "unknown instruction '" + string(tok[0]) + "'");
+        return false;
+    }
+
+    size_t expected = 2;
+    if (opcode == OP_ADD || opcode == OP_SUB || opcode == OP_MUL || opcode == OP_SHL || opcode == OP_SLT ||
+        opcode == OP_SRL) expected = 4;
+    else if (opcode == OP_MOV || opcode == OP_CMP || opcode == PSEUDO_LI ||
+             opcode == PSEUDO_MOVE || opcode == PSEUDO_BEQZ) expected = 3;
+    else if (opcode == OP_RET) expected = 1;
+    if (t.count != expected) {
+        reportError(prog, line, string(tok[0]) + " expects " + to_string(expected - 1) + " operand(s)");
+        return false;
+    }
+
+    Instruction in{opcode};
+    auto reg = [&](string_view token, int& out) {
+        uint32_t r;
+        if (!lookupReg(prog, line, token, r)) return false;
+        out = (int)r;
+        return true;
+    };
+    int32_t imm;
+    switch (opcode) {
+    case OP_MOV:
+    case OP_CMP:
+        if (!reg(tok[1], in.rd)) return false;
+        if (parseImmediate(tok[2], imm)) in.imm = imm;
+        else if (!reg(tok[2], in.rs1)) return false;
+        break;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_SLT:
+        if (!reg(tok[1], in.rd) || !reg(tok[2], in.rs1) || !reg(tok[3], in.rs2)) return false;
+        break;
+    case OP_JMP:
+    case OP_JE:
+    case OP_CALL:
+        in.target = tok[1];
+        break;
+    case OP_SHL:
+    case OP_SRL:
+        if (!reg(tok[1], in.rd) || !reg(tok[2], in.rs1)) return false;
+        if (parseImmediate(tok[3], imm)) in.imm = imm;
+        else if (!reg(tok[3], in.rs2)) return false;
+        break;
+    case OP_RET:
+        break;
+    case PSEUDO_LI:
+        if (!reg(tok[1], in.rd)) return false;
+        if (!parseLongImmediate(tok[2], in.imm)) {
+            reportError(prog, line, "bad 32-bit immediate '" + string(tok[2]) + "'");
+            return false;
+        }
+        break;
+    case PSEUDO_MOVE:
+        if (!reg(tok[1], in.rd) || !reg(tok[2], in.rs1)) return false;
+        break;
+    case PSEUDO_BEQZ:
+        if (!reg(tok[1], in.rd)) return false;
+        in.target = tok[2];
+        break;
+    default:  // CLR, PUSH, POP, DEC
+        if (!reg(tok[1], in.rd)) return false;
+        break;
+    }
+    return assembleInstruction(in, line, prog);
+}
+
+inline void addToTarget(uint32_t& word, uint32_t address) {
+    uint32_t target = ((word >> 8) + address) & 0xFFFF;
+    word = (word & ~(0xFFFFu << 8)) | (target << 8);
+}
+
+// Patch forward references in one pass over the fixup list. With
+// keepUnresolved, references to labels this program does not define stay
+// pending (a chunk of a larger source); otherwise they are errors.
+void resolveFixups(AssembledProgram& prog, bool keepUnresolved = false) {
+    vector<Fixup> pending;
+    for (Fixup& f : prog.fixups) {
+        auto it = prog.labels.find(f.label);
+        if (it == prog.labels.end()) {
+            if (keepUnresolved) pending.push_back(std::move(f));
+            else reportError(prog, f.line, "undefined label '" + f.label + "'");
+            continue;
+        }
+        addToTarget(prog.words[f.index], it->second);
+        prog.localRefs.push_back(f.index);
+    }
+    prog.fixups.swap(pending);
+}
+
+//--------------------------------------
+// Peephole optimizer
+//--------------------------------------
+// Runs on the encoded words before forward references are resolved, one
+// basic block at a time (blocks start at labels; nothing is known on
+// entry). Register constants from MOV immediates are tracked through the
+// block to fold JE after a decided CMP, to drop moves that do not change
+// a register, and to strength-reduce MUL by a power of two to SHL. A MOV
+// overwritten by the next instruction, PUSH/POP pairs and code after an
+// unconditional jump are removed. Removed words are then squeezed out and
+// labels, local references and fixups remapped.
+struct KnownValue {
+    bool known = false;
+    uint32_t value = 0;
+};
+
+inline uint32_t fieldOp(uint32_t w) { return w >> 28; }
+inline uint32_t fieldRd(uint32_t w) { return (w >> 24) & 0xF; }
+inline uint32_t fieldRs1(uint32_t w) { return (w >> 20) & 0xF; }
+inline uint32_t fieldRs2(uint32_t w) { return (w >> 16) & 0xF; }
+inline uint32_t fieldMode(uint32_t w) { return w & 0xFF; }
+inline uint32_t fieldImm(uint32_t w) { return (w >> 8) & 0xFFFF; }
+inline uint32_t signExtend16(uint32_t v) { return (uint32_t)(int32_t)(int16_t)v; }
+
+// Does the instruction read register r?
+static bool readsRegister(uint32_t w, uint32_t r) {
+    uint32_t op = fieldOp(w), mode = fieldMode(w);
+    switch (op) {
+    case OP_MOV: return mode == MODE_LO ? fieldRd(w) == r : mode == 0 && fieldRs1(w) == r;
+    case OP_CMP: return fieldRd(w) == r || (mode == 0 && fieldRs1(w) == r);
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_SLT: return fieldRs1(w) == r || fieldRs2(w) == r;
+    case OP_SHL: case OP_SRL: return fieldRs1(w) == r || (mode == 0 && fieldRs2(w) == r);
+    case OP_PUSH: case OP_DEC: return fieldRd(w) == r;
+    default: return false;
+    }
+}
+
+static size_t peephole(AssembledProgram& prog) {
+    vector<uint32_t>& words = prog.words;
+    size_t n = words.size();
+    vector<bool> blockStart(n + 1, false), keep(n, true);
+    blockStart[0] = true;
+    for (const LabelDef& def : prog.definitions) {
+        if (def.address / 4 <= n) blockStart[def.address / 4] = true;
+    }
+
+    KnownValue regs[16];
+    int flag = -1;      // JE outcome when decided: 1 taken, 0 not taken
+    bool dead = false;  // after JMP/RET until the next label
+    size_t last = SIZE_MAX;  // previous surviving word of this block
+    size_t saved = 0;
+    auto drop = [&](size_t i) {
+        keep[i] = false;
+        saved++;
+    };
+
+    for (size_t i = 0; i < n; i++) {
+        if (blockStart[i]) {
+            for (KnownValue& k : regs) k = KnownValue();
+            flag = -1;
+            dead = false;
+            last = SIZE_MAX;
+        }
+        if (dead) {
+            drop(i);
+            continue;
+        }
+
+        uint32_t& w = words[i];
+        uint32_t op = fieldOp(w), rd = fieldRd(w), rs1 = fieldRs1(w), rs2 = fieldRs2(w);
+        uint32_t mode = fieldMode(w), imm = fieldImm(w);
+        KnownValue result;
+        bool writesRd = false;
+
+        switch (op) {
+        case OP_MOV:
+            writesRd = true;
+            if (mode == MODE_IMM) result = {true, signExtend16(imm)};
+            else if (mode == MODE_HI) result = {true, imm << 16};
+            else if (mode == MODE_LO) result = {regs[rd].known, (regs[rd].value & 0xFFFF0000) | imm};
+            else result = regs[rs1];
+            if ((mode == 0 && rs1 == rd) || (result.known && regs[rd].known && result.value == regs[rd].value)) {
+                drop(i);
+                continue;
+            }
+            // The previous MOV to rd is dead if this one does not read it
+            if (last != SIZE_MAX && fieldOp(words[last]) == OP_MOV && fieldMode(words[last]) != MODE_LO &&
+                mode != MODE_LO && fieldRd(words[last]) == rd && !readsRegister(w, rd)) {
+                drop(last);
+            }
+            break;
+        case OP_CMP: {
+            KnownValue rhs = mode == MODE_IMM ? KnownValue{true, signExtend16(imm)} : regs[rs1];
+            flag = regs[rd].known && rhs.known ? (regs[rd].value == rhs.value) : -1;
+            break;
+        }
+        case OP_JE:
+            if (flag == 0) {
+                drop(i);
+                continue;
+            }
+            if (flag == 1) {
+                w = (w & 0x0FFFFFFF) | (OP_JMP << 28);
+                dead = true;
+            }
+            break;
+        case OP_JMP:
+        case OP_RET:
+            dead = true;
+            break;
+        case OP_CALL:
+            for (KnownValue& k : regs) k = KnownValue();
+            flag = -1;
+            break;
+        case OP_POP:
+            writesRd = true;
+            if (last != SIZE_MAX && fieldOp(words[last]) == OP_PUSH) {
+                uint32_t pushed = fieldRd(words[last]);
+                drop(last);
+                if (pushed == rd) {
+                    drop(i);
+                    last = SIZE_MAX;
+                    continue;
+                }
+                w = encodeReg(OP_MOV, rd, pushed);
+                result = regs[pushed];
+            }
+            break;
+        case OP_MUL: {
+            writesRd = true;
+            KnownValue a = regs[rs1], b = regs[rs2];
+            if (a.known && b.known) {
+                result = {true, a.value * b.value};
+                break;
+            }
+            uint32_t src = rs1;
+            if (a.known) {
+                swap(a, b);
+                src = rs2;
+            }
+            if (b.known && b.value == 0) {
+                w = encodeImm(OP_MOV, rd, 0, MODE_IMM);
+                result = {true, 0};
+            } else if (b.known && (b.value & (b.value - 1)) == 0) {
+                uint32_t shift = 0;
+                while ((1u << shift) != b.value) shift++;
+                w = shift == 0 ? encodeReg(OP_MOV, rd, src) : encodeShift(OP_SHL, rd, src, shift);
+                result = shift == 0 ? regs[src] : KnownValue();
+            }
+            break;
+        }
+        case OP_ADD:
+        case OP_SUB:
+            writesRd = true;
+            if (regs[rs1].known && regs[rs2].known) {
+                uint32_t a = regs[rs1].value, b = regs[rs2].value;
+                result = {true, op == OP_ADD ? a + b : a - b};
+            }
+            break;
+        case OP_SHL:
+            writesRd = true;
+            if (regs[rs1].known && mode == MODE_IMM) result = {true, regs[rs1].value << (imm & 0x1F)};
+            break;
+        case OP_SRL:
+            writesRd = true;
+            if (regs[rs1].known && mode == MODE_IMM) result = {true, regs[rs1].value >> (imm & 0x1F)};
+            break;
+        case OP_SLT:
+            writesRd = true;
+            if (regs[rs1].known && regs[rs2].known) result = {true, (int32_t)regs[rs1].value < (int32_t)regs[rs2].value};
+            break;
+        case OP_DEC:
+            writesRd = true;
+            if (regs[rd].known) result = {true, regs[rd].value - 1};
+            break;
+        default:
+            break;
+        }
+        if (writesRd) regs[rd] = result;
+        last = i;
+    }
+    if (saved == 0) return 0;
+
+    // Squeeze out removed words; a label on a removed word moves to the
+    // next surviving one.
+    vector<uint32_t> newIndex(n + 1);
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        newIndex[i] = (uint32_t)kept;
+        if (keep[i]) words[kept++] = words[i];
+    }
+    newIndex[n] = (uint32_t)kept;
+    words.resize(kept);
+    auto moveAddress = [&](uint32_t address) { return address / 4 <= n ? newIndex[address / 4] * 4 : address; };
+    for (LabelDef& def : prog.definitions) {
+        def.address = moveAddress(def.address);
+        prog.labels[def.name] = def.address;
+    }
+    vector<size_t> refs;
+    for (size_t index : prog.localRefs) {
+        if (!keep[index]) continue;
+        uint32_t& word = words[newIndex[index]];
+        word = (word & ~(0xFFFFu << 8)) | ((moveAddress(fieldImm(word)) & 0xFFFF) << 8);
+        refs.push_back(newIndex[index]);
+    }
+    prog.localRefs.swap(refs);
+    vector<Fixup> fixups;
+    for (Fixup& f : prog.fixups) {
+        if (!keep[f.index]) continue;
+        f.index = newIndex[f.index];
+        fixups.push_back(std::move(f));
+    }
+    prog.fixups.swap(fixups);
+    prog.saved += saved;
+    return saved;
+}
+
+void finishProgram(AssembledProgram& prog, bool keepUnresolved, bool optimize) {
+    if (optimize) peephole(prog);
+    resolveFixups(prog, keepUnresolved);
+    stable_sort(prog.diagnostics.begin(), prog.diagnostics.end(),
+                [](const Diagnostic& a, const Diagnostic& b) { return a.line < b.line; });
+}
+
+// Assemble the lines in [begin, end) as an independent program whose
+// addresses start at 0, echoing to `trace` as assembleSource does.
+static void assembleChunk(const char* begin, const char* end, AssembledProgram& prog, bool optimize,
+                          ostream* trace = nullptr) {
+    int lineNo = 0;
+    while (begin < end) {
+        const char* nl = static_cast<const char*>(memchr(begin, '\n', end - begin));
+        const char* stop = nl ? nl : end;
+        lineNo++;
+        if (stop > begin && *begin != '#') { // Ignore empty lines and comments
+            string_view line(begin, stop - begin);
+            if (trace) *trace << "Reading line " << lineNo << ": " << line << endl;
+            size_t first = prog.words.size();
+            if (assembleLine(line, lineNo, prog) && trace) {
+                for (size_t i = first; i < prog.words.size(); i++) {
+                    *trace << "Converted binary instruction: " << bitset<32>(prog.words[i]) << endl;
+                }
+            }
+        }
+        begin = stop + 1;
+    }
+    prog.lines = lineNo;
+    finishProgram(prog, true, optimize);
+}
+
+// Output image: ABIN version 1, see Object_Format.h
+const size_t WRITER_BUFFER_SIZE = 1 << 20;
+
+// Streams 32-bit words into a large buffer and hands it to the OS in one
+// write() per chunk. Words are serialized byte by byte, so the file is the
+// same whatever the host's endianness or the compiler's type sizes. The
+// second constructor appends the same bytes to a vector instead of a file.
+class BinaryWriter {
+public:
+    explicit BinaryWriter(const string& path) : buffer(WRITER_BUFFER_SIZE), used(0), failed(false) {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        failed = fd < 0;
     }
 
-    string line;
-    vector<string> binaryInstructions;
-    int currentLine = 0;
+    explicit BinaryWriter(vector<uint8_t>& memory) : buffer(4096), used(0), fd(-1), failed(false), memory(&memory) {}
 
-    // First pass: Gather label locations
-    while (getline(asmFile, line)) {
-        if (line.empty() || line[0] == '#') continue; // Ignore empty lines and comments
+    ~BinaryWriter() { close(); }
 
-        cout << "Reading line " << currentLine << ": " << line << endl;  // Print the line being read
+    void putWord(uint32_t w) {
+        if (used + 4 > buffer.size()) flush();
+        uint8_t* p = buffer.data() + used;
+        p[0] = w >> 24;
+        p[1] = w >> 16;
+        p[2] = w >> 8;
+        p[3] = w;
+        used += 4;
+    }
 
-        bool isLabel = false;
-        string binaryCode = convertToBinary(line, isLabel);
+    void putWords(const vector<uint32_t>& words) {
+        for (uint32_t w : words) putWord(w);
+    }
 
-        if (isLabel) {
-            // Mark label address in labelMap
-            string label = line.substr(0, line.size() - 1);  // Remove the colon
-            labelMap[label] = currentLine;
-            cout << "Label found: " << label << " at line " << currentLine << endl;  // Print label
-        } else if (!binaryCode.empty()) {
-            binaryInstructions.push_back(binaryCode);
-            cout << "Converted binary instruction: " << binaryCode << endl;  // Print converted binary code
+    void putBytes(const char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (used == buffer.size()) flush();
+            buffer[used++] = (uint8_t)p[i];
         }
+    }
 
-        currentLine++;
+    // Length-prefixed, for the assembly cache
+    void putString(const string& s) {
+        putWord((uint32_t)s.size());
+        putBytes(s.data(), s.size());
     }
 
-    // Debug: Print label map
-    cout << "\nLabel Map after first pass:" << endl;
-    for (const auto& label : labelMap) {
-        cout << label.first << " : " << label.second << endl;
+    void flush() {
+        if (memory) {
+            memory->insert(memory->end(), buffer.begin(), buffer.begin() + used);
+            used = 0;
+            return;
+        }
+        size_t off = 0;
+        while (!failed && off < used) {
+            ssize_t n = ::write(fd, buffer.data() + off, used - off);
+            if (n <= 0) failed = true;
+            else off += n;
+        }
+        used = 0;
     }
 
-    // Second pass: Resolve labels and generate final binary
-    vector<string> finalBinaryInstructions;
-    for (const auto& instruction : binaryInstructions) {
-        cout << "\nProcessing instruction: " << instruction << endl;
+    // Returns false if anything failed since the file was opened.
+    bool close() {
+        if (memory) flush();
+        if (fd >= 0) {
+            flush();
+            if (::close(fd) != 0) failed = true;
+            fd = -1;
+        }
+        return !failed;
+    }
 
-        string resolvedInstruction = instruction;
-        size_t pos;
-        for (const auto& label : labelMap) {
-            pos = resolvedInstruction.find(label.first);
-            if (pos != string::npos) {
-                // Replace label with its corresponding address (simplified for now)
-                string address = bitset<16>(label.second).to_string();  // Assuming 16-bit addresses
-                resolvedInstruction.replace(pos, label.first.length(), address);
-                cout << "Resolved label: " << label.first << " with address: " << address << endl;
+private:
+    vector<uint8_t> buffer;
+    size_t used;
+    int fd;
+    bool failed;
+    vector<uint8_t>* memory = nullptr;
+};
+
+struct SourceChunk {
+    const char* begin;
+    const char* end;
+};
+
+// Run f(0) .. f(n-1) on up to `threads` threads.
+template <typename F>
+static void parallelFor(size_t n, unsigned threads, F f) {
+    unsigned count = (unsigned)min<size_t>(max(1u, threads), n);
+    if (count <= 1) {
+        for (size_t i = 0; i < n; i++) f(i);
+        return;
+    }
+    vector<thread> workers;
+    for (unsigned t = 0; t < count; t++) {
+        workers.emplace_back([&, t] {
+            for (size_t i = t; i < n; i += count) f(i);
+        });
+    }
+    for (thread& w : workers) w.join();
+}
+
+// Does the line [line, end) define a label? Local labels ("." prefix)
+// count only with includeLocal.
+static bool definesLabel(const char* line, const char* end, bool includeLocal) {
+    while (line < end && (*line == ' ' || *line == '\t')) line++;
+    if (line == end || *line == '#' || (*line == '.' && !includeLocal)) return false;
+    const char* colon = find(line, end, ':');
+    if (colon == end) return false;
+    const char* comment = find_if(line, colon, [](char c) { return c == '#' || c == ';'; });
+    return comment == colon;
+}
+
+// Cut the source into `parts` roughly equal chunks at line boundaries. With
+// alignToLabels (the peephole pass is on) each cut is moved forward to the
+// next label line, so chunks start on basic block boundaries and the pass
+// sees the same blocks as a serial build; a cut with no label before the
+// next one stays where it was, so a label-sparse source is still split.
+static vector<SourceChunk> splitEvenly(string_view source, unsigned parts, bool alignToLabels) {
+    vector<SourceChunk> ranges;
+    const char* data = source.data();
+    const char* end = data + source.size();
+    const char* begin = data;
+    for (unsigned i = 1; i <= parts && begin < end; i++) {
+        const char* cut = i == parts ? end : data + source.size() * i / parts;
+        if (cut < begin) cut = begin;
+        const char* nl = static_cast<const char*>(memchr(cut, '\n', end - cut));
+        const char* stop = nl ? nl + 1 : end;
+        if (alignToLabels) {
+            const char* limit = i + 1 >= parts ? end : data + source.size() * (i + 1) / parts;
+            for (const char* line = stop; line < limit;) {
+                const char* next = static_cast<const char*>(memchr(line, '\n', end - line));
+                if (definesLabel(line, next ? next : end, true)) {
+                    stop = line;
+                    break;
+                }
+                line = next ? next + 1 : end;
+            }
+        }
+        ranges.push_back({begin, stop});
+        begin = stop;
+    }
+    return ranges;
+}
+
+// Combine separately assembled chunks, in source order, into one program.
+// The chunk tables are merged into one global table (chunk base = prefix sum
+// of chunk sizes), then a parallel pass rebases each chunk's local
+// references, resolves its cross-chunk fixups and copies its words into
+// place. The result is identical to assembling the source serially. With
+// keepUnresolved (object output) undefined labels stay as fixups and the
+// rebased local references are kept for relocation.
+AssembledProgram linkChunks(vector<AssembledProgram>& chunks, unsigned threads,
+                            bool keepUnresolved = false) {
+    AssembledProgram out;
+    vector<uint32_t> base(chunks.size());
+    vector<int> firstLine(chunks.size());
+    size_t totalWords = 0, totalLabels = 0;
+    int lines = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        base[i] = (uint32_t)totalWords * 4;
+        firstLine[i] = lines;
+        totalWords += chunks[i].words.size();
+        totalLabels += chunks[i].definitions.size();
+        lines += chunks[i].lines;
+    }
+    out.labels.reserve(totalLabels);
+    out.definitions.reserve(totalLabels);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        for (const Diagnostic& d : chunks[i].diagnostics) {
+            out.diagnostics.push_back({d.line + firstLine[i], d.message});
+        }
+        for (const LabelDef& def : chunks[i].definitions) {
+            LabelDef global = {def.name, def.address + base[i], def.line + firstLine[i]};
+            if (out.labels.emplace(global.name, global.address).second) {
+                out.definitions.push_back(global);
+            } else {
+                out.diagnostics.push_back({global.line, "duplicate label '" + global.name + "'"});
             }
         }
+    }
+    out.lines = lines;
+    for (const AssembledProgram& c : chunks) out.saved += c.saved;
+
+    out.words.resize(totalWords);
+    vector<vector<Diagnostic>> undefinedRefs(chunks.size());
+    vector<vector<size_t>> localRefs(chunks.size());
+    vector<vector<Fixup>> pending(chunks.size());
+    parallelFor(chunks.size(), threads, [&](size_t i) {
+        const AssembledProgram& c = chunks[i];
+        size_t first = base[i] / 4;
+        uint32_t* dst = out.words.data() + first;
+        copy(c.words.begin(), c.words.end(), dst);
+        for (size_t index : c.localRefs) {
+            addToTarget(dst[index], base[i]);
+            if (keepUnresolved) localRefs[i].push_back(first + index);
+        }
+        for (const Fixup& f : c.fixups) {
+            auto it = out.labels.find(f.label);
+            if (it != out.labels.end()) {
+                addToTarget(dst[f.index], it->second);
+                if (keepUnresolved) localRefs[i].push_back(first + f.index);
+            } else if (keepUnresolved) {
+                pending[i].push_back({first + f.index, f.label, f.line + firstLine[i]});
+            } else {
+                undefinedRefs[i].push_back({f.line + firstLine[i], "undefined label '" + f.label + "'"});
+            }
+        }
+    });
+    for (size_t i = 0; i < chunks.size(); i++) {
+        out.diagnostics.insert(out.diagnostics.end(), undefinedRefs[i].begin(), undefinedRefs[i].end());
+        out.localRefs.insert(out.localRefs.end(), localRefs[i].begin(), localRefs[i].end());
+        out.fixups.insert(out.fixups.end(), pending[i].begin(), pending[i].end());
+    }
+    return out;
+}
+
+// Parallel assembly: one chunk per thread, each with its own label table.
+AssembledProgram assembleParallel(string_view source, unsigned threads, bool keepUnresolved = false,
+                                  bool optimize = false) {
+    vector<SourceChunk> ranges = splitEvenly(source, threads, optimize);
+    vector<AssembledProgram> chunks(ranges.size());
+    parallelFor(ranges.size(), threads, [&](size_t i) {
+        assembleChunk(ranges[i].begin, ranges[i].end, chunks[i], optimize);
+    });
+    return linkChunks(chunks, threads, keepUnresolved);
+}
+
+//--------------------------------------
+// Incremental assembly cache
+//--------------------------------------
+// The source is split into units, one per function: a unit starts at every
+// label whose name does not begin with '.', so ".loop:"-style labels stay
+// with their function. Each unit is assembled as an independent chunk and
+// its result (words, labels, local references, pending fixups) is cached
+// under a hash of the unit text and the assembler options. On the next
+// build only units whose text changed are re-encoded; linkChunks stitches
+// cached and fresh units together exactly as in a parallel build. An entry
+// also records the unit's length and a second, unrelated hash of it, and
+// is only reused when both match too, so a collision of the key is a miss.
+const uint32_t CACHE_MAGIC = 0x41434348;  // "ACCH"
+const uint32_t CACHE_VERSION = 3;
+// Everything that affects encoding; bump when the encoder changes.
+const string ASSEMBLER_OPTIONS = "encoding=2";
+
+static uint64_t hashBytes(const char* p, size_t n, uint64_t h = 1469598103934665603ull) {
+    for (size_t i = 0; i < n; i++) {
+        h ^= (uint8_t)p[i];
+        h *= 1099511628211ull;  // FNV-1a
+    }
+    return h;
+}
+
+// The check hash: eight bytes at a time through the splitmix64 finalizer
+static uint64_t checkHash(const char* p, size_t n) {
+    uint64_t h = n;
+    for (size_t i = 0; i < n; i += 8) {
+        uint64_t w = 0;
+        for (size_t b = 0; b < 8 && i + b < n; b++) w |= (uint64_t)(uint8_t)p[i + b] << (8 * b);
+        h = (h ^ w) + 0x9e3779b97f4a7c15ull;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        h ^= h >> 31;
+    }
+    return h;
+}
+
+struct UnitKey {
+    uint64_t hash = 0;    // of the options and the text; indexes the cache
+    uint64_t length = 0;  // of the text
+    uint64_t check = 0;   // checkHash of the text
+};
+
+static vector<SourceChunk> splitUnits(string_view source) {
+    vector<SourceChunk> units;
+    const char* p = source.data();
+    const char* end = p + source.size();
+    const char* unitStart = p;
+    while (p < end) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* stop = nl ? nl : end;
+        if (p > unitStart && definesLabel(p, stop, false)) {
+            units.push_back({unitStart, p});
+            unitStart = p;
+        }
+        p = nl ? nl + 1 : end;
+    }
+    if (unitStart < end) units.push_back({unitStart, end});
+    return units;
+}
+
+class AssemblyCache {
+public:
+    // Entries are decoded lazily; only the index is built at load time.
+    bool load(const string& path) {
+        ifstream in(path, ios::binary);
+        if (!in) return false;
+        data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        pos = 0;
+        end = data.size();
+        if (data.size() < 12 || get32() != CACHE_MAGIC || get32() != CACHE_VERSION) {
+            data.clear();
+            return false;
+        }
+        uint32_t count = get32();
+        for (uint32_t i = 0; i < count && pos + 12 <= data.size(); i++) {
+            uint64_t key = get64();
+            uint32_t size = get32();
+            if (size > data.size() - pos) break;  // truncated file: keep the entries before it
+            index[key] = {pos, size};
+            pos += size;
+        }
+        return true;
+    }
+
+    // The file may be truncated or stale, so every count and length is
+    // checked against the bytes left in its entry; any mismatch is a miss.
+    bool lookup(const UnitKey& key, AssembledProgram& prog) {
+        auto it = index.find(key.hash);
+        if (it == index.end()) return false;
+        pos = it->second.first;
+        end = pos + it->second.second;
+        bad = false;
+        if (get64() != key.length || get64() != key.check) return false;
+        prog.lines = get32();
+        prog.saved = get32();
+        prog.words.resize(getCount(4));
+        for (uint32_t& w : prog.words) w = get32();
+        uint32_t n = getCount(12);
+        for (uint32_t i = 0; i < n && !bad; i++) {
+            LabelDef def;
+            def.name = getString();
+            def.address = get32();
+            def.line = get32();
+            prog.labels.emplace(def.name, def.address);
+            prog.definitions.push_back(std::move(def));
+        }
+        prog.localRefs.resize(getCount(4));
+        for (size_t& r : prog.localRefs) {
+            r = get32();
+            if (r >= prog.words.size()) bad = true;
+        }
+        prog.fixups.resize(getCount(12));
+        for (Fixup& f : prog.fixups) {
+            f.index = get32();
+            f.line = get32();
+            f.label = getString();
+            if (f.index >= prog.words.size()) bad = true;
+        }
+        if (bad || pos != end) {
+            prog = AssembledProgram();
+            return false;
+        }
+        return true;
+    }
+
+    static bool save(const string& path, const vector<UnitKey>& keys,
+                     const vector<AssembledProgram>& units) {
+        BinaryWriter out(path);
+        vector<size_t> cacheable;
+        for (size_t i = 0; i < units.size(); i++) {
+            if (units[i].diagnostics.empty()) cacheable.push_back(i);  // errors are never cached
+        }
+        out.putWord(CACHE_MAGIC);
+        out.putWord(CACHE_VERSION);
+        out.putWord((uint32_t)cacheable.size());
+        for (size_t i : cacheable) {
+            const AssembledProgram& u = units[i];
+            uint32_t size = 4 * (9 + u.words.size() + u.localRefs.size()) + 4;
+            for (const LabelDef& d : u.definitions) size += 12 + d.name.size();
+            for (const Fixup& f : u.fixups) size += 12 + f.label.size();
+            out.putWord(keys[i].hash >> 32);
+            out.putWord((uint32_t)keys[i].hash);
+            out.putWord(size);
+            out.putWord(keys[i].length >> 32);
+            out.putWord((uint32_t)keys[i].length);
+            out.putWord(keys[i].check >> 32);
+            out.putWord((uint32_t)keys[i].check);
+            out.putWord(u.lines);
+            out.putWord((uint32_t)u.saved);
+            out.putWord((uint32_t)u.words.size());
+            out.putWords(u.words);
+            out.putWord((uint32_t)u.definitions.size());
+            for (const LabelDef& d : u.definitions) {
+                out.putString(d.name);
+                out.putWord(d.address);
+                out.putWord(d.line);
+            }
+            out.putWord((uint32_t)u.localRefs.size());
+            for (size_t r : u.localRefs) out.putWord((uint32_t)r);
+            out.putWord((uint32_t)u.fixups.size());
+            for (const Fixup& f : u.fixups) {
+                out.putWord((uint32_t)f.index);
+                out.putWord(f.line);
+                out.putString(f.label);
+            }
+        }
+        return out.close();
+    }
+
+private:
+    string data;
+    size_t pos = 0;
+    size_t end = 0;    // reads stop here: the file, or the entry being decoded
+    bool bad = false;  // a read ran past `end`
+    unordered_map<uint64_t, pair<size_t, uint32_t>> index;  // key -> (offset, size)
+
+    uint32_t get32() {
+        if (end - pos < 4) {
+            bad = true;
+            pos = end;
+            return 0;
+        }
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data()) + pos;
+        pos += 4;
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
 
-        // Ensure each instruction is 32-bit long
-        if (resolvedInstruction.size() < 32) {
-            resolvedInstruction = resolvedInstruction + string(32 - resolvedInstruction.size(), '0');
+    uint64_t get64() {
+        uint64_t hi = get32();
+        return (hi << 32) | get32();
+    }
+
+    // An element count, where each element takes at least `minBytes`
+    uint32_t getCount(size_t minBytes) {
+        uint32_t n = get32();
+        if (n > (end - pos) / minBytes) {
+            bad = true;
+            return 0;
         }
+        return n;
+    }
+
+    string getString() {
+        uint32_t n = get32();
+        if (n > end - pos) {
+            bad = true;
+            return string();
+        }
+        string s = data.substr(pos, n);
+        pos += n;
+        return s;
+    }
+};
+
+struct IncrementalStats {
+    size_t units = 0;
+    size_t reused = 0;
+};
+
+// Assemble with the on-disk unit cache at cachePath; `options` is every
+// setting that changes the encoding, so changing any of them misses.
+AssembledProgram assembleIncremental(string_view source, const string& cachePath,
+                                     const string& options, unsigned threads,
+                                     IncrementalStats& stats, bool keepUnresolved = false,
+                                     bool optimize = false) {
+    vector<SourceChunk> units = splitUnits(source);
+    uint64_t optionsHash = hashBytes(options.data(), options.size());
+    vector<UnitKey> keys(units.size());
+    parallelFor(units.size(), threads, [&](size_t i) {
+        size_t length = units[i].end - units[i].begin;
+        keys[i].hash = hashBytes(units[i].begin, length, optionsHash);
+        keys[i].length = length;
+        keys[i].check = checkHash(units[i].begin, length);
+    });
+
+    AssemblyCache cache;
+    cache.load(cachePath);
+    vector<AssembledProgram> chunks(units.size());
+    vector<size_t> misses;
+    for (size_t i = 0; i < units.size(); i++) {
+        if (!cache.lookup(keys[i], chunks[i])) misses.push_back(i);
+    }
+    parallelFor(misses.size(), threads, [&](size_t m) {
+        size_t i = misses[m];
+        assembleChunk(units[i].begin, units[i].end, chunks[i], optimize);
+    });
+    stats.units = units.size();
+    stats.reused = units.size() - misses.size();
+
+    if (!misses.empty() && !AssemblyCache::save(cachePath, keys, chunks)) {
+        cerr << "Warning: could not write assembly cache " << cachePath << endl;
+    }
+    return linkChunks(chunks, threads, keepUnresolved);
+}
 
-        finalBinaryInstructions.push_back(resolvedInstruction);
-        cout << "Final binary instruction: " << resolvedInstruction << endl;  // Print final instruction
+// Read-only mapping of the source file; the lexer works on views into it.
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            size = (size_t)st.st_size;
+            opened = true;
+            if (size > 0) {
+                void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) opened = false;
+                else data = static_cast<const char*>(p);
+            }
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return opened; }
+    string_view view() const { return data ? string_view(data, size) : string_view(); }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool opened = false;
+};
+
+// Entry point is the "main" label if there is one, else the first instruction.
+uint32_t entryPoint(const AssembledProgram& prog) {
+    auto it = prog.labels.find("main");
+    return it != prog.labels.end() ? it->second : 0;
+}
+
+static bool putImage(BinaryWriter& out, const AssembledProgram& prog) {
+    out.putWord(IMAGE_MAGIC);
+    out.putWord(IMAGE_VERSION);
+    out.putWord(entryPoint(prog));
+    out.putWord((uint32_t)prog.words.size() * 4);  // text
+    out.putWord(0);                                // data
+    out.putWord(0);                                // bss
+    out.putWords(prog.words);
+    return out.close();
+}
+
+// Relocatable object (see Object_Format.h): one .text section, a symbol
+// per label (names starting with '.' are local), an undefined symbol per
+// external label, and an ABS16 relocation for every label reference.
+static bool putObject(BinaryWriter& out, const AssembledProgram& prog) {
+    struct SymbolOut {
+        string name;
+        uint32_t section, value, flags;
+    };
+    struct RelocOut {
+        uint32_t offset, symbol;
+        int32_t addend;
+    };
+    vector<SymbolOut> symbols = {{".text", 0, 0, SYM_SECTION}};
+    for (const LabelDef& def : prog.definitions) {
+        symbols.push_back({def.name, 0, def.address, def.name[0] == '.' ? SYM_LOCAL : SYM_GLOBAL});
+    }
+    vector<RelocOut> relocs;
+    for (size_t index : prog.localRefs) {
+        relocs.push_back({(uint32_t)index * 4, 0, (int32_t)((prog.words[index] >> 8) & 0xFFFF)});
+    }
+    unordered_map<string, uint32_t> externals;
+    for (const Fixup& f : prog.fixups) {
+        auto it = externals.emplace(f.label, (uint32_t)symbols.size());
+        if (it.second) symbols.push_back({f.label, OBJ_UNDEF, 0, SYM_GLOBAL});
+        relocs.push_back({(uint32_t)f.index * 4, it.first->second, (int32_t)((prog.words[f.index] >> 8) & 0xFFFF)});
     }
+    sort(relocs.begin(), relocs.end(), [](const RelocOut& a, const RelocOut& b) { return a.offset < b.offset; });
 
-    // Debug: Print final binary instructions
-    cout << "\nFinal Binary Instructions before writing to file:" << endl;
-    for (const auto& bin : finalBinaryInstructions) {
-        cout << "Binary Instruction: " << bin << endl;
+    // String table: section name then symbol names
+    string strings = ".text";
+    strings += '\0';
+    vector<uint32_t> nameOffset(symbols.size(), 0);
+    for (size_t i = 1; i < symbols.size(); i++) {
+        nameOffset[i] = (uint32_t)strings.size();
+        strings += symbols[i].name;
+        strings += '\0';
     }
+    strings.resize((strings.size() + 3) & ~(size_t)3, '\0');
 
-    // Output the binary instructions
-    ofstream binFile("output.bin", ios::binary);
-    if (!binFile) {
-        cerr << "Error opening output binary file" << endl;
+    uint32_t textOffset = 4 * (OBJ_HEADER_WORDS + OBJ_SECTION_WORDS +
+                               OBJ_SYMBOL_WORDS * (uint32_t)symbols.size() +
+                               OBJ_RELOC_WORDS * (uint32_t)relocs.size()) +
+                          (uint32_t)strings.size();
+    out.putWord(OBJ_MAGIC);
+    out.putWord(OBJ_VERSION);
+    out.putWord(1);
+    out.putWord((uint32_t)symbols.size());
+    out.putWord((uint32_t)relocs.size());
+    out.putWord((uint32_t)strings.size());
+
+    out.putWord(0);  // ".text"
+    out.putWord(SECTION_TEXT);
+    out.putWord(textOffset);
+    out.putWord((uint32_t)prog.words.size() * 4);
+
+    for (size_t i = 0; i < symbols.size(); i++) {
+        out.putWord(nameOffset[i]);
+        out.putWord(symbols[i].section);
+        out.putWord(symbols[i].value);
+        out.putWord(symbols[i].flags);
+    }
+    for (const RelocOut& r : relocs) {
+        out.putWord(0);
+        out.putWord(r.offset);
+        out.putWord(r.symbol);
+        out.putWord(RELOC_ABS16);
+        out.putWord((uint32_t)r.addend);
+    }
+    out.putBytes(strings.data(), strings.size());
+    out.putWords(prog.words);
+    return out.close();
+}
+
+bool writeImage(const string& path, const AssembledProgram& prog) {
+    BinaryWriter out(path);
+    return putImage(out, prog);
+}
+
+bool writeObject(const string& path, const AssembledProgram& prog) {
+    BinaryWriter out(path);
+    return putObject(out, prog);
+}
+
+// The bytes writeObject would write, for callers that keep them in memory
+vector<uint8_t> objectBytes(const AssembledProgram& prog) {
+    vector<uint8_t> bytes;
+    BinaryWriter out(bytes);
+    putObject(out, prog);
+    return bytes;
+}
+
+AssembledProgram assembleSource(string_view source, bool keepUnresolved, bool optimize, ostream* trace) {
+    AssembledProgram prog;
+    assembleChunk(source.data(), source.data() + source.size(), prog, optimize, trace);
+    if (!keepUnresolved) resolveFixups(prog);
+    stable_sort(prog.diagnostics.begin(), prog.diagnostics.end(),
+                [](const Diagnostic& a, const Diagnostic& b) { return a.line < b.line; });
+    return prog;
+}
+
+}  // namespace atob
+
+#ifndef TOOLCHAIN_LIBRARY
+using namespace atob;
+
+int main(int argc, char* argv[]) {
+    // Usage: atob [-c] [-O] [-v] [--bench] [-j threads] [--cache file] [input.asm [output]]
+    // -c writes a relocatable object (default output.o) instead of an image.
+    // -O runs the peephole pass; numeric branch targets are not adjusted.
+    unsigned threads = 1;
+    string cachePath;
+    bool verbose = false, bench = false, objectOutput = false, optimize = false;
+    vector<string> files;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) threads = max(1, stoi(argv[++i]));
+        else if (arg == "--cache" && i + 1 < argc) cachePath = argv[++i];
+        else if (arg == "-v") verbose = true;
+        else if (arg == "--bench") bench = true;
+        else if (arg == "-c") objectOutput = true;
+        else if (arg == "-O") optimize = true;
+        else files.push_back(arg);
+    }
+    string inputPath = files.size() > 0 ? files[0] : "input.asm";
+    string outputPath = files.size() > 1 ? files[1] : objectOutput ? "output.o" : "output.bin";
+
+    // Map the assembly source
+    MappedFile asmFile(inputPath);
+    if (!asmFile.ok()) {
+        cerr << "Error opening assembly file" << endl;
+        return 1;
+    }
+    string_view source = asmFile.view();
+
+    auto start = chrono::steady_clock::now();
+    AssembledProgram prog;
+    if (!cachePath.empty()) {
+        IncrementalStats stats;
+        string options = ASSEMBLER_OPTIONS + (optimize ? " -O" : "");
+        prog = assembleIncremental(source, cachePath, options, threads, stats, objectOutput, optimize);
+        cout << "Reused " << stats.reused << " of " << stats.units << " units from " << cachePath << endl;
+    } else if (threads > 1) {
+        prog = assembleParallel(source, threads, objectOutput, optimize);
+    } else {
+        prog = assembleSource(source, objectOutput, optimize, verbose ? &cout : nullptr);
+    }
+    if (optimize) {
+        cout << "Peephole pass saved " << prog.saved << " instruction(s)" << endl;
+    }
+    if (bench) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        size_t lines = prog.lines;
+        if (lines == 0) lines = (size_t)count(source.begin(), source.end(), '\n');
+        cout << "Assembled " << lines << " lines in " << seconds << " s ("
+             << (size_t)(lines / max(seconds, 1e-9)) << " lines/s)" << endl;
+    }
+
+    stable_sort(prog.diagnostics.begin(), prog.diagnostics.end(),
+                [](const Diagnostic& a, const Diagnostic& b) { return a.line < b.line; });
+    for (const Diagnostic& d : prog.diagnostics) {
+        cerr << "line " << d.line << ": " << d.message << endl;
+    }
+    if (!prog.diagnostics.empty()) {
+        cerr << prog.diagnostics.size() << " error(s); no output written" << endl;
         return 1;
     }
 
-    for (const auto& bin : finalBinaryInstructions) {
-        bitset<32> binary(bin);  // Ensure 32-bit output
-        binFile.write(reinterpret_cast<const char*>(&binary), sizeof(binary));
+    if (verbose) {
+        // Debug: Print label map
+        cout << "\nLabel Map:" << endl;
+        for (const auto& label : prog.labels) {
+            cout << label.first << " : " << label.second << endl;
+        }
+
+        // Debug: Print final binary instructions
+        cout << "\nFinal Binary Instructions before writing to file:" << endl;
+        for (uint32_t word : prog.words) {
+            cout << "Binary Instruction: " << bitset<32>(word) << endl;
+        }
     }
 
-    binFile.close();
-    cout << "Binary instructions written to output.bin" << endl;
+    // Output the binary image or object
+    if (!(objectOutput ? writeObject(outputPath, prog) : writeImage(outputPath, prog))) {
+        cerr << "Error writing output binary file" << endl;
+        return 1;
+    }
+    cout << "Binary instructions written to " << outputPath << endl;
 
     return 0;
 }
+#endif
@@ -0,0 +1,85 @@
+#ifndef ASSEMBLY_TO_BINARY_H
+#define ASSEMBLY_TO_BINARY_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Library interface of the assembler (Assembly_to_Binary.cpp). Toolchain.cpp
+// links against it; the atob tool is the same source with its main().
+namespace atob {
+
+enum OpcodeValue : uint32_t {
+    OP_MOV = 0x0, OP_ADD, OP_SUB, OP_CMP, OP_JMP, OP_CALL, OP_RET,
+    OP_PUSH, OP_POP, OP_DEC, OP_MUL, OP_JE, OP_SHL, OP_SLT, OP_SRL,
+    PSEUDO_LI = 0x10, PSEUDO_MOVE, PSEUDO_CLR, PSEUDO_BEQZ
+};
+
+// A branch whose label was not yet defined when it was encoded. The target
+// field is left zero and patched once every label is known.
+struct Fixup {
+    size_t index;   // instruction word to patch
+    std::string label;
+    int line;       // source line, for diagnostics
+};
+
+struct LabelDef {
+    std::string name;
+    uint32_t address;
+    int line;
+};
+
+struct Diagnostic {
+    int line;
+    std::string message;
+};
+
+struct AssembledProgram {
+    std::vector<uint32_t> words;
+    std::unordered_map<std::string, uint32_t> labels;  // label -> byte address
+    std::vector<LabelDef> definitions;                 // labels in source order
+    std::vector<Fixup> fixups;
+    std::vector<size_t> localRefs;   // words whose target is a label of this program
+    std::vector<Diagnostic> diagnostics;
+    int lines = 0;                   // source lines consumed
+    size_t saved = 0;                // instructions removed by the peephole pass
+};
+
+// One instruction with its operands already parsed, for a front end that
+// generates code in memory instead of as text. Operands are in source
+// order: MOV, CMP, SHL and SRL take imm when their last register is -1;
+// target is the label (or number) of JMP, JE, CALL and BEQZ and must stay
+// valid until the program is finished.
+struct Instruction {
+    uint32_t opcode;  // an OpcodeValue, pseudo-instructions included
+    int rd = -1, rs1 = -1, rs2 = -1;
+    int64_t imm = 0;
+    std::string_view target = {};
+};
+
+// Building a program statement by statement; `line` numbers diagnostics.
+// finishProgram runs the peephole pass when `optimize` is set and patches
+// references to labels the program defines. With keepUnresolved the rest
+// stay as fixups for an object file; otherwise they are diagnostics.
+void defineLabel(std::string_view name, int line, AssembledProgram& prog);
+bool assembleInstruction(const Instruction& in, int line, AssembledProgram& prog);
+void finishProgram(AssembledProgram& prog, bool keepUnresolved, bool optimize);
+
+// Assemble a whole source held in memory, single-threaded, with the same
+// meaning of keepUnresolved. With a trace stream, each line read and the
+// words it encodes to are echoed there (atob -v).
+AssembledProgram assembleSource(std::string_view source, bool keepUnresolved, bool optimize,
+                                std::ostream* trace = nullptr);
+
+// Output formats of Object_Format.h: an ABIN image, or an AOBJ object that
+// keeps unresolved labels as undefined symbols.
+bool writeImage(const std::string& path, const AssembledProgram& prog);
+bool writeObject(const std::string& path, const AssembledProgram& prog);
+std::vector<uint8_t> objectBytes(const AssembledProgram& prog);
+
+}  // namespace atob
+
+#endif
@@ -4,6 +4,32 @@
 #include <iomanip>
 #include <stdexcept>
 #include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <csetjmp>
+#include <csignal>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 //--------------------------------------
 // Configurations
@@ -11,6 +37,10 @@
 static const uint32_t MEMORY_SIZE = 65536; // 64KB memory (in bytes)
 static const uint8_t NUM_REGISTERS = 32;   // 32 GPR
 static const uint32_t HALT_INSTR = 0xFC000000; 
+static const uint32_t BREAK_INSTR = 0x0000000D; // R-type funct 0x0D
+static const uint64_t GUEST_ADDRESS_SPACE = 1ull << 32; // every uint32_t address
+static const uint64_t GUARD_SIZE = 65536;               // catches words straddling 4GB
+static const size_t BATCH_CONSOLE_LIMIT = 4096;         // console values kept per direction in batch mode
 
 //--------------------------------------
 // Flags Register Bits: (Z, C, V, S)
@@ -22,6 +52,348 @@ struct Flags {
     bool sign;      // S
 };
 
+//--------------------------------------
+// Guest Memory
+//--------------------------------------
+// The whole 32-bit guest address space (plus a trailing guard) is reserved as
+// one PROT_NONE mapping and only the first MEMORY_SIZE bytes are made
+// readable/writable. Any guest address is then a valid offset into the
+// reservation, so fetch, load and store index it directly: an out-of-range
+// access lands on a guard page and the fault handler below turns it into a
+// guest exception. Word accesses go through at() so addr+3 never wraps.
+struct GuestMemory {
+    uint8_t* base;
+
+    GuestMemory() {
+        void* p = mmap(nullptr, GUEST_ADDRESS_SPACE + GUARD_SIZE, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("Failed to reserve guest address space");
+        }
+        base = static_cast<uint8_t*>(p);
+        if (mprotect(base, MEMORY_SIZE, PROT_READ | PROT_WRITE) != 0) {
+            munmap(base, GUEST_ADDRESS_SPACE + GUARD_SIZE);
+            throw std::runtime_error("Failed to commit guest memory");
+        }
+    }
+
+    ~GuestMemory() { munmap(base, GUEST_ADDRESS_SPACE + GUARD_SIZE); }
+
+    GuestMemory(const GuestMemory&) = delete;
+    GuestMemory& operator=(const GuestMemory&) = delete;
+
+    uint8_t& operator[](uint32_t addr) { return base[addr]; }
+    uint8_t* at(uint32_t addr) { return base + addr; }
+
+    bool contains(const void* host) const {
+        const uint8_t* p = static_cast<const uint8_t*>(host);
+        return p >= base && p < base + GUEST_ADDRESS_SPACE + GUARD_SIZE;
+    }
+};
+
+//--------------------------------------
+// Guest Fault Handling
+//--------------------------------------
+// CPU::run() arms a per-thread landing pad; a host SIGSEGV/SIGBUS inside the
+// guest reservation long-jumps back to it with the faulting guest address.
+// Faults anywhere else are host bugs and get the default action.
+struct FaultContext {
+    sigjmp_buf env;
+    const GuestMemory* mem;
+    volatile uint32_t address;
+};
+
+static thread_local FaultContext* activeFault = nullptr;
+
+static void guestFaultHandler(int sig, siginfo_t* info, void*) {
+    FaultContext* ctx = activeFault;
+    if (ctx && ctx->mem->contains(info->si_addr)) {
+        ctx->address = (uint32_t)(static_cast<uint8_t*>(info->si_addr) - ctx->mem->base);
+        siglongjmp(ctx->env, 1);
+    }
+    signal(sig, SIG_DFL); // re-executing the access now crashes as usual
+}
+
+static void installFaultHandler() {
+    static bool installed = [] {
+        struct sigaction sa = {};
+        sa.sa_sigaction = guestFaultHandler;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, nullptr);
+        sigaction(SIGBUS, &sa, nullptr); // macOS reports PROT_NONE hits as SIGBUS
+        return true;
+    }();
+    (void)installed;
+}
+
+//--------------------------------------
+// Record / Replay
+//--------------------------------------
+// With recording on, the CPU takes a checkpoint every `interval` retired
+// instructions (registers, PC, HI/LO, flags and only the memory pages
+// dirtied since the previous checkpoint) and logs every nondeterministic
+// input it consumes. Any earlier instruction count can then be reached
+// again by restoring the nearest checkpoint and replaying forward, with
+// inputs served from the log so the replay is exact.
+static const uint32_t CHECKPOINT_PAGE_SHIFT = 8; // 256-byte dirty granularity
+static const uint32_t CHECKPOINT_PAGE_SIZE = 1u << CHECKPOINT_PAGE_SHIFT;
+static const uint32_t CHECKPOINT_PAGES = MEMORY_SIZE >> CHECKPOINT_PAGE_SHIFT;
+static const uint64_t DEFAULT_CHECKPOINT_INTERVAL = 1000000;
+static const uint64_t NO_WRITE = UINT64_MAX;
+
+struct Checkpoint {
+    uint64_t icount;
+    uint32_t registers[NUM_REGISTERS];
+    uint32_t pc, hi, lo;
+    uint8_t flagReg;
+    std::vector<uint32_t> pages; // pages saved by this checkpoint
+    std::vector<uint8_t> data;   // their contents, CHECKPOINT_PAGE_SIZE each
+};
+
+struct InputEvent {
+    uint64_t icount; // instruction that consumed the value
+    uint32_t value;
+};
+
+struct Recorder {
+    uint64_t interval;
+    std::vector<Checkpoint> checkpoints;  // ordered by icount
+    std::vector<InputEvent> inputs;       // ordered by icount
+    size_t inputCursor = 0;               // next log entry to serve on replay
+    uint64_t frontier = 0;                // furthest instruction count ever reached
+    uint8_t dirty[CHECKPOINT_PAGES] = {};
+
+    // Per page, the checkpoints that saved it: (checkpoint index, data offset)
+    std::vector<std::pair<uint32_t, uint32_t>> versions[CHECKPOINT_PAGES];
+
+    // Write watch used by "run back to last write"
+    bool watching = false;
+    uint32_t watchAddress = 0;
+    uint64_t lastWrite = NO_WRITE;
+
+    explicit Recorder(uint64_t n) : interval(n) {}
+
+    // Index of the last checkpoint taken at or before instruction count n
+    size_t checkpointBefore(uint64_t n) const {
+        auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), n,
+            [](uint64_t v, const Checkpoint& c) { return v < c.icount; });
+        return (it - checkpoints.begin()) - 1;
+    }
+};
+
+//--------------------------------------
+// Run Statistics
+//--------------------------------------
+// Counters are plain increments on paths the core already takes (one per
+// decoded opcode, one per taken branch, one byte store per guest store), so
+// they stay on in production. Loads and stores are read off the opcode
+// counts at export time. Memory use is tracked at the checkpoint page
+// granularity; guest memory is never freed, so pages touched = peak.
+struct RunStats {
+    uint64_t opcodeCounts[64] = {};   // I/J-type, by opcode
+    uint64_t functCounts[64] = {};    // R-type, by funct
+    uint64_t takenBranches = 0;       // BEQ/BNE that branched
+    double wallSeconds = 0;           // host time spent inside runUntil
+    uint8_t touched[CHECKPOINT_PAGES] = {};
+};
+
+//--------------------------------------
+// Predecode
+//--------------------------------------
+// loadProgram decodes the program once into a table parallel to its words:
+// the operation resolved to one dense code, the register fields split out
+// and the immediate sign-extended, with branch offsets and jump targets
+// already in bytes. The run loop dispatches from the table while the PC is
+// inside the program and decodes on the fly anywhere else. Every write into
+// the program's words re-decodes them, so self-modifying code, breakpoints
+// and checkpoint restores stay exact.
+//
+// Given a cache directory, the table is also kept on disk as
+// <image hash>-v<version>.pdc, after a header and a copy of the image, and
+// later runs of the same image map it copy-on-write instead of decoding.
+// A hit costs one hash and one compare of the image. The file is in host
+// byte order and only means something to the simulator that wrote it, so
+// DECODE_CACHE_VERSION must change with decode() or DecodedInstr.
+static const uint32_t DECODE_CACHE_VERSION = 1;
+static const char DECODE_CACHE_MAGIC[8] = {'C', 'P', 'U', 'D', 'E', 'C', 'O', 'D'};
+
+enum DecodedOp : uint8_t {
+    OP_HALT, OP_UNKNOWN_R, OP_JR, OP_ADD, OP_SUB, OP_SYSCALL, OP_BREAK,
+    OP_J, OP_JAL, OP_BEQ, OP_BNE, OP_ADDI, OP_LW, OP_SW, OP_UNKNOWN_I
+};
+
+struct DecodedInstr {
+    uint8_t op;     // DecodedOp
+    uint8_t code;   // opcode, or funct for R-type
+    uint8_t rs, rt, rd;
+    int32_t imm;
+};
+
+struct DecodeCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;  // sizeof(DecodedInstr)
+    uint64_t imageHash;
+    uint32_t count;      // instructions; the image, then the table, follow
+    uint32_t reserved;
+};
+
+static DecodedInstr decode(uint32_t instruction) {
+    DecodedInstr d;
+    std::memset(&d, 0, sizeof(d)); // padding included: tables are written out
+    uint8_t opcode = (instruction >> 26) & 0x3F;
+    d.rs = (instruction >> 21) & 0x1F;
+    d.rt = (instruction >> 16) & 0x1F;
+    d.rd = (instruction >> 11) & 0x1F;
+    d.imm = (int32_t)(int16_t)(instruction & 0xFFFF);
+    if (instruction == HALT_INSTR) {
+        d.op = OP_HALT;
+        d.code = opcode;
+    } else if (opcode == 0x00) {
+        d.code = instruction & 0x3F;
+        switch (d.code) {
+            case 0x08: d.op = OP_JR; break;
+            case 0x20: d.op = OP_ADD; break;
+            case 0x22: d.op = OP_SUB; break;
+            case 0x0C: d.op = OP_SYSCALL; break;
+            case 0x0D: d.op = OP_BREAK; break;
+            default:   d.op = OP_UNKNOWN_R; break;
+        }
+    } else {
+        d.code = opcode;
+        switch (opcode) {
+            case 0x02: d.op = OP_J;   d.imm = (instruction & 0x03FFFFFF) << 2; break;
+            case 0x03: d.op = OP_JAL; d.imm = (instruction & 0x03FFFFFF) << 2; break;
+            case 0x04: d.op = OP_BEQ; d.imm = (int32_t)((uint32_t)d.imm << 2); break;
+            case 0x05: d.op = OP_BNE; d.imm = (int32_t)((uint32_t)d.imm << 2); break;
+            case 0x08: d.op = OP_ADDI; break;
+            case 0x23: d.op = OP_LW; break;
+            case 0x2B: d.op = OP_SW; break;
+            default:   d.op = OP_UNKNOWN_I; break;
+        }
+    }
+    return d;
+}
+
+// FNV-1a taken a word at a time; it only picks the file; the image compare
+// decides a hit.
+static uint64_t hashImage(const std::vector<uint32_t>& program) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (uint32_t word : program) {
+        h ^= word;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// The decoded table of the loaded program, built here or mapped from the cache
+struct PredecodedProgram {
+    DecodedInstr* table = nullptr;
+    std::vector<DecodedInstr> owned;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    PredecodedProgram() = default;
+    PredecodedProgram(const PredecodedProgram&) = delete;
+    PredecodedProgram& operator=(const PredecodedProgram&) = delete;
+    ~PredecodedProgram() {
+        if (mapping) munmap(mapping, mappingSize);
+    }
+
+    static std::string cachePath(const std::string& dir, uint64_t hash) {
+        char name[48];
+        std::snprintf(name, sizeof(name), "/%016llx-v%u.pdc", (unsigned long long)hash, DECODE_CACHE_VERSION);
+        return dir + name;
+    }
+
+    static size_t cacheSize(size_t count) {
+        return sizeof(DecodeCacheHeader) + count * (4 + sizeof(DecodedInstr));
+    }
+
+    // Maps the cache file if it holds exactly this image. The mapping is
+    // private and writable, so re-decoding a word never reaches the file.
+    bool map(const std::string& path, const std::vector<uint32_t>& program, uint64_t hash) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        size_t size = cacheSize(program.size());
+        if (fstat(fd, &st) != 0 || (uint64_t)st.st_size != size) {
+            close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) return false;
+        const DecodeCacheHeader* h = static_cast<const DecodeCacheHeader*>(p);
+        const uint8_t* image = static_cast<const uint8_t*>(p) + sizeof(DecodeCacheHeader);
+        if (std::memcmp(h->magic, DECODE_CACHE_MAGIC, sizeof(h->magic)) != 0 ||
+            h->version != DECODE_CACHE_VERSION || h->entrySize != sizeof(DecodedInstr) ||
+            h->imageHash != hash || h->count != program.size() ||
+            std::memcmp(image, program.data(), program.size() * 4) != 0) {
+            munmap(p, size);
+            return false;
+        }
+        mapping = p;
+        mappingSize = size;
+        table = reinterpret_cast<DecodedInstr*>(static_cast<uint8_t*>(p) + sizeof(DecodeCacheHeader) + program.size() * 4);
+        return true;
+    }
+
+    void build(const std::vector<uint32_t>& program) {
+        owned.resize(program.size());
+        for (size_t i = 0; i < program.size(); i++) owned[i] = decode(program[i]);
+        table = owned.data();
+    }
+
+    // Written to a temporary file of its own (mkstemp) and renamed, so
+    // concurrent writers of the same image, whether processes or daemon
+    // workers, never map or rename a half-written file.
+    bool store(const std::string& path, const std::vector<uint32_t>& program, uint64_t hash) const {
+        DecodeCacheHeader h = {};
+        std::memcpy(h.magic, DECODE_CACHE_MAGIC, sizeof(h.magic));
+        h.version = DECODE_CACHE_VERSION;
+        h.entrySize = sizeof(DecodedInstr);
+        h.imageHash = hash;
+        h.count = program.size();
+        std::string tmp = path + ".XXXXXX";
+        int fd = mkstemp(&tmp[0]);
+        if (fd < 0) return false;
+        const std::pair<const void*, size_t> parts[] = {
+            {&h, sizeof(h)},
+            {program.data(), program.size() * 4},
+            {table, program.size() * sizeof(DecodedInstr)},
+        };
+        bool ok = fchmod(fd, 0644) == 0;
+        for (const auto& part : parts) {
+            const char* p = static_cast<const char*>(part.first);
+            for (size_t off = 0; ok && off < part.second; ) {
+                ssize_t n = write(fd, p + off, part.second - off);
+                if (n <= 0) ok = false;
+                else off += n;
+            }
+        }
+        ok = close(fd) == 0 && ok;
+        if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+//--------------------------------------
+// Debugger Support
+//--------------------------------------
+enum StopReason { STOP_NONE, STOP_HALT, STOP_FAULT, STOP_BREAKPOINT, STOP_WATCHPOINT };
+enum WatchType { WATCH_WRITE = 1, WATCH_READ = 2, WATCH_ACCESS = 3 };
+
+struct Watchpoint {
+    uint32_t address;
+    uint32_t length;
+    int type;
+};
+
 //--------------------------------------
 // CPU Structure
 //--------------------------------------
@@ -33,14 +405,90 @@ struct CPU {
     uint8_t flagReg; // bit 0:Z, bit1:C, bit2:V, bit3:S
     bool running;
 
-    std::vector<uint8_t> memory; // memory in bytes
+    GuestMemory memory; // memory in bytes, guard-page protected
 
-    CPU() : pc(0), hi(0), lo(0), flagReg(0), running(false) {
-        memory.resize(MEMORY_SIZE, 0);
+    uint32_t instrPc;       // address of the instruction being executed
+    bool faulted;           // last run stopped on a guest memory fault
+    uint32_t faultPc;
+    uint32_t faultAddress;
+
+    uint64_t icount;                    // instructions retired
+
+    // Predecoded program: decoded[i] is the word at decodedBase + 4*i
+    std::unique_ptr<PredecodedProgram> predecoded;
+    DecodedInstr* decoded;
+    uint32_t decodedBase;
+    uint32_t decodedBytes;              // 0: nothing predecoded
+    std::string decodeCacheDir;         // empty: no persistent cache
+    uint64_t decodeCacheFailures;       // stores that failed in batch mode, which says nothing
+
+    // Batch mode (the daemon): no host messages, and the guest console is
+    // consoleInput/consoleOutput instead of stdin/stdout.
+    bool batch;
+    std::vector<uint32_t> consoleInput;  // read int, in order; 0 once used up
+    size_t consoleInputPos;
+    std::vector<uint32_t> consoleOutput; // print int, up to BATCH_CONSOLE_LIMIT values
+    uint64_t nextCheckpointAt;          // UINT64_MAX unless recording
+    std::unique_ptr<Recorder> recorder; // null unless recording
+
+    int coreId;
+    RunStats stats;
+    uint64_t statsInterval;             // 0: export only at exit
+    uint64_t nextStatsAt;               // UINT64_MAX unless exporting periodically
+    std::string statsPrefix;            // writes <prefix>.json and <prefix>.prom
+    uint64_t nextEventAt;               // min(nextCheckpointAt, nextStatsAt)
+
+    // Debugger state. Breakpoints live in the instruction stream itself, so
+    // the only per-access cost is the hookStores/hookLoads test on LW/SW.
+    std::unordered_map<uint32_t, uint32_t> breakpoints; // address -> original word
+    std::vector<Watchpoint> watchpoints;
+    bool hookStores;            // recorder or write watchpoints active
+    bool hookLoads;             // read watchpoints active
+    bool travelling;            // internal replay: debugger stops suppressed
+    uint64_t stepOverIcount;    // resume past a breakpoint at this instruction
+    StopReason stopReason;
+    Watchpoint watchHit;
+    uint32_t watchHitAddress;
+
+    explicit CPU(bool batchMode = false)
+          : pc(0), hi(0), lo(0), flagReg(0), running(false),
+            instrPc(0), faulted(false), faultPc(0), faultAddress(0),
+            icount(0), decoded(nullptr), decodedBase(0), decodedBytes(0), decodeCacheFailures(0),
+            batch(batchMode), consoleInputPos(0),
+            nextCheckpointAt(UINT64_MAX), coreId(0), statsInterval(0), nextStatsAt(UINT64_MAX), nextEventAt(UINT64_MAX),
+            hookStores(false), hookLoads(false), travelling(false),
+            stepOverIcount(UINT64_MAX), stopReason(STOP_NONE),
+            watchHit(), watchHitAddress(0) {
+        installFaultHandler();
         for (int i = 0; i < NUM_REGISTERS; i++) {
             registers[i] = 0;
         }
-        std::cout << "CPU initialized with " << MEMORY_SIZE << " bytes of memory.\n";
+        if (!batch) std::cout << "CPU initialized with " << MEMORY_SIZE << " bytes of memory.\n";
+    }
+
+    // Back to the just-constructed state for another program, zeroing only
+    // the memory pages the last one touched. Recording, debugging and stats
+    // export are not reset: batch runs do not use them.
+    void reset() {
+        for (uint32_t p = 0; p < CHECKPOINT_PAGES; p++) {
+            if (stats.touched[p]) std::memset(memory.at(p << CHECKPOINT_PAGE_SHIFT), 0, CHECKPOINT_PAGE_SIZE);
+        }
+        std::fill(registers, registers + NUM_REGISTERS, 0);
+        pc = hi = lo = 0;
+        flagReg = 0;
+        running = false;
+        instrPc = 0;
+        faulted = false;
+        faultPc = faultAddress = 0;
+        icount = 0;
+        stopReason = STOP_NONE;
+        stats = RunStats();
+        predecoded.reset();
+        decoded = nullptr;
+        decodedBytes = 0;
+        consoleInput.clear();
+        consoleInputPos = 0;
+        consoleOutput.clear();
     }
 
     void setFlag(char flag, bool value) {
@@ -62,18 +510,36 @@ struct CPU {
         return false;
     }
 
-    uint32_t fetchInstruction() {
-        if (pc + 3 >= MEMORY_SIZE) {
-            std::cerr << "PC out of range. Stopping.\n";
-            running = false;
-            return 0;
+    uint32_t loadWord(uint32_t addr) {
+        const uint8_t* p = memory.at(addr);
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    void storeWord(uint32_t addr, uint32_t value) {
+        pokeWord(addr, value); // a faulting store goes no further
+        stats.touched[(addr >> CHECKPOINT_PAGE_SHIFT) & (CHECKPOINT_PAGES - 1)] = 1;
+        if (hookStores) noteWrite(addr);
+    }
+
+    void pokeWord(uint32_t addr, uint32_t value) {
+        // Highest byte first: mapped memory is a prefix of the address space,
+        // so if any byte faults this one does, before anything is written.
+        uint8_t* p = memory.at(addr);
+        p[3] = value & 0xFF;
+        p[2] = (value >> 8)  & 0xFF;
+        p[1] = (value >> 16) & 0xFF;
+        p[0] = (value >> 24) & 0xFF;
+        if (addr + 3ull >= decodedBase && addr < (uint64_t)decodedBase + decodedBytes) redecode(addr, 4);
+    }
+
+    // Bring the predecoded words overlapping [addr, addr + length) back in
+    // line with memory.
+    void redecode(uint32_t addr, uint32_t length) {
+        uint64_t first = std::max<uint64_t>(addr & ~3u, decodedBase);
+        uint64_t end = std::min<uint64_t>((uint64_t)addr + length, (uint64_t)decodedBase + decodedBytes);
+        for (uint64_t a = first; a < end; a += 4) {
+            decoded[(a - decodedBase) >> 2] = decode(loadWord((uint32_t)a));
         }
-        uint32_t instruction = (memory[pc] << 24) |
-                               (memory[pc+1] << 16) |
-                               (memory[pc+2] << 8)  |
-                                memory[pc+3];
-        pc += 4; // move to next instruction
-        return instruction;
     }
 
     void dumpMemory(uint32_t startAddress, uint32_t endAddress) {
@@ -121,6 +587,11 @@ struct CPU {
             throw std::runtime_error("Program too large to fit in memory");
         }
 
+        for (uint32_t a = startAddress; a < byteEnd; a += CHECKPOINT_PAGE_SIZE) {
+            stats.touched[a >> CHECKPOINT_PAGE_SHIFT] = 1;
+        }
+        if (byteEnd > startAddress) stats.touched[(byteEnd - 1) >> CHECKPOINT_PAGE_SHIFT] = 1;
+
         for (size_t i = 0; i < program.size(); i++) {
             uint32_t instr = program[i];
             memory[startAddress + i*4]   = (instr >> 24) & 0xFF;
@@ -131,8 +602,66 @@ struct CPU {
 
         pc = startAddress;
         running = false;
-        std::cout << "Program loaded at 0x" << std::hex << startAddress 
-                  << " with " << program.size() << " instructions.\n";
+        if (!batch) {
+            std::cout << "Program loaded at 0x" << std::hex << startAddress 
+                      << " with " << program.size() << " instructions.\n";
+        }
+        predecode(program, startAddress);
+    }
+
+    void predecode(const std::vector<uint32_t>& program, uint32_t startAddress) {
+        predecoded.reset();
+        decoded = nullptr;
+        decodedBase = startAddress;
+        decodedBytes = 0;
+        if (startAddress & 3) return; // the table is indexed by aligned PC
+
+        std::unique_ptr<PredecodedProgram> table(new PredecodedProgram());
+        if (decodeCacheDir.empty()) {
+            table->build(program);
+        } else {
+            uint64_t hash = hashImage(program);
+            std::string path = PredecodedProgram::cachePath(decodeCacheDir, hash);
+            if (table->map(path, program, hash)) {
+                if (!batch) std::cout << "Decode cache hit: " << path << "\n";
+            } else {
+                table->build(program);
+                if (table->store(path, program, hash)) {
+                    if (!batch) std::cout << "Decode cache stored: " << path << "\n";
+                } else if (batch) {
+                    decodeCacheFailures++;
+                } else {
+                    std::cerr << "Cannot write decode cache " << path << "\n";
+                }
+            }
+        }
+        predecoded = std::move(table);
+        decoded = predecoded->table;
+        decodedBytes = program.size() * 4;
+    }
+
+    static std::vector<uint32_t> readProgramFile(const std::string& path) {
+        // Raw image of big-endian 32-bit instruction words
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            throw std::runtime_error("Cannot open program file " + path);
+        }
+        // One read: going through istreambuf_iterator costs more than the
+        // rest of a cached start
+        std::vector<uint8_t> bytes((size_t)in.tellg());
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(bytes.data()), bytes.size())) {
+            throw std::runtime_error("Cannot read program file " + path);
+        }
+        if (bytes.size() % 4 != 0) {
+            throw std::runtime_error("Program file size is not a multiple of 4");
+        }
+        std::vector<uint32_t> program(bytes.size() / 4);
+        for (size_t i = 0; i < program.size(); i++) {
+            program[i] = ((uint32_t)bytes[i*4] << 24) | ((uint32_t)bytes[i*4+1] << 16) |
+                         ((uint32_t)bytes[i*4+2] << 8) | bytes[i*4+3];
+        }
+        return program;
     }
 
     void displayState() {
@@ -150,113 +679,1505 @@ struct CPU {
     }
 
     void run() {
-        running = true;
         std::cout << "Starting program execution...\n";
-        while (running) {
-            uint32_t instruction = fetchInstruction();
-            if (!running) break; 
+        runUntil(UINT64_MAX);
+        std::cout << "Program execution finished.\n";
+    }
+
+    // Execute until the program stops or `stopAt` instructions have retired.
+    void runUntil(uint64_t stopAt) {
+        running = true;
+        faulted = false;
+        stopReason = STOP_NONE;
+        auto started = std::chrono::steady_clock::now();
+
+        FaultContext fault;
+        fault.mem = &memory;
+        fault.address = 0;
+        activeFault = &fault;
+        if (sigsetjmp(fault.env, 1) != 0) {
+            // The faulting access had no architectural effect, so the state
+            // left behind is exactly the state before instruction instrPc.
+            faulted = true;
+            // A faulting fetch is not counted yet. A fault under a
+            // breakpoint comes from stepping over it, which counted the
+            // replaced instruction too.
+            if (instrPc <= MEMORY_SIZE - 4) {
+                unretire();
+                auto it = breakpoints.find(instrPc);
+                if (it != breakpoints.end()) uncount(decode(it->second));
+            }
+            pc = instrPc;
+            faultPc = instrPc;
+            faultAddress = fault.address;
+            running = false;
+            stopReason = STOP_FAULT;
+            if (!batch) {
+                std::cerr << "Guest memory fault at PC=0x" << std::hex << faultPc
+                          << " address=0x" << faultAddress << ". Stopping.\n";
+            }
+        }
+
+        // The table only changes in place, so its bounds stay in registers
+        const DecodedInstr* const table = decoded;
+        const uint32_t base = decodedBase, bytes = decodedBytes;
+        while (running && icount < stopAt) {
+            instrPc = pc;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            if (icount == nextEventAt) scheduledEvents();
+            uint32_t offset = pc - base;
+            const DecodedInstr* d;
+            DecodedInstr outside;
+            if (offset < bytes && !(offset & 3)) {
+                d = &table[offset >> 2];
+            } else {
+                outside = decode(loadWord(pc));
+                d = &outside;
+            }
+            pc += 4;
+            icount++;
             // If instruction is HALT, stop
-            if (instruction == HALT_INSTR) {
-                std::cout << "HALT instruction executed.\n";
+            if (d->op == OP_HALT) {
+                stats.opcodeCounts[HALT_INSTR >> 26]++;
+                if (!batch && !replaying()) std::cout << "HALT instruction executed.\n";
                 running = false;
+                stopReason = STOP_HALT;
                 break;
             }
-            decodeExecute(instruction);
+            execute(*d);
             registers[0] = 0;
         }
-        std::cout << "Program execution finished.\n";
+        activeFault = nullptr;
+        stats.wallSeconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - started).count();
+    }
+
+    // Checkpoints and periodic stats exports share one compare in the loop.
+    void scheduledEvents() {
+        if (icount == nextCheckpointAt) checkpointBoundary();
+        if (icount == nextStatsAt) {
+            writeStats();
+            nextStatsAt = icount + statsInterval;
+        }
+        scheduleEvents();
     }
 
-    void decodeExecute(uint32_t instruction) {
-        // Extract fields for MIPS (just as example)
-        uint8_t opcode = (instruction >> 26) & 0x3F;
-        uint8_t rs = (instruction >> 21) & 0x1F;
-        uint8_t rt = (instruction >> 16) & 0x1F;
-        uint8_t rd = (instruction >> 11) & 0x1F;
-        uint8_t shamt = (instruction >> 6) & 0x1F;
-        uint8_t funct = instruction & 0x3F;
-        int16_t imm = instruction & 0xFFFF;
-        uint32_t uimm = imm;
-        int32_t simm = (int32_t)(int16_t)imm;
-
-        // Simple demonstration: handle a few instructions
-        // ADDI, ADD, SUB as examples
-        // For high grade, implement more instructions according to your ISA and print info.
-
-        // Example instructions:
-        // 0x08: ADDI rt,rs,imm
-        // R-type (opcode=0): use funct to determine ADD(0x20),SUB(0x22)
-        // More can be added: AND(0x24), OR(0x25), SLT(0x2A)...
-
-        if (instruction == HALT_INSTR) {
+    void scheduleEvents() {
+        nextEventAt = std::min(nextCheckpointAt, nextStatsAt);
+    }
+
+    //--------------------------------------
+    // Record / Replay
+    //--------------------------------------
+    void startRecording(uint64_t interval = DEFAULT_CHECKPOINT_INTERVAL) {
+        recorder.reset(new Recorder(interval));
+        recorder->frontier = icount;
+        hookStores = true;
+        for (uint32_t p = 0; p < CHECKPOINT_PAGES; p++) recorder->dirty[p] = 1;
+        takeCheckpoint();
+    }
+
+    // True while re-executing already recorded history, so outputs are not
+    // repeated. Called mid-instruction, when icount already counts it.
+    bool replaying() const {
+        return recorder && icount <= recorder->frontier;
+    }
+
+    void noteWrite(uint32_t addr) {
+        if (recorder) {
+            recorder->dirty[(addr >> CHECKPOINT_PAGE_SHIFT) & (CHECKPOINT_PAGES - 1)] = 1;
+            if (recorder->watching && recorder->watchAddress - addr < 4) {
+                recorder->lastWrite = icount - 1; // icount already counts this store
+            }
+        }
+        checkWatchpoints(addr, WATCH_WRITE);
+    }
+
+    void takeCheckpoint() {
+        Recorder& r = *recorder;
+        Checkpoint cp;
+        cp.icount = icount;
+        std::copy(registers, registers + NUM_REGISTERS, cp.registers);
+        cp.pc = pc; cp.hi = hi; cp.lo = lo; cp.flagReg = flagReg;
+        uint32_t index = r.checkpoints.size();
+        for (uint32_t p = 0; p < CHECKPOINT_PAGES; p++) {
+            if (!r.dirty[p]) continue;
+            r.dirty[p] = 0;
+            r.versions[p].push_back({index, (uint32_t)cp.data.size()});
+            cp.pages.push_back(p);
+            const uint8_t* src = memory.at(p << CHECKPOINT_PAGE_SHIFT);
+            cp.data.insert(cp.data.end(), src, src + CHECKPOINT_PAGE_SIZE);
+        }
+        // Checkpoints hold the program, not the debugger's patches
+        for (const auto& bp : breakpoints) {
+            uint32_t page = bp.first >> CHECKPOINT_PAGE_SHIFT;
+            auto it = std::lower_bound(cp.pages.begin(), cp.pages.end(), page);
+            if (it == cp.pages.end() || *it != page) continue;
+            size_t off = (it - cp.pages.begin()) * CHECKPOINT_PAGE_SIZE
+                       + (bp.first & (CHECKPOINT_PAGE_SIZE - 1));
+            for (int i = 0; i < 4; i++) cp.data[off + i] = (bp.second >> (24 - 8*i)) & 0xFF;
+        }
+        r.checkpoints.push_back(std::move(cp));
+        nextCheckpointAt = icount + r.interval;
+        scheduleEvents();
+    }
+
+    void checkpointBoundary() {
+        Recorder& r = *recorder;
+        if (icount < r.frontier) {
+            // Replaying: the checkpoint for this point already exists and the
+            // memory now matches it, so only the dirty set needs resetting.
+            std::fill(r.dirty, r.dirty + CHECKPOINT_PAGES, 0);
+            nextCheckpointAt = icount + r.interval;
+            scheduleEvents();
+            return;
+        }
+        takeCheckpoint();
+    }
+
+    void restoreCheckpoint(size_t index) {
+        Recorder& r = *recorder;
+        r.frontier = std::max(r.frontier, icount);
+        const Checkpoint& cp = r.checkpoints[index];
+        for (uint32_t p = 0; p < CHECKPOINT_PAGES; p++) {
+            // Newest version of the page saved at or before this checkpoint
+            const auto& v = r.versions[p];
+            auto it = std::upper_bound(v.begin(), v.end(), (uint32_t)index,
+                [](uint32_t i, const std::pair<uint32_t, uint32_t>& e) { return i < e.first; });
+            if (it == v.begin()) continue;
+            --it;
+            if (it + 1 == v.end() && !r.dirty[p]) continue; // unchanged since
+            const Checkpoint& owner = r.checkpoints[it->first];
+            std::copy(owner.data.begin() + it->second,
+                      owner.data.begin() + it->second + CHECKPOINT_PAGE_SIZE,
+                      memory.at(p << CHECKPOINT_PAGE_SHIFT));
+            redecode(p << CHECKPOINT_PAGE_SHIFT, CHECKPOINT_PAGE_SIZE);
+        }
+        std::fill(r.dirty, r.dirty + CHECKPOINT_PAGES, 0);
+        for (const auto& bp : breakpoints) pokeWord(bp.first, BREAK_INSTR);
+        std::copy(cp.registers, cp.registers + NUM_REGISTERS, registers);
+        pc = cp.pc; hi = cp.hi; lo = cp.lo; flagReg = cp.flagReg;
+        icount = cp.icount;
+        nextCheckpointAt = index + 1 < r.checkpoints.size()
+            ? r.checkpoints[index + 1].icount : icount + r.interval;
+        // Periodic exports resume from here rather than replaying missed ones
+        if (statsInterval) nextStatsAt = icount + statsInterval;
+        scheduleEvents();
+        auto in = std::lower_bound(r.inputs.begin(), r.inputs.end(), icount,
+            [](const InputEvent& e, uint64_t n) { return e.icount < n; });
+        r.inputCursor = in - r.inputs.begin();
+    }
+
+    // Bring the machine to the state just before instruction number `target`.
+    void travelTo(uint64_t target) {
+        travelling = true;
+        restoreCheckpoint(recorder->checkpointBefore(target));
+        runUntil(target);
+        travelling = false;
+    }
+
+    bool reverseStep(uint64_t n = 1) {
+        if (!recorder || icount == recorder->checkpoints.front().icount) return false;
+        uint64_t start = recorder->checkpoints.front().icount;
+        travelTo(icount - std::min(n, icount - start));
+        return true;
+    }
+
+    // Stop just before the most recent instruction that wrote `addr`.
+    bool reverseToLastWrite(uint32_t addr) {
+        if (!recorder) return false;
+        Recorder& r = *recorder;
+        uint64_t end = icount;
+        for (size_t k = r.checkpointBefore(end == 0 ? 0 : end - 1); ; k--) {
+            uint64_t segmentEnd = k + 1 < r.checkpoints.size()
+                ? std::min(end, r.checkpoints[k + 1].icount) : end;
+            restoreCheckpoint(k);
+            r.watching = true;
+            r.watchAddress = addr;
+            r.lastWrite = NO_WRITE;
+            travelling = true;
+            runUntil(segmentEnd);
+            travelling = false;
+            r.watching = false;
+            if (r.lastWrite != NO_WRITE) {
+                travelTo(r.lastWrite);
+                return true;
+            }
+            if (k == 0) break;
+        }
+        travelTo(end);
+        return false;
+    }
+
+    // Registers or memory were changed from outside the guest (debugger):
+    // history past this point is no longer reproducible.
+    void discardFuture() {
+        if (!recorder) return;
+        Recorder& r = *recorder;
+        while (!r.checkpoints.empty() && r.checkpoints.back().icount >= icount) {
+            for (uint32_t p : r.checkpoints.back().pages) {
+                r.versions[p].pop_back();
+                r.dirty[p] = 1;
+            }
+            r.checkpoints.pop_back();
+        }
+        r.inputs.resize(r.inputCursor);
+        r.frontier = icount;
+        takeCheckpoint();
+    }
+
+    //--------------------------------------
+    // Statistics Export
+    //--------------------------------------
+    void enableStats(const std::string& prefix, uint64_t interval) {
+        statsPrefix = prefix;
+        statsInterval = interval;
+        nextStatsAt = interval ? icount + interval : UINT64_MAX;
+        scheduleEvents();
+    }
+
+    static std::string opcodeName(bool rtype, int code) {
+        if (rtype) {
+            switch (code) {
+                case 0x08: return "JR";
+                case 0x0C: return "SYSCALL";
+                case 0x0D: return "BREAK";
+                case 0x20: return "ADD";
+                case 0x22: return "SUB";
+            }
+        } else {
+            switch (code) {
+                case 0x02: return "J";
+                case 0x03: return "JAL";
+                case 0x04: return "BEQ";
+                case 0x05: return "BNE";
+                case 0x08: return "ADDI";
+                case 0x23: return "LW";
+                case 0x2B: return "SW";
+                case 0x3F: return "HALT";
+            }
+        }
+        char buf[16];
+        std::snprintf(buf, sizeof(buf), rtype ? "funct_0x%02x" : "op_0x%02x", code);
+        return buf;
+    }
+
+    uint64_t peakMemoryBytes() const {
+        uint64_t pages = 0;
+        for (uint32_t p = 0; p < CHECKPOINT_PAGES; p++) pages += stats.touched[p];
+        return pages * CHECKPOINT_PAGE_SIZE;
+    }
+
+    double simulatedMips() const {
+        return stats.wallSeconds > 0 ? icount / stats.wallSeconds / 1e6 : 0;
+    }
+
+    std::string statsJson() const {
+        std::ostringstream j;
+        j << std::dec << "{\n"
+          << "  \"core\": " << coreId << ",\n"
+          << "  \"instructions_retired\": " << icount << ",\n"
+          << "  \"loads\": " << stats.opcodeCounts[0x23] << ",\n"
+          << "  \"stores\": " << stats.opcodeCounts[0x2B] << ",\n"
+          << "  \"taken_branches\": " << stats.takenBranches << ",\n"
+          << "  \"host_wall_seconds\": " << stats.wallSeconds << ",\n"
+          << "  \"simulated_mips\": " << simulatedMips() << ",\n"
+          << "  \"guest_memory_peak_bytes\": " << peakMemoryBytes() << ",\n"
+          << "  \"opcodes\": {";
+        const char* sep = "\n";
+        for (int rtype = 1; rtype >= 0; rtype--) {
+            const uint64_t* counts = rtype ? stats.functCounts : stats.opcodeCounts;
+            for (int c = 0; c < 64; c++) {
+                if (!counts[c]) continue;
+                j << sep << "    \"" << opcodeName(rtype, c) << "\": " << counts[c];
+                sep = ",\n";
+            }
+        }
+        j << "\n  }\n}\n";
+        return j.str();
+    }
+
+    std::string statsPrometheus() const {
+        std::ostringstream m;
+        m << std::dec;
+        std::string core = "core=\"" + std::to_string(coreId) + "\"";
+        auto metric = [&](const char* name, const char* type, const char* help, const std::string& value) {
+            m << "# HELP " << name << " " << help << "\n"
+              << "# TYPE " << name << " " << type << "\n"
+              << name << "{" << core << "} " << value << "\n";
+        };
+        auto real = [](double v) {
+            std::ostringstream o;
+            o << std::setprecision(9) << v;
+            return o.str();
+        };
+        using std::to_string;
+        metric("cpu_instructions_retired_total", "counter", "Guest instructions retired.", to_string(icount));
+        metric("cpu_loads_total", "counter", "Guest load instructions executed.", to_string(stats.opcodeCounts[0x23]));
+        metric("cpu_stores_total", "counter", "Guest store instructions executed.", to_string(stats.opcodeCounts[0x2B]));
+        metric("cpu_taken_branches_total", "counter", "Conditional branches taken.", to_string(stats.takenBranches));
+        metric("cpu_host_wall_seconds", "gauge", "Host wall time spent executing.", real(stats.wallSeconds));
+        metric("cpu_simulated_mips", "gauge", "Retired guest instructions per host microsecond.", real(simulatedMips()));
+        metric("cpu_guest_memory_peak_bytes", "gauge", "Guest memory touched.", to_string(peakMemoryBytes()));
+        m << "# HELP cpu_opcode_executed_total Guest instructions executed by opcode.\n"
+          << "# TYPE cpu_opcode_executed_total counter\n";
+        for (int rtype = 1; rtype >= 0; rtype--) {
+            const uint64_t* counts = rtype ? stats.functCounts : stats.opcodeCounts;
+            for (int c = 0; c < 64; c++) {
+                if (!counts[c]) continue;
+                m << "cpu_opcode_executed_total{" << core << ",opcode=\""
+                  << opcodeName(rtype, c) << "\"} " << counts[c] << "\n";
+            }
+        }
+        return m.str();
+    }
+
+    // Written to a temporary name and renamed, so scrapers never see a
+    // half-written file.
+    void writeStats() const {
+        if (statsPrefix.empty()) return;
+        const std::pair<std::string, std::string> files[] = {
+            {statsPrefix + ".json", statsJson()},
+            {statsPrefix + ".prom", statsPrometheus()},
+        };
+        for (const auto& f : files) {
+            std::string tmp = f.first + ".tmp";
+            std::ofstream out(tmp, std::ios::trunc);
+            out << f.second;
+            out.close();
+            if (!out || std::rename(tmp.c_str(), f.first.c_str()) != 0) {
+                std::cerr << "Cannot write statistics file " << f.first << "\n";
+            }
+        }
+    }
+
+    //--------------------------------------
+    // Breakpoints / Watchpoints
+    //--------------------------------------
+    // A software breakpoint overwrites the instruction with BREAK, so it costs
+    // nothing until executed. The original word is what the debugger, the
+    // checkpoints and a resumed step see.
+    bool insertBreakpoint(uint32_t addr) {
+        if ((addr & 3) || addr > MEMORY_SIZE - 4) return false;
+        if (breakpoints.count(addr)) return true;
+        breakpoints[addr] = loadWord(addr);
+        pokeWord(addr, BREAK_INSTR);
+        return true;
+    }
+
+    bool removeBreakpoint(uint32_t addr) {
+        auto it = breakpoints.find(addr);
+        if (it == breakpoints.end()) return false;
+        pokeWord(addr, it->second);
+        breakpoints.erase(it);
+        return true;
+    }
+
+    void breakpointTrap() {
+        auto it = breakpoints.find(instrPc);
+        if (it != breakpoints.end() && (travelling || icount - 1 == stepOverIcount)) {
+            execute(decode(it->second));
+            return;
+        }
+        // Stop before the instruction: it has not retired.
+        pc = instrPc;
+        unretire();
+        running = false;
+        stopReason = STOP_BREAKPOINT;
+    }
+
+    // Take back the counts of the instruction at instrPc, which stopped
+    // before retiring and runs again when resumed.
+    void unretire() {
+        icount--;
+        uncount(decode(loadWord(instrPc)));
+    }
+
+    void uncount(const DecodedInstr& d) {
+        bool rtype = d.op >= OP_UNKNOWN_R && d.op <= OP_BREAK;
+        (rtype ? stats.functCounts : stats.opcodeCounts)[d.code]--;
+    }
+
+    void insertWatchpoint(uint32_t addr, uint32_t len, int type) {
+        watchpoints.push_back({addr, len, type});
+        updateHooks();
+    }
+
+    bool removeWatchpoint(uint32_t addr, uint32_t len, int type) {
+        for (size_t i = 0; i < watchpoints.size(); i++) {
+            const Watchpoint& w = watchpoints[i];
+            if (w.address == addr && w.length == len && w.type == type) {
+                watchpoints.erase(watchpoints.begin() + i);
+                updateHooks();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void updateHooks() {
+        hookStores = recorder != nullptr;
+        hookLoads = false;
+        for (const Watchpoint& w : watchpoints) {
+            if (w.type & WATCH_WRITE) hookStores = true;
+            if (w.type & WATCH_READ) hookLoads = true;
+        }
+    }
+
+    // Watchpoints stop after the accessing instruction completes.
+    void checkWatchpoints(uint32_t addr, int access) {
+        if (travelling) return;
+        for (const Watchpoint& w : watchpoints) {
+            if ((w.type & access) && addr < w.address + w.length && w.address < addr + 4) {
+                running = false;
+                stopReason = STOP_WATCHPOINT;
+                watchHit = w;
+                watchHitAddress = addr;
+                return;
+            }
+        }
+    }
+
+    // Memory as the program sees it, with breakpoint patches hidden.
+    uint8_t debugReadByte(uint32_t addr) {
+        auto it = breakpoints.find(addr & ~3u);
+        if (it != breakpoints.end()) return (it->second >> (24 - 8 * (addr & 3))) & 0xFF;
+        return memory[addr];
+    }
+
+    void debugWriteByte(uint32_t addr, uint8_t value) {
+        auto it = breakpoints.find(addr & ~3u);
+        if (it != breakpoints.end()) {
+            int shift = 24 - 8 * (addr & 3);
+            it->second = (it->second & ~(0xFFu << shift)) | ((uint32_t)value << shift);
+            return;
+        }
+        memory[addr] = value;
+        redecode(addr, 1);
+        if (recorder) recorder->dirty[addr >> CHECKPOINT_PAGE_SHIFT] = 1;
+    }
+
+    // Every source of nondeterminism goes through here.
+    uint32_t nondeterministicInput(uint32_t (*live)()) {
+        if (!recorder) return live();
+        Recorder& r = *recorder;
+        if (r.inputCursor < r.inputs.size()) {
+            return r.inputs[r.inputCursor++].value;
+        }
+        uint32_t value = live();
+        r.inputs.push_back({icount - 1, value});
+        r.inputCursor++;
+        return value;
+    }
+
+    static uint32_t readIntFromConsole() {
+        int32_t v = 0;
+        if (!(std::cin >> v)) {
+            std::cin.clear();
+            v = 0;
+        }
+        return (uint32_t)v;
+    }
+
+    static uint32_t hostTimeMillis() {
+        return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void syscall() {
+        // SPIM-style services selected by $v0 (R2), argument in $a0 (R4)
+        switch (registers[2]) {
+            case 1: // print int
+                if (batch) {
+                    if (consoleOutput.size() < BATCH_CONSOLE_LIMIT) consoleOutput.push_back(registers[4]);
+                } else if (!replaying()) {
+                    std::cout << std::dec << (int32_t)registers[4] << "\n";
+                }
+                break;
+            case 5: // read int
+                if (batch) {
+                    registers[2] = consoleInputPos < consoleInput.size() ? consoleInput[consoleInputPos++] : 0;
+                } else {
+                    registers[2] = nondeterministicInput(readIntFromConsole);
+                }
+                break;
+            case 10: // exit
+                running = false;
+                stopReason = STOP_HALT;
+                break;
+            case 30: // system time (ms, low 32 bits)
+                registers[4] = nondeterministicInput(hostTimeMillis);
+                break;
+            default:
+                if (!batch) std::cout << "Unknown syscall " << std::dec << registers[2] << "\n";
+                break;
+        }
+    }
+
+    void execute(DecodedInstr d) {
+        if (d.op == OP_HALT) {
             // HALT already handled in run()
             return;
         }
 
-        if (opcode == 0x00) {
+        switch (d.op) {
             // R-type
-            switch (funct) {
-                case 0x20: { // ADD
-                    int32_t v1 = (int32_t)registers[rs];
-                    int32_t v2 = (int32_t)registers[rt];
-                    int64_t res = (int64_t)v1 + (int64_t)v2;
-                    registers[rd] = (uint32_t)res;
-                    setFlag('Z', registers[rd] == 0);
-                    setFlag('S', (registers[rd] & 0x80000000) != 0);
-                    // Overflow check for signed add
-                    bool overflow = ( (v1>0 && v2>0 && (int32_t)res<0) ||
-                                      (v1<0 && v2<0 && (int32_t)res>0) );
-                    setFlag('V', overflow);
-                    break;
+            case OP_JR: // JR rs
+                stats.functCounts[0x08]++;
+                pc = registers[d.rs];
+                break;
+            case OP_ADD: { // ADD
+                stats.functCounts[0x20]++;
+                int32_t v1 = (int32_t)registers[d.rs];
+                int32_t v2 = (int32_t)registers[d.rt];
+                int64_t res = (int64_t)v1 + (int64_t)v2;
+                registers[d.rd] = (uint32_t)res;
+                setFlag('Z', registers[d.rd] == 0);
+                setFlag('S', (registers[d.rd] & 0x80000000) != 0);
+                // Overflow check for signed add
+                bool overflow = ( (v1>0 && v2>0 && (int32_t)res<0) ||
+                                  (v1<0 && v2<0 && (int32_t)res>0) );
+                setFlag('V', overflow);
+                break;
+            }
+            case OP_SUB: { // SUB
+                stats.functCounts[0x22]++;
+                int32_t v1 = (int32_t)registers[d.rs];
+                int32_t v2 = (int32_t)registers[d.rt];
+                int64_t res = (int64_t)v1 - (int64_t)v2;
+                registers[d.rd] = (uint32_t)res;
+                setFlag('Z', registers[d.rd] == 0);
+                setFlag('S', (registers[d.rd] & 0x80000000) != 0);
+                bool overflow = ((v1>0 && v2<0 && (int32_t)res<0) ||
+                                 (v1<0 && v2>0 && (int32_t)res>0));
+                setFlag('V', overflow);
+                break;
+            }
+            case OP_SYSCALL: // SYSCALL
+                stats.functCounts[0x0C]++;
+                syscall();
+                break;
+            case OP_BREAK: // BREAK
+                stats.functCounts[0x0D]++;
+                breakpointTrap();
+                break;
+            case OP_UNKNOWN_R:
+                stats.functCounts[d.code]++;
+                if (!batch) std::cout << "Unknown R-type funct=0x" << std::hex << (int)d.code << "\n";
+                break;
+
+            // I-type or J-type
+            case OP_J: // J target
+                stats.opcodeCounts[0x02]++;
+                pc = (pc & 0xF0000000) | (uint32_t)d.imm;
+                break;
+            case OP_JAL: // JAL target
+                stats.opcodeCounts[0x03]++;
+                registers[31] = pc;
+                pc = (pc & 0xF0000000) | (uint32_t)d.imm;
+                break;
+            case OP_BEQ: // BEQ rs, rt, offset
+                stats.opcodeCounts[0x04]++;
+                if (registers[d.rs] == registers[d.rt]) {
+                    pc += (uint32_t)d.imm;
+                    stats.takenBranches++;
                 }
-                case 0x22: { // SUB
-                    int32_t v1 = (int32_t)registers[rs];
-                    int32_t v2 = (int32_t)registers[rt];
-                    int64_t res = (int64_t)v1 - (int64_t)v2;
-                    registers[rd] = (uint32_t)res;
-                    setFlag('Z', registers[rd] == 0);
-                    setFlag('S', (registers[rd] & 0x80000000) != 0);
-                    bool overflow = ((v1>0 && v2<0 && (int32_t)res<0) ||
-                                     (v1<0 && v2>0 && (int32_t)res>0));
-                    setFlag('V', overflow);
-                    break;
+                break;
+            case OP_BNE: // BNE rs, rt, offset
+                stats.opcodeCounts[0x05]++;
+                if (registers[d.rs] != registers[d.rt]) {
+                    pc += (uint32_t)d.imm;
+                    stats.takenBranches++;
                 }
-                default:
-                    std::cout << "Unknown R-type funct=0x" << std::hex << (int)funct << "\n";
-                    break;
+                break;
+            case OP_ADDI: // ADDI
+                stats.opcodeCounts[0x08]++;
+            {
+                int32_t v1 = (int32_t)registers[d.rs];
+                int64_t res = (int64_t)v1 + (int64_t)d.imm;
+                registers[d.rt] = (uint32_t)res;
+                setFlag('Z', registers[d.rt]==0);
+                setFlag('S', (registers[d.rt] & 0x80000000)!=0);
+                // Overflow detection same logic as ADD
+                bool overflow = ((v1>0 && d.imm>0 && (int32_t)res<0) ||
+                                 (v1<0 && d.imm<0 && (int32_t)res>0));
+                setFlag('V', overflow);
+                break;
+            }
+            case OP_LW: // LW rt, imm(rs)
+                stats.opcodeCounts[0x23]++;
+                if (hookLoads) checkWatchpoints(registers[d.rs] + d.imm, WATCH_READ);
+                registers[d.rt] = loadWord(registers[d.rs] + d.imm);
+                break;
+            case OP_SW: // SW rt, imm(rs)
+                stats.opcodeCounts[0x2B]++;
+                storeWord(registers[d.rs] + d.imm, registers[d.rt]);
+                break;
+            // more instructions could be added here (and to decode())
+            default:
+                stats.opcodeCounts[d.code]++;
+                if (!batch) std::cout << "Unknown opcode=0x" << std::hex << (int)d.code << "\n";
+                break;
+        }
+    }
+};
+
+//--------------------------------------
+// GDB Remote Serial Protocol stub
+//--------------------------------------
+// Serves one gdb connection on a TCP port on 127.0.0.1 or on a Unix socket
+// path. Registers use gdb's MIPS numbering (r0-r31, sr, lo, hi, badvaddr,
+// cause, pc, f0-f31, fcsr, fir) in big-endian target order. "continue" runs
+// the core in large slices and only polls the socket for ^C between them.
+static const uint64_t GDB_CONTINUE_SLICE = 1 << 20;
+static const int GDB_NUM_REGS = 72;
+static const int GDB_PC_REG = 37;
+
+class GdbStub {
+public:
+    explicit GdbStub(CPU& cpu) : cpu(cpu), listenFd(-1), fd(-1) {}
+
+    ~GdbStub() {
+        if (fd >= 0) close(fd);
+        if (listenFd >= 0) close(listenFd);
+    }
+
+    // `where` is a port number or a Unix socket path.
+    void serve(const std::string& where) {
+        signal(SIGPIPE, SIG_IGN);
+        bool isPort = !where.empty() &&
+            std::all_of(where.begin(), where.end(), [](char c) { return std::isdigit((unsigned char)c); });
+        if (isPort) {
+            char* stop = nullptr;
+            unsigned long port = std::strtoul(where.c_str(), &stop, 10);
+            if (*stop != '\0' || port == 0 || port > 65535) {
+                throw std::runtime_error("Bad gdb port " + where);
+            }
+            listenFd = socket(AF_INET, SOCK_STREAM, 0);
+            if (listenFd < 0) throw std::runtime_error("Cannot create gdb socket");
+            int one = 1;
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons((uint16_t)port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+                throw std::runtime_error("Cannot bind gdb port " + where);
             }
         } else {
-            // I-type or J-type
-            switch (opcode) {
-                case 0x08: // ADDI
-                {
-                    int32_t v1 = (int32_t)registers[rs];
-                    int64_t res = (int64_t)v1 + (int64_t)simm;
-                    registers[rt] = (uint32_t)res;
-                    setFlag('Z', registers[rt]==0);
-                    setFlag('S', (registers[rt] & 0x80000000)!=0);
-                    // Overflow detection same logic as ADD
-                    bool overflow = ((v1>0 && simm>0 && (int32_t)res<0) ||
-                                     (v1<0 && simm<0 && (int32_t)res>0));
-                    setFlag('V', overflow);
-                    break;
+            listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listenFd < 0) throw std::runtime_error("Cannot create gdb socket");
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, where.c_str(), sizeof(addr.sun_path) - 1);
+            unlink(where.c_str());
+            if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+                throw std::runtime_error("Cannot bind gdb socket " + where);
+            }
+        }
+        if (listen(listenFd, 1) != 0) throw std::runtime_error("Cannot listen on gdb " + where);
+        std::cout << "Waiting for gdb on " << where << "...\n";
+        fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) throw std::runtime_error("gdb accept failed");
+        std::cout << "gdb connected.\n";
+
+        std::string packet;
+        while (readPacket(packet)) {
+            if (!handle(packet)) break;
+        }
+        std::cout << "gdb disconnected.\n";
+    }
+
+private:
+    CPU& cpu;
+    int listenFd;
+    int fd;
+    std::string pending;    // bytes received but not yet consumed
+    std::string lastSent;   // for retransmission on '-'
+
+    bool readByte(char& c) {
+        if (!pending.empty()) {
+            c = pending[0];
+            pending.erase(0, 1);
+            return true;
+        }
+        char buf[4096];
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        pending.assign(buf + 1, n - 1);
+        c = buf[0];
+        return true;
+    }
+
+    bool readPacket(std::string& packet) {
+        char c;
+        for (;;) {
+            if (!readByte(c)) return false;
+            if (c == '-') { sendRaw(lastSent); continue; }
+            if (c == 0x03) { packet = "?"; return true; } // ^C while stopped
+            if (c != '$') continue;                       // '+' acks and noise
+            packet.clear();
+            uint8_t sum = 0;
+            while (readByte(c) && c != '#') {
+                packet += c;
+                sum += (uint8_t)c;
+            }
+            char hex[3] = {0, 0, 0};
+            if (!readByte(hex[0]) || !readByte(hex[1])) return false;
+            if ((uint8_t)std::strtoul(hex, nullptr, 16) != sum) {
+                sendRaw("-");
+                continue;
+            }
+            sendRaw("+");
+            return true;
+        }
+    }
+
+    void sendRaw(const std::string& data) {
+        size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = send(fd, data.data() + off, data.size() - off, 0);
+            if (n <= 0) return;
+            off += n;
+        }
+    }
+
+    void sendPacket(const std::string& data) {
+        uint8_t sum = 0;
+        for (char c : data) sum += (uint8_t)c;
+        char tail[4];
+        std::snprintf(tail, sizeof(tail), "#%02x", sum);
+        lastSent = "$" + data + tail;
+        sendRaw(lastSent);
+    }
+
+    bool interruptPending() {
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 0) <= 0) return false;
+        char c;
+        if (!readByte(c)) return true; // connection gone: stop the target too
+        if (c == 0x03) return true;
+        pending.insert(pending.begin(), c);
+        return false;
+    }
+
+    static std::string hex32(uint32_t v) {
+        char buf[9];
+        std::snprintf(buf, sizeof(buf), "%08x", v);
+        return buf;
+    }
+
+    static uint32_t parseHex32(const std::string& s, size_t pos) {
+        return (uint32_t)std::strtoul(s.substr(pos, 8).c_str(), nullptr, 16);
+    }
+
+    // Parses the hex field s[begin, end) (end == npos means to the end of the
+    // packet). Packets come from the client, so an empty field, a stray
+    // character or more than 8 digits fails instead of throwing.
+    static bool parseHexField(const std::string& s, size_t begin, size_t end, uint32_t& out) {
+        if (end == std::string::npos) end = s.size();
+        if (begin >= end || end > s.size() || end - begin > 8) return false;
+        if (!std::isxdigit((unsigned char)s[begin])) return false;
+        std::string field = s.substr(begin, end - begin);
+        char* stop = nullptr;
+        unsigned long v = std::strtoul(field.c_str(), &stop, 16);
+        if (stop != field.c_str() + field.size()) return false;
+        out = (uint32_t)v;
+        return true;
+    }
+
+    uint32_t readRegister(uint32_t n) {
+        if (n < 32) return cpu.registers[n];
+        switch (n) {
+            case 32: return cpu.flagReg;       // sr carries the Z/C/V/S flags
+            case 33: return cpu.lo;
+            case 34: return cpu.hi;
+            case 35: return cpu.faultAddress;  // badvaddr
+            case GDB_PC_REG: return cpu.pc;
+        }
+        return 0;
+    }
+
+    void writeRegister(uint32_t n, uint32_t v) {
+        if (n > 0 && n < 32) cpu.registers[n] = v;
+        else if (n == 32) cpu.flagReg = v & 0x0F;
+        else if (n == 33) cpu.lo = v;
+        else if (n == 34) cpu.hi = v;
+        else if (n == GDB_PC_REG) cpu.pc = v;
+    }
+
+    std::string targetXml() {
+        std::ostringstream x;
+        x << "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+          << "<target version=\"1.0\"><architecture>mips</architecture>"
+          << "<feature name=\"org.gnu.gdb.mips.cpu\">";
+        for (int i = 0; i < 32; i++) {
+            x << "<reg name=\"r" << i << "\" bitsize=\"32\" regnum=\"" << i << "\"/>";
+        }
+        x << "<reg name=\"lo\" bitsize=\"32\" regnum=\"33\"/>"
+          << "<reg name=\"hi\" bitsize=\"32\" regnum=\"34\"/>"
+          << "<reg name=\"pc\" bitsize=\"32\" regnum=\"37\"/></feature>"
+          << "<feature name=\"org.gnu.gdb.mips.cp0\">"
+          << "<reg name=\"status\" bitsize=\"32\" regnum=\"32\"/>"
+          << "<reg name=\"badvaddr\" bitsize=\"32\" regnum=\"35\"/>"
+          << "<reg name=\"cause\" bitsize=\"32\" regnum=\"36\"/></feature>"
+          << "<feature name=\"org.gnu.gdb.mips.fpu\">";
+        for (int i = 0; i < 32; i++) {
+            x << "<reg name=\"f" << i << "\" bitsize=\"32\" type=\"ieee_single\" regnum=\""
+              << 38 + i << "\"/>";
+        }
+        x << "<reg name=\"fcsr\" bitsize=\"32\" group=\"float\" regnum=\"70\"/>"
+          << "<reg name=\"fir\" bitsize=\"32\" group=\"float\" regnum=\"71\"/>"
+          << "</feature></target>";
+        return x.str();
+    }
+
+    std::string stopReply() {
+        switch (cpu.stopReason) {
+            case STOP_HALT: return "W00";
+            case STOP_FAULT: return "S0b"; // SIGSEGV
+            case STOP_WATCHPOINT: {
+                const char* kind = cpu.watchHit.type == WATCH_WRITE ? "watch"
+                                 : cpu.watchHit.type == WATCH_READ ? "rwatch" : "awatch";
+                char buf[48];
+                std::snprintf(buf, sizeof(buf), "T05%s:%x;", kind, cpu.watchHitAddress);
+                return buf;
+            }
+            default: return "S05";
+        }
+    }
+
+    std::string resume(bool step) {
+        cpu.stepOverIcount = cpu.icount; // step off a breakpoint we are sitting on
+        if (step) {
+            cpu.runUntil(cpu.icount + 1);
+        } else {
+            for (;;) {
+                cpu.runUntil(cpu.icount + GDB_CONTINUE_SLICE);
+                if (!cpu.running) break;
+                if (interruptPending()) {
+                    cpu.stepOverIcount = UINT64_MAX;
+                    return "S02"; // SIGINT
                 }
-                // more instructions could be added here
-                default:
-                    std::cout << "Unknown opcode=0x" << std::hex << (int)opcode << "\n";
-                    break;
             }
         }
+        cpu.stepOverIcount = UINT64_MAX;
+        return stopReply();
+    }
 
+    // Returns false when the session should end.
+    bool handle(const std::string& pkt) {
+        char cmd = pkt.empty() ? 0 : pkt[0];
+        switch (cmd) {
+            case '?':
+                sendPacket(cpu.stopReason == STOP_NONE ? "S05" : stopReply());
+                return true;
+            case 'g': {
+                std::string out;
+                for (int i = 0; i < GDB_NUM_REGS; i++) out += hex32(readRegister(i));
+                sendPacket(out);
+                return true;
+            }
+            case 'G': {
+                for (int i = 0; i < GDB_NUM_REGS && (size_t)(1 + i*8 + 8) <= pkt.size(); i++) {
+                    writeRegister(i, parseHex32(pkt, 1 + i*8));
+                }
+                cpu.discardFuture();
+                sendPacket("OK");
+                return true;
+            }
+            case 'p': {
+                uint32_t reg;
+                if (!parseHexField(pkt, 1, std::string::npos, reg)) {
+                    sendPacket("E01");
+                    return true;
+                }
+                sendPacket(hex32(readRegister(reg)));
+                return true;
+            }
+            case 'P': {
+                size_t eq = pkt.find('=');
+                uint32_t reg, value;
+                if (eq == std::string::npos || !parseHexField(pkt, 1, eq, reg) ||
+                    !parseHexField(pkt, eq + 1, std::string::npos, value)) {
+                    sendPacket("E01");
+                    return true;
+                }
+                writeRegister(reg, value);
+                cpu.discardFuture();
+                sendPacket("OK");
+                return true;
+            }
+            case 'm': {
+                size_t comma = pkt.find(',');
+                uint32_t addr, len;
+                if (comma == std::string::npos || !parseHexField(pkt, 1, comma, addr) ||
+                    !parseHexField(pkt, comma + 1, std::string::npos, len)) {
+                    sendPacket("E01");
+                    return true;
+                }
+                if (addr >= MEMORY_SIZE || len > MEMORY_SIZE - addr) {
+                    sendPacket("E14");
+                    return true;
+                }
+                std::string out;
+                char buf[3];
+                for (uint32_t i = 0; i < len; i++) {
+                    std::snprintf(buf, sizeof(buf), "%02x", cpu.debugReadByte(addr + i));
+                    out += buf;
+                }
+                sendPacket(out);
+                return true;
+            }
+            case 'M': {
+                size_t comma = pkt.find(','), colon = pkt.find(':');
+                uint32_t addr, len;
+                if (comma == std::string::npos || colon == std::string::npos || colon < comma ||
+                    !parseHexField(pkt, 1, comma, addr) || !parseHexField(pkt, comma + 1, colon, len)) {
+                    sendPacket("E01");
+                    return true;
+                }
+                if (addr >= MEMORY_SIZE || len > MEMORY_SIZE - addr || len > (pkt.size() - colon - 1) / 2) {
+                    sendPacket("E14");
+                    return true;
+                }
+                // Check the whole payload before writing any of it.
+                std::vector<uint8_t> bytes(len);
+                for (uint32_t i = 0; i < len; i++) {
+                    uint32_t byte;
+                    if (!parseHexField(pkt, colon + 1 + i*2, colon + 3 + i*2, byte)) {
+                        sendPacket("E01");
+                        return true;
+                    }
+                    bytes[i] = (uint8_t)byte;
+                }
+                for (uint32_t i = 0; i < len; i++) cpu.debugWriteByte(addr + i, bytes[i]);
+                cpu.discardFuture();
+                sendPacket("OK");
+                return true;
+            }
+            case 'c':
+            case 's':
+                if (pkt.size() > 1) {
+                    uint32_t target;
+                    if (!parseHexField(pkt, 1, std::string::npos, target)) {
+                        sendPacket("E01");
+                        return true;
+                    }
+                    cpu.pc = target;
+                }
+                sendPacket(resume(cmd == 's'));
+                return true;
+            case 'b':
+                if (pkt == "bs" && cpu.recorder) {
+                    sendPacket(cpu.reverseStep(1) ? "S05" : "T05replaylog:begin;");
+                } else {
+                    sendPacket("");
+                }
+                return true;
+            case 'Z':
+            case 'z': {
+                // Z<type>,<addr>,<kind>
+                size_t c1 = pkt.find(',');
+                size_t c2 = c1 == std::string::npos ? c1 : pkt.find(',', c1 + 1);
+                uint32_t type, addr, len;
+                if (c2 == std::string::npos || !parseHexField(pkt, 1, c1, type) ||
+                    !parseHexField(pkt, c1 + 1, c2, addr) || !parseHexField(pkt, c2 + 1, std::string::npos, len)) {
+                    sendPacket("E01");
+                    return true;
+                }
+                bool insert = cmd == 'Z';
+                bool ok;
+                if (type == 0 || type == 1) {
+                    ok = insert ? cpu.insertBreakpoint(addr) : cpu.removeBreakpoint(addr);
+                } else if (type >= 2 && type <= 4) {
+                    int watch = type == 2 ? WATCH_WRITE : type == 3 ? WATCH_READ : WATCH_ACCESS;
+                    ok = true;
+                    if (insert) cpu.insertWatchpoint(addr, len, watch);
+                    else ok = cpu.removeWatchpoint(addr, len, watch);
+                } else {
+                    sendPacket("");
+                    return true;
+                }
+                sendPacket(ok ? "OK" : "E01");
+                return true;
+            }
+            case 'q':
+                if (pkt.compare(0, 10, "qSupported") == 0) {
+                    std::string features = "PacketSize=4000;qXfer:features:read+;swbreak+";
+                    if (cpu.recorder) features += ";ReverseStep+";
+                    sendPacket(features);
+                } else if (pkt.compare(0, 31, "qXfer:features:read:target.xml:") == 0) {
+                    size_t comma = pkt.find(',', 31);
+                    uint32_t offset, length;
+                    if (comma == std::string::npos || !parseHexField(pkt, 31, comma, offset) ||
+                        !parseHexField(pkt, comma + 1, std::string::npos, length)) {
+                        sendPacket("E01");
+                        return true;
+                    }
+                    std::string xml = targetXml();
+                    if (offset >= xml.size()) sendPacket("l");
+                    else if ((size_t)offset + length >= xml.size()) sendPacket("l" + xml.substr(offset));
+                    else sendPacket("m" + xml.substr(offset, length));
+                } else if (pkt == "qAttached") {
+                    sendPacket("1");
+                } else if (pkt == "qfThreadInfo") {
+                    sendPacket("m1");
+                } else if (pkt == "qsThreadInfo") {
+                    sendPacket("l");
+                } else if (pkt == "qC") {
+                    sendPacket("QC1");
+                } else if (pkt == "qSymbol::") {
+                    sendPacket("OK");
+                } else {
+                    sendPacket("");
+                }
+                return true;
+            case 'H':
+            case 'T':
+                sendPacket("OK");
+                return true;
+            case 'D':
+                sendPacket("OK");
+                return false;
+            case 'k':
+                return false;
+            default:
+                sendPacket(""); // unsupported
+                return true;
+        }
     }
 };
 
+//--------------------------------------
+// Debug shell (record/replay front end)
+//--------------------------------------
+static void debugShell(CPU& cpu) {
+    std::cout << "Commands: s [n] | c | rs [n] | rw <addr> | r | x <start> <end> | q\n";
+    std::string line;
+    while (std::cout << "(cpu " << std::dec << cpu.icount << ") " && std::getline(std::cin, line)) {
+        std::istringstream ss(line);
+        std::string cmd;
+        ss >> cmd;
+        if (cmd == "s") {
+            uint64_t n = 1;
+            ss >> n;
+            cpu.runUntil(cpu.icount + n);
+        } else if (cmd == "c") {
+            cpu.runUntil(UINT64_MAX);
+        } else if (cmd == "rs") {
+            uint64_t n = 1;
+            ss >> n;
+            if (!cpu.reverseStep(n)) std::cout << "Already at the start of the recording.\n";
+        } else if (cmd == "rw") {
+            uint32_t addr = 0;
+            ss >> std::hex >> addr;
+            if (!cpu.reverseToLastWrite(addr)) {
+                std::cout << "No recorded write to 0x" << std::hex << addr << ".\n";
+            }
+        } else if (cmd == "r") {
+            cpu.displayState();
+            continue;
+        } else if (cmd == "x") {
+            uint32_t start = 0, end = 0;
+            ss >> std::hex >> start >> end;
+            cpu.dumpMemory(start, end);
+            continue;
+        } else if (cmd == "q") {
+            break;
+        } else if (!cmd.empty()) {
+            std::cout << "Unknown command " << cmd << "\n";
+            continue;
+        } else {
+            continue;
+        }
+        std::cout << "PC: 0x" << std::hex << cpu.pc << (cpu.running ? "" : " (stopped)") << "\n";
+    }
+}
+
+//--------------------------------------
+// Simulation daemon
+//--------------------------------------
+// Runs many small guest programs in one process. Clients connect to a Unix
+// socket and send frames in which every integer is a big-endian u32, as
+// in program images:
+//
+//   request:  length (of the rest), id, instruction limit (0: default),
+//             image words, input count, image..., inputs...
+//   response: length (of the rest), id, status, pc, fault address,
+//             instructions retired (high word, low word), r0..r31,
+//             output count, outputs...
+//
+// Inputs feed the read-int syscall in order and the outputs are what
+// print-int printed (see CPU::batch). A connection may pipeline requests.
+// Responses carry the request id and may come back in any order.
+//
+// The main thread polls the socket and the connections and queues each
+// complete frame. Every worker owns one CPU from the pool, built at
+// start-up and reset() between programs. A worker takes its share of the
+// queue, up to DAEMON_BATCH requests, per trip to the lock. Responses for
+// one connection leave in a single write. Throughput is reported every
+// DAEMON_REPORT_SECONDS while requests are being served. On exit it is
+// reported over the time requests were outstanding.
+static const size_t DAEMON_BATCH = 32;
+static const uint64_t DAEMON_DEFAULT_LIMIT = 100000000;
+static const uint32_t DAEMON_MAX_FRAME = 16 + MEMORY_SIZE + 4 * BATCH_CONSOLE_LIMIT;
+static const int DAEMON_REPORT_SECONDS = 5;
+
+enum DaemonStatus : uint32_t { RESULT_HALTED, RESULT_FAULT, RESULT_LIMIT, RESULT_BREAK, RESULT_BAD_REQUEST };
+
+static void putU32(std::string& out, uint32_t v) {
+    char b[4] = {(char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v};
+    out.append(b, 4);
+}
+
+static uint32_t getU32(const char* p) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+static volatile sig_atomic_t daemonStop = 0;
+
+class SimulationDaemon {
+public:
+    SimulationDaemon(unsigned workers, const std::string& decodeCacheDir)
+        : listenFd(-1), stopping(false), served(0), batches(0), lastDoneNs(0) {
+        for (unsigned i = 0; i < std::max(1u, workers); i++) {
+            pool.emplace_back(new CPU(true));
+            pool.back()->coreId = i;
+            pool.back()->decodeCacheDir = decodeCacheDir;
+        }
+    }
+
+    ~SimulationDaemon() {
+        if (listenFd >= 0) close(listenFd);
+    }
+
+    void serve(const std::string& path) {
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0) throw std::runtime_error("Cannot create daemon socket");
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(path.c_str());
+        if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            throw std::runtime_error("Cannot bind daemon socket " + path);
+        }
+        if (listen(listenFd, SOMAXCONN) != 0) throw std::runtime_error("Cannot listen on daemon socket " + path);
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, [](int) { daemonStop = 1; });
+        signal(SIGTERM, [](int) { daemonStop = 1; });
+
+        for (auto& cpu : pool) threads.emplace_back(&SimulationDaemon::work, this, cpu.get());
+        std::cout << "Serving on " << path << " with " << pool.size() << " worker(s).\n" << std::flush;
+
+        std::vector<std::shared_ptr<Connection>> connections;
+        std::vector<pollfd> fds;
+        std::vector<Request> arrived;
+        auto started = std::chrono::steady_clock::now();
+        auto reportedAt = started;
+        uint64_t reportedServed = 0, reportedBatches = 0, queued = 0;
+        int64_t busySinceNs = -1; // requests outstanding since then
+        double busySeconds = 0;
+        while (!daemonStop) {
+            fds.assign(1, pollfd{listenFd, POLLIN, 0});
+            for (const auto& c : connections) fds.push_back({c->fd, POLLIN, 0});
+            if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+                throw std::runtime_error("poll failed");
+            }
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listenFd, nullptr, nullptr);
+                if (fd >= 0) connections.push_back(std::make_shared<Connection>(fd));
+            }
+            for (size_t i = 1; i < fds.size(); i++) {
+                if (fds[i].revents && !receive(connections[i - 1], arrived)) connections[i - 1].reset();
+            }
+            connections.erase(std::remove(connections.begin(), connections.end(), nullptr), connections.end());
+            if (!arrived.empty()) {
+                if (busySinceNs < 0) busySinceNs = nowNs();
+                queued += arrived.size();
+                std::lock_guard<std::mutex> guard(lock);
+                for (Request& r : arrived) queue.push_back(std::move(r));
+                ready.notify_all();
+                arrived.clear();
+            } else if (busySinceNs >= 0 && served == queued) {
+                busySeconds += (lastDoneNs - busySinceNs) / 1e9;
+                busySinceNs = -1;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(now - reportedAt).count();
+            if (seconds >= DAEMON_REPORT_SECONDS) {
+                uint64_t n = served - reportedServed, b = batches - reportedBatches;
+                if (n) {
+                    std::cout << "Served " << std::dec << n << " request(s) in " << seconds << " s ("
+                              << n / seconds << " req/s, " << (double)n / b << " per batch).\n" << std::flush;
+                }
+                reportedAt = now;
+                reportedServed += n;
+                reportedBatches += b;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (std::thread& t : threads) t.join();
+        unlink(path.c_str());
+        if (busySinceNs >= 0) busySeconds += (lastDoneNs - busySinceNs) / 1e9;
+        std::cout << "Served " << std::dec << served << " request(s) in total";
+        if (busySeconds > 0) std::cout << ", " << served / busySeconds << " req/s over " << busySeconds << " s busy";
+        std::cout << ".\n";
+        uint64_t cacheFailures = 0;
+        for (const auto& cpu : pool) cacheFailures += cpu->decodeCacheFailures;
+        if (cacheFailures) std::cerr << cacheFailures << " decode cache write(s) failed.\n";
+    }
+
+private:
+    struct Connection {
+        int fd;
+        std::mutex writeLock;
+        std::string received;  // main thread only
+        explicit Connection(int f) : fd(f) {}
+        ~Connection() { close(fd); }
+    };
+
+    // Queued requests keep their connection open until answered
+    struct Request {
+        std::shared_ptr<Connection> connection;
+        std::string frame;  // without the length word
+    };
+
+    int listenFd;
+    std::vector<std::unique_ptr<CPU>> pool;
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<Request> queue;
+    bool stopping;
+    std::atomic<uint64_t> served, batches;
+    std::atomic<int64_t> lastDoneNs;
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Reads what is available and queues the complete frames. False when
+    // the connection is finished with: closed, broken or out of sync.
+    static bool receive(const std::shared_ptr<Connection>& c, std::vector<Request>& arrived) {
+        char buf[65536];
+        ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        c->received.append(buf, n);
+        size_t off = 0;
+        while (c->received.size() - off >= 4) {
+            uint32_t length = getU32(&c->received[off]);
+            if (length > DAEMON_MAX_FRAME) return false;
+            if (c->received.size() - off - 4 < length) break;
+            arrived.push_back({c, c->received.substr(off + 4, length)});
+            off += 4 + length;
+        }
+        c->received.erase(0, off);
+        return true;
+    }
+
+    void work(CPU* cpu) {
+        std::vector<Request> batch;
+        std::vector<std::pair<Connection*, std::string>> replies;
+        std::vector<uint32_t> image;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ready.wait(guard, [&] { return stopping || !queue.empty(); });
+                if (queue.empty()) return; // stopping, and nothing left to answer
+                size_t n = std::max<size_t>(1, std::min(DAEMON_BATCH, queue.size() / pool.size()));
+                for (size_t i = 0; i < n; i++) {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+            for (const Request& r : batch) {
+                size_t k = 0;
+                while (k < replies.size() && replies[k].first != r.connection.get()) k++;
+                if (k == replies.size()) replies.push_back({r.connection.get(), std::string()});
+                runRequest(*cpu, r.frame, image, replies[k].second);
+            }
+            for (const auto& reply : replies) {
+                std::lock_guard<std::mutex> guard(reply.first->writeLock);
+                sendAll(reply.first->fd, reply.second);
+            }
+            served += batch.size();
+            batches++;
+            lastDoneNs = nowNs();
+            replies.clear();
+            batch.clear(); // last, releasing the connections
+        }
+    }
+
+    static void runRequest(CPU& cpu, const std::string& frame, std::vector<uint32_t>& image, std::string& out) {
+        const char* p = frame.data();
+        uint32_t id = frame.size() >= 4 ? getU32(p) : 0;
+        uint32_t words = frame.size() >= 16 ? getU32(p + 8) : 0;
+        uint32_t inputs = frame.size() >= 16 ? getU32(p + 12) : 0;
+        bool valid = frame.size() >= 16 && words <= MEMORY_SIZE / 4 && inputs <= BATCH_CONSOLE_LIMIT &&
+                     frame.size() == 16 + 4 * ((size_t)words + inputs);
+        cpu.reset();
+        uint32_t status = RESULT_BAD_REQUEST;
+        if (valid) {
+            uint64_t limit = getU32(p + 4) ? getU32(p + 4) : DAEMON_DEFAULT_LIMIT;
+            image.resize(words);
+            for (uint32_t i = 0; i < words; i++) image[i] = getU32(p + 16 + 4 * i);
+            for (uint32_t i = 0; i < inputs; i++) cpu.consoleInput.push_back(getU32(p + 16 + 4 * (words + i)));
+            cpu.loadProgram(image, 0);
+            cpu.runUntil(limit);
+            status = cpu.running ? RESULT_LIMIT
+                   : cpu.stopReason == STOP_FAULT ? RESULT_FAULT
+                   : cpu.stopReason == STOP_BREAKPOINT ? RESULT_BREAK : RESULT_HALTED;
+        }
+
+        size_t start = out.size();
+        putU32(out, 0); // length, patched below
+        putU32(out, id);
+        putU32(out, status);
+        putU32(out, cpu.pc);
+        putU32(out, cpu.faultAddress);
+        putU32(out, (uint32_t)(cpu.icount >> 32));
+        putU32(out, (uint32_t)cpu.icount);
+        for (int i = 0; i < NUM_REGISTERS; i++) putU32(out, cpu.registers[i]);
+        putU32(out, cpu.consoleOutput.size());
+        for (uint32_t v : cpu.consoleOutput) putU32(out, v);
+        uint32_t length = out.size() - start - 4;
+        for (int i = 0; i < 4; i++) out[start + i] = (char)(length >> (24 - 8 * i));
+    }
+};
+
+// Client for the daemon: sends `program` `requests` times, keeping up to
+// `window` requests in flight, and prints the first result and the rate.
+static void submitPrograms(const std::string& path, const std::vector<uint32_t>& program,
+                           const std::vector<uint32_t>& inputs, uint64_t requests, unsigned window) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("Cannot create socket");
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot connect to daemon socket " + path);
+    }
+    std::string frame;
+    putU32(frame, 16 + 4 * (program.size() + inputs.size()));
+    putU32(frame, 0); // id, patched per request
+    putU32(frame, 0); // default instruction limit
+    putU32(frame, program.size());
+    putU32(frame, inputs.size());
+    for (uint32_t w : program) putU32(frame, w);
+    for (uint32_t v : inputs) putU32(frame, v);
+
+    static const char* STATUS[] = {"halted", "guest memory fault", "instruction limit", "BREAK", "bad request"};
+    auto started = std::chrono::steady_clock::now();
+    uint64_t sent = 0, received = 0;
+    std::string pending;
+    char buf[65536];
+    while (received < requests) {
+        std::string burst;
+        while (sent < requests && sent - received < window) {
+            for (int i = 0; i < 4; i++) frame[4 + i] = (char)(sent >> (24 - 8 * i));
+            burst += frame;
+            sent++;
+        }
+        if (!burst.empty() && !sendAll(fd, burst)) break;
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        pending.append(buf, n);
+        size_t off = 0;
+        while (pending.size() - off >= 4 && pending.size() - off - 4 >= getU32(&pending[off])) {
+            const char* r = &pending[off + 4];
+            if (received == 0) {
+                uint32_t status = getU32(r + 4);
+                uint64_t icount = ((uint64_t)getU32(r + 16) << 32) | getU32(r + 20);
+                std::cout << "Request " << std::dec << getU32(r) << ": "
+                          << (status <= RESULT_BAD_REQUEST ? STATUS[status] : "unknown status")
+                          << " after " << icount << " instruction(s), PC=0x" << std::hex << getU32(r + 8)
+                          << ", R2=0x" << getU32(r + 24 + 4 * 2) << std::dec;
+                uint32_t outputs = getU32(r + 24 + 4 * NUM_REGISTERS);
+                if (outputs) std::cout << ", printed";
+                for (uint32_t i = 0; i < outputs; i++) std::cout << " " << (int32_t)getU32(r + 28 + 4 * (NUM_REGISTERS + i));
+                std::cout << "\n";
+            }
+            received++;
+            off += 4 + getU32(&pending[off]);
+        }
+        pending.erase(0, off);
+    }
+    close(fd);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << std::dec << received << " of " << requests << " response(s) in " << seconds << " s ("
+              << received / seconds << " req/s).\n";
+    if (received < requests) throw std::runtime_error("Daemon closed the connection");
+}
+
 //--------------------------------------
 // main function
 //--------------------------------------
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        // Usage: cpu [--record] [--checkpoint-interval N] [--debug]
+        //            [--gdb <port|socket-path>]
+        //            [--stats <prefix>] [--stats-interval N]
+        //            [--decode-cache <dir>] [program.bin]
+        //        cpu --serve <socket-path> [--workers N] [--decode-cache <dir>]
+        //        cpu --submit <socket-path> [--requests N] [--window N] [--input V]... program.bin
+        bool record = false, debug = false;
+        uint64_t interval = DEFAULT_CHECKPOINT_INTERVAL, statsInterval = 0;
+        std::string programFile, gdbEndpoint, statsPrefix, decodeCacheDir;
+        std::string serveSocket, submitSocket;
+        unsigned workers = std::thread::hardware_concurrency(), window = 64;
+        uint64_t requests = 1;
+        std::vector<uint32_t> inputs;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--record") record = true;
+            else if (arg == "--debug") debug = record = true;
+            else if (arg == "--gdb" && i + 1 < argc) gdbEndpoint = argv[++i];
+            else if (arg == "--stats" && i + 1 < argc) statsPrefix = argv[++i];
+            else if (arg == "--stats-interval" && i + 1 < argc) statsInterval = std::stoull(argv[++i]);
+            else if (arg == "--decode-cache" && i + 1 < argc) decodeCacheDir = argv[++i];
+            else if (arg == "--checkpoint-interval" && i + 1 < argc) interval = std::stoull(argv[++i]);
+            else if (arg == "--serve" && i + 1 < argc) serveSocket = argv[++i];
+            else if (arg == "--workers" && i + 1 < argc) workers = std::stoul(argv[++i]);
+            else if (arg == "--submit" && i + 1 < argc) submitSocket = argv[++i];
+            else if (arg == "--requests" && i + 1 < argc) requests = std::stoull(argv[++i]);
+            else if (arg == "--window" && i + 1 < argc) window = std::max(1ul, std::stoul(argv[++i]));
+            else if (arg == "--input" && i + 1 < argc) inputs.push_back((uint32_t)std::stol(argv[++i]));
+            else programFile = arg;
+        }
+
+        if (!serveSocket.empty()) {
+            SimulationDaemon daemon(workers, decodeCacheDir);
+            daemon.serve(serveSocket);
+            return 0;
+        }
+        if (!submitSocket.empty()) {
+            if (programFile.empty()) throw std::runtime_error("--submit needs a program file");
+            submitPrograms(submitSocket, CPU::readProgramFile(programFile), inputs, requests, window);
+            return 0;
+        }
+
         CPU cpu;
+        cpu.decodeCacheDir = decodeCacheDir;
         // Example program:
         // Instruction list (assuming standard MIPS encoding):
         // addi $t0, $zero, 5 = 0x20080005 (opcode=0x08, rs=0, rt=8, imm=5)
@@ -269,12 +2190,29 @@ int main() {
             0x01095020, // add $t2,$t0,$t1
             HALT_INSTR  // halt
         };
+        if (!programFile.empty()) program = cpu.readProgramFile(programFile);
 
         cpu.loadProgram(program, 0x0000);
+        if (record) cpu.startRecording(interval);
+        if (!statsPrefix.empty()) cpu.enableStats(statsPrefix, statsInterval);
+        if (!gdbEndpoint.empty()) {
+            GdbStub stub(cpu);
+            stub.serve(gdbEndpoint);
+            cpu.writeStats();
+            return 0;
+        }
+        if (debug) {
+            debugShell(cpu);
+            cpu.writeStats();
+            return 0;
+        }
         cpu.dumpMemory(0x0000, 0x0000 + program.size()*4);
         cpu.run();
         cpu.dumpMemory(0x0000, 0x0000 + program.size()*4);
         cpu.displayState();
+        std::cout << "Retired " << std::dec << cpu.icount << " instructions in "
+                  << cpu.stats.wallSeconds << " s (" << cpu.simulatedMips() << " MIPS).\n";
+        cpu.writeStats();
 
     } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << "\n";
@@ -1,85 +1,2949 @@
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <sstream>
 #include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <iterator>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
 #include <stdexcept>
+#include "HLL_to_Assembly.h"
 
-// Function to convert C++ code to assembly (handling recursion)
-std::string cpp_to_assembly(const std::string& cpp_code) {
-    std::string assembly_code;
+// Compiler for a C subset to the toolchain assembly (Assembly_to_Binary.cpp).
+//
+//   program   := function*
+//   function  := ("int" | "void") name "(" [ "int" name { "," "int" name } ] ")" ( block | ";" )
+//   statement := block | "int" name [ "=" expr ] ";" | name ("=" | "+=" | "-=" | "*=") expr ";"
+//              | name ("++" | "--") ";" | "if" "(" expr ")" statement [ "else" statement ]
+//              | "while" "(" expr ")" statement | "for" "(" [simple] ";" [expr] ";" [simple] ")" statement
+//              | "return" [ expr ] ";" | "break" ";" | "continue" ";" | expr ";"
+//   expr      := C precedence over || && == != < <= > >= + - * / % and unary - !, calls, ints
+//
+// The pipeline is parse -> linear IR over virtual registers -> inlining
+// (-O2) -> SSA optimizations (-O1, -O2) -> liveness -> linear-scan allocation to R0-R7
+// -> machine instructions, list-scheduled per basic block for a pipeline
+// model from -O1 up -> assembly text. Arguments are passed in
+// R0..R7 and the result is returned in R0; every register is caller-saved.
+// Values live across a call are pushed before its arguments are evaluated
+// and popped after it returns, so they only occupy a register while they
+// are actually in use. The ISA has no loads or stores, so there is nothing
+// to spill to: a function that needs more than eight live values at once is
+// rejected.
+//
+// Self tail calls, and linear recursion of the form "return x + f(...)" or
+// "return x * f(...)", become loops (the latter with an accumulator); any
+// other call whose result is returned directly becomes a JMP to the callee.
+
+// The compiler proper; HLL_to_Assembly.h is its interface. main() is
+// compiled out with TOOLCHAIN_LIBRARY defined, for the toolchain library.
+namespace htoa {
+
+const int NUM_REGISTERS = 8;
+
+struct CompileError : std::runtime_error {
+    CompileError(int line, const std::string& message)
+        : std::runtime_error("line " + std::to_string(line) + ": " + message) {}
+};
+
+//--------------------------------------
+// Lexer
+//--------------------------------------
+enum class Tok { Ident, Number, Punct, End };
+
+struct Token {
+    Tok kind;
+    std::string text;
+    int64_t value = 0;
+    int line = 0;
+};
+
+static std::vector<Token> tokenize(const std::string& src) {
+    static const char* const PUNCT[] = {"&&", "||", "==", "!=", "<=", ">=", "+=", "-=", "*=", "++", "--",
+                                        "(", ")", "{", "}", ",", ";", "=", "<", ">", "+", "-", "*", "/",
+                                        "%", "!"};
+    std::vector<Token> tokens;
+    int line = 1;
+    size_t i = 0;
+    while (i < src.size()) {
+        char c = src[i];
+        if (c == '\n') {
+            line++;
+            i++;
+        } else if (isspace((unsigned char)c)) {
+            i++;
+        } else if (c == '#' || src.compare(i, 2, "//") == 0) {  // preprocessor lines are ignored
+            while (i < src.size() && src[i] != '\n') i++;
+        } else if (src.compare(i, 2, "/*") == 0) {
+            size_t end = src.find("*/", i + 2);
+            if (end == std::string::npos) throw CompileError(line, "unterminated comment");
+            line += (int)std::count(src.begin() + i, src.begin() + end, '\n');
+            i = end + 2;
+        } else if (isalpha((unsigned char)c) || c == '_') {
+            size_t start = i;
+            while (i < src.size() && (isalnum((unsigned char)src[i]) || src[i] == '_')) i++;
+            tokens.push_back({Tok::Ident, src.substr(start, i - start), 0, line});
+        } else if (isdigit((unsigned char)c)) {
+            size_t start = i;
+            while (i < src.size() && isalnum((unsigned char)src[i])) i++;
+            std::string text = src.substr(start, i - start);
+            size_t used = 0;
+            int64_t value = 0;
+            try {
+                value = std::stoll(text, &used, 0);
+            } catch (const std::exception&) {
+            }
+            if (used != text.size() || value > 0xFFFFFFFFll) throw CompileError(line, "bad number '" + text + "'");
+            tokens.push_back({Tok::Number, text, value, line});
+        } else {
+            const char* match = nullptr;
+            for (const char* p : PUNCT) {
+                if (src.compare(i, strlen(p), p) == 0) {
+                    match = p;
+                    break;
+                }
+            }
+            if (!match) throw CompileError(line, std::string("unexpected character '") + c + "'");
+            tokens.push_back({Tok::Punct, match, 0, line});
+            i += strlen(match);
+        }
+    }
+    tokens.push_back({Tok::End, "", 0, line});
+    return tokens;
+}
+
+//--------------------------------------
+// Syntax tree
+//--------------------------------------
+struct Expr {
+    enum Kind { Num, Var, Unary, Binary, Call } kind;
+    std::string op;     // operator, variable or callee name
+    int64_t value = 0;  // Num
+    std::vector<std::unique_ptr<Expr>> kids;
+    int line = 0;
+};
+
+struct Stmt {
+    enum Kind { Block, Decl, Assign, ExprStmt, If, While, For, Return, Break, Continue } kind;
+    std::string name, op;       // Decl/Assign target, assignment operator
+    std::unique_ptr<Expr> expr;  // initializer, value, condition
+    std::vector<std::unique_ptr<Stmt>> body;  // Block; If: then, else; While: body; For: init, step, body
+    int line = 0;
+};
+
+struct FunctionDecl {
+    std::string name;
+    bool returnsInt = true;
+    std::vector<std::string> params;
+    std::unique_ptr<Stmt> body;  // null for a prototype
+    int line = 0;
+};
+
+class Parser {
+public:
+    explicit Parser(std::vector<Token> t) : tokens(std::move(t)) {}
+
+    std::vector<FunctionDecl> program() {
+        std::vector<FunctionDecl> functions;
+        while (peek().kind != Tok::End) functions.push_back(function());
+        return functions;
+    }
+
+private:
+    std::vector<Token> tokens;
+    size_t pos = 0;
+
+    const Token& peek(size_t ahead = 0) const { return tokens[std::min(pos + ahead, tokens.size() - 1)]; }
+    bool at(const char* text) const { return peek().kind != Tok::Number && peek().text == text; }
+    bool accept(const char* text) {
+        if (!at(text)) return false;
+        pos++;
+        return true;
+    }
+    void expect(const char* text) {
+        if (!accept(text)) throw CompileError(peek().line, std::string("expected '") + text + "'");
+    }
+    std::string identifier() {
+        if (peek().kind != Tok::Ident) throw CompileError(peek().line, "expected a name");
+        return tokens[pos++].text;
+    }
+
+    FunctionDecl function() {
+        FunctionDecl f;
+        f.line = peek().line;
+        if (accept("void")) f.returnsInt = false;
+        else expect("int");
+        f.name = identifier();
+        expect("(");
+        if (!accept(")")) {
+            if (!(at("void") && peek(1).text == ")")) {
+                do {
+                    expect("int");
+                    f.params.push_back(peek().kind == Tok::Ident ? identifier() : "");
+                } while (accept(","));
+            } else {
+                pos++;
+            }
+            expect(")");
+        }
+        if (!accept(";")) f.body = block();
+        return f;
+    }
+
+    std::unique_ptr<Stmt> make(Stmt::Kind kind) {
+        auto s = std::make_unique<Stmt>();
+        s->kind = kind;
+        s->line = peek().line;
+        return s;
+    }
+
+    std::unique_ptr<Stmt> block() {
+        auto s = make(Stmt::Block);
+        expect("{");
+        while (!accept("}")) {
+            if (peek().kind == Tok::End) throw CompileError(peek().line, "expected '}'");
+            s->body.push_back(statement());
+        }
+        return s;
+    }
+
+    // Declaration, assignment or expression, without the ';'
+    std::unique_ptr<Stmt> simple() {
+        if (accept("int")) {
+            auto s = make(Stmt::Decl);
+            s->name = identifier();
+            if (accept("=")) s->expr = expr();
+            return s;
+        }
+        if (peek().kind == Tok::Ident) {
+            const std::string& next = peek(1).text;
+            if (next == "=" || next == "+=" || next == "-=" || next == "*=" || next == "++" || next == "--") {
+                auto s = make(Stmt::Assign);
+                s->name = identifier();
+                s->op = tokens[pos++].text;
+                if (s->op != "++" && s->op != "--") s->expr = expr();
+                return s;
+            }
+        }
+        auto s = make(Stmt::ExprStmt);
+        s->expr = expr();
+        return s;
+    }
+
+    std::unique_ptr<Stmt> statement() {
+        if (at("{")) return block();
+        if (accept("if")) {
+            auto s = make(Stmt::If);
+            expect("(");
+            s->expr = expr();
+            expect(")");
+            s->body.push_back(statement());
+            if (accept("else")) s->body.push_back(statement());
+            return s;
+        }
+        if (accept("while")) {
+            auto s = make(Stmt::While);
+            expect("(");
+            s->expr = expr();
+            expect(")");
+            s->body.push_back(statement());
+            return s;
+        }
+        if (accept("for")) {
+            auto s = make(Stmt::For);
+            expect("(");
+            s->body.push_back(at(";") ? nullptr : simple());
+            expect(";");
+            if (!at(";")) s->expr = expr();
+            expect(";");
+            s->body.push_back(at(")") ? nullptr : simple());
+            expect(")");
+            s->body.push_back(statement());
+            return s;
+        }
+        if (accept("return")) {
+            auto s = make(Stmt::Return);
+            if (!at(";")) s->expr = expr();
+            expect(";");
+            return s;
+        }
+        if (accept("break") || accept("continue")) {
+            auto s = make(tokens[pos - 1].text == "break" ? Stmt::Break : Stmt::Continue);
+            expect(";");
+            return s;
+        }
+        auto s = simple();
+        expect(";");
+        return s;
+    }
+
+    std::unique_ptr<Expr> node(Expr::Kind kind, const std::string& op, int line) {
+        auto e = std::make_unique<Expr>();
+        e->kind = kind;
+        e->op = op;
+        e->line = line;
+        return e;
+    }
+
+    // Binary levels, loosest first
+    std::unique_ptr<Expr> expr(int level = 0) {
+        static const std::vector<std::vector<std::string>> LEVELS = {
+            {"||"}, {"&&"}, {"==", "!="}, {"<", "<=", ">", ">="}, {"+", "-"}, {"*", "/", "%"}};
+        if (level == (int)LEVELS.size()) return unary();
+        auto left = expr(level + 1);
+        for (;;) {
+            const auto& ops = LEVELS[level];
+            if (peek().kind != Tok::Punct || std::find(ops.begin(), ops.end(), peek().text) == ops.end()) break;
+            auto e = node(Expr::Binary, peek().text, peek().line);
+            pos++;
+            e->kids.push_back(std::move(left));
+            e->kids.push_back(expr(level + 1));
+            left = std::move(e);
+        }
+        return left;
+    }
+
+    std::unique_ptr<Expr> unary() {
+        if (at("-") || at("!")) {
+            auto e = node(Expr::Unary, peek().text, peek().line);
+            pos++;
+            e->kids.push_back(unary());
+            return e;
+        }
+        if (accept("+")) return unary();
+        return primary();
+    }
+
+    std::unique_ptr<Expr> primary() {
+        const Token& t = peek();
+        if (t.kind == Tok::Number) {
+            auto e = node(Expr::Num, t.text, t.line);
+            e->value = t.value;
+            pos++;
+            return e;
+        }
+        if (accept("(")) {
+            auto e = expr();
+            expect(")");
+            return e;
+        }
+        if (t.kind != Tok::Ident) throw CompileError(t.line, "expected an expression");
+        auto e = node(Expr::Var, identifier(), t.line);
+        if (accept("(")) {
+            e->kind = Expr::Call;
+            if (!accept(")")) {
+                do e->kids.push_back(expr());
+                while (accept(","));
+                expect(")");
+            }
+        }
+        return e;
+    }
+};
+
+//--------------------------------------
+// IR: a linear list of three-address instructions over virtual registers
+//--------------------------------------
+// Div and Rem divide by 2^imm; they are expanded into shifts before code
+// generation. ArgStart marks where the arguments of the Call with the same
+// imm begin to be evaluated. Phi only exists in SSA form.
+enum class Op {
+    Param, Const, Copy, Add, Sub, Mul, Slt, Dec, Shl, Srl, Div, Rem,
+    Label, Jump, JumpEq, ArgStart, Call, Ret, Save, Restore, Phi
+};
+
+struct Instr {
+    Op op;
+    int dst = -1, a = -1, b = -1;  // virtual registers; JumpEq with b < 0 compares with imm
+    int32_t imm = 0;               // Const value, shift amount, Param index, Call/ArgStart id
+    int label = -1;                // Label, Jump, JumpEq
+    std::string callee = {};
+    std::vector<int> args = {};    // Call arguments, Phi operands
+    std::vector<int> from = {};    // Phi: the predecessor block of each operand
+};
+
+struct IrFunction {
+    std::string name;
+    std::vector<Instr> code;
+    int vregs = 0;
+    int labels = 0;
+    int calls = 0;
+};
+
+// Calls fn on each virtual register the instruction reads
+template <class I, class Fn>
+static void forEachUse(I& i, Fn fn) {
+    switch (i.op) {
+    case Op::Copy: case Op::Dec: case Op::Shl: case Op::Srl: case Op::Div: case Op::Rem: case Op::Save: fn(i.a); break;
+    case Op::Add: case Op::Sub: case Op::Mul: case Op::Slt: fn(i.a); fn(i.b); break;
+    case Op::JumpEq: fn(i.a); if (i.b >= 0) fn(i.b); break;
+    case Op::Call: case Op::Phi: for (auto& a : i.args) fn(a); break;
+    case Op::Ret: if (i.a >= 0) fn(i.a); break;
+    default: break;
+    }
+}
+
+static void usesOf(const Instr& i, std::vector<int>& out) {
+    out.clear();
+    forEachUse(i, [&](int v) { out.push_back(v); });
+}
+
+static int defOf(const Instr& i) {
+    switch (i.op) {
+    case Op::Label: case Op::Jump: case Op::JumpEq: case Op::ArgStart: case Op::Ret: case Op::Save: return -1;
+    default: return i.dst;
+    }
+}
+
+// No effect beyond defining dst, so it may be removed, merged or moved
+static bool isPure(Op op) {
+    switch (op) {
+    case Op::Const: case Op::Copy: case Op::Add: case Op::Sub: case Op::Mul: case Op::Slt:
+    case Op::Dec: case Op::Shl: case Op::Srl: case Op::Div: case Op::Rem: case Op::Phi:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Lowers one function's syntax tree to IR. Locals are virtual registers;
+// conditions become compare-and-branch without materializing booleans.
+class Lowering {
+public:
+    Lowering(const std::map<std::string, const FunctionDecl*>& decls) : functions(decls) {}
+
+    IrFunction lower(const FunctionDecl& f) {
+        ir = IrFunction();
+        ir.name = f.name;
+        scopes.assign(1, {});
+        if (f.params.size() > NUM_REGISTERS) throw CompileError(f.line, "more than 8 parameters");
+        self = &f;
+        params.clear();
+        for (size_t i = 0; i < f.params.size(); i++) {
+            int v = newReg();
+            emit({Op::Param, v, -1, -1, (int32_t)i});
+            if (!f.params[i].empty()) scopes.back()[f.params[i]] = v;
+            params.push_back(v);
+        }
+        returnsInt = f.returnsInt;
+        planRecursion(*f.body);
+        if (top >= 0) {
+            if (accumulator >= 0) emit({Op::Const, accumulator, -1, -1, accumulateOp == Op::Mul ? 1 : 0});
+            label(top);
+        }
+        statement(*f.body);
+        if (fallsThrough()) emit({Op::Ret});
+        // Out-of-line blocks (taken branches that end in a return), placed last
+        for (size_t k = 0; k < deferred.size(); k++) {
+            Deferred d = std::move(deferred[k]);
+            scopes = std::move(d.scopes);
+            loops = std::move(d.loops);
+            label(d.label);
+            statement(*d.body);
+        }
+        deferred.clear();
+        return std::move(ir);
+    }
+
+private:
+    const std::map<std::string, const FunctionDecl*>& functions;
+    IrFunction ir;
+    std::vector<std::map<std::string, int>> scopes;
+    std::vector<std::pair<int, int>> loops;  // (continue, break) labels
+    struct Deferred {
+        int label;
+        const Stmt* body;
+        std::vector<std::map<std::string, int>> scopes;  // as at the branch
+        std::vector<std::pair<int, int>> loops;
+    };
+    std::vector<Deferred> deferred;
+    bool returnsInt = true;
+    const FunctionDecl* self = nullptr;
+    std::vector<int> params;    // virtual registers of the parameters
+    int top = -1;               // loop head for self tail calls, or -1
+    int accumulator = -1;       // register folding pending "x op" results, or -1
+    Op accumulateOp = Op::Add;
+
+    int newReg() { return ir.vregs++; }
+    int newLabel() { return ir.labels++; }
+    void emit(Instr i) { ir.code.push_back(std::move(i)); }
+    void label(int l) { emit({Op::Label, -1, -1, -1, 0, l}); }
+    void jump(int l) { emit({Op::Jump, -1, -1, -1, 0, l}); }
+    void jumpEq(int a, int b, int32_t imm, int l) { emit({Op::JumpEq, -1, a, b, imm, l}); }
+
+    bool fallsThrough() const {
+        if (ir.code.empty()) return true;
+        Op op = ir.code.back().op;
+        return op != Op::Ret && op != Op::Jump;
+    }
+
+    int lookup(const std::string& name, int line) const {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            auto found = it->find(name);
+            if (found != it->end()) return found->second;
+        }
+        throw CompileError(line, "undeclared variable '" + name + "'");
+    }
+
+    static bool isSmall(const Expr& e) { return e.kind == Expr::Num && e.value <= 32767; }
+
+    static bool powerOfTwo(const Expr& e, int& shift) {
+        if (e.kind != Expr::Num || e.value <= 0 || (e.value & (e.value - 1)) != 0) return false;
+        for (shift = 0; (int64_t(1) << shift) != e.value; shift++) {}
+        return true;
+    }
+
+    // Does control leave the statement other than by falling off its end?
+    static bool alwaysReturns(const Stmt& s) {
+        switch (s.kind) {
+        case Stmt::Return: return true;
+        case Stmt::Block:
+            for (const auto& child : s.body) {
+                if (alwaysReturns(*child)) return true;
+            }
+            return false;
+        case Stmt::If: return s.body.size() == 2 && alwaysReturns(*s.body[0]) && alwaysReturns(*s.body[1]);
+        default: return false;
+        }
+    }
+
+    // Is "jump if e == jumpIf" a single compare-and-branch? JE is the only
+    // conditional branch, so == is cheap when taken on true and a plain
+    // value (compared with 0) when taken on false.
+    static bool cheapBranch(const Expr& e, bool jumpIf) {
+        if (e.kind == Expr::Unary && e.op == "!") return cheapBranch(*e.kids[0], !jumpIf);
+        if (e.kind != Expr::Binary) return !jumpIf;
+        if (e.op == "==") return jumpIf;
+        if (e.op == "!=") return !jumpIf;
+        if (e.op == "<" || e.op == "<=" || e.op == ">" || e.op == ">=") return true;
+        if (e.op == "&&") return !jumpIf;
+        if (e.op == "||") return jumpIf;
+        return !jumpIf;
+    }
+
+    bool isSelfCall(const Expr& e) const { return e.kind == Expr::Call && e.op == self->name; }
+
+    bool callsSelf(const Expr& e) const {
+        if (isSelfCall(e)) return true;
+        for (const auto& kid : e.kids) {
+            if (callsSelf(*kid)) return true;
+        }
+        return false;
+    }
+
+    static void returnsIn(const Stmt& s, std::vector<const Expr*>& out) {
+        if (s.kind == Stmt::Return && s.expr) out.push_back(s.expr.get());
+        for (const auto& child : s.body) {
+            if (child) returnsIn(*child, out);
+        }
+    }
+
+    // The self call in "x op self(...)" or "self(...) op x", where op is
+    // + or * and x does not recurse; null otherwise
+    const Expr* accumulatedCall(const Expr& e, const Expr*& other) const {
+        if (e.kind != Expr::Binary || (e.op != "+" && e.op != "*")) return nullptr;
+        for (int k = 0; k < 2; k++) {
+            if (isSelfCall(*e.kids[k]) && !callsSelf(*e.kids[1 - k])) {
+                other = e.kids[1 - k].get();
+                return e.kids[k].get();
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns of the form "self(...)" become a jump back to the top with
+    // the parameters reassigned. If the only other recursive returns are
+    // "x op self(...)" with a single op among + and *, they become loops
+    // too: x is folded into an accumulator (identity at entry) and every
+    // non-recursive return yields accumulator op value. 32-bit + and * are
+    // associative and commutative, so the order of folding is immaterial.
+    void planRecursion(const Stmt& body) {
+        top = accumulator = -1;
+        std::vector<const Expr*> returns;
+        returnsIn(body, returns);
+        std::set<std::string> ops;
+        bool tail = false;
+        for (const Expr* e : returns) {
+            const Expr* other;
+            if (isSelfCall(*e)) tail = true;
+            else if (accumulatedCall(*e, other)) ops.insert(e->op);
+        }
+        if (ops.size() == 1) {
+            accumulator = newReg();
+            accumulateOp = *ops.begin() == "*" ? Op::Mul : Op::Add;
+        }
+        if (tail || accumulator >= 0) top = newLabel();
+    }
 
-    // Handling recursion (e.g., factorial function)
-    if (cpp_code.find("factorial") != std::string::npos) {
-        size_t func_start = cpp_code.find("factorial") + 10; // "factorial" is 9 chars long
-        size_t param_start = cpp_code.find("(") + 1;
-        size_t param_end = cpp_code.find(")");
-        std::string param = cpp_code.substr(param_start, param_end - param_start);
-        
-        // Factorial Base Case: if n == 0 return 1
-        assembly_code += "MOV R0, 0\n";  // Load n (R0 holds the value of n)
-        assembly_code += "CMP R0, 0\n";  // Compare n with 0
-        assembly_code += "JE factorial_base_case\n";  // If n == 0, jump to base case
-
-        // Factorial Recursive Case: return n * factorial(n-1)
-        assembly_code += "PUSH R0\n";  // Save current n (push it to the stack)
-        assembly_code += "DEC R0\n";  // Decrement n (prepare for recursive call)
-        assembly_code += "CALL factorial\n";  // Call the factorial function
-        
-        assembly_code += "POP R1\n";  // Pop the saved value of n
-        assembly_code += "MUL R0, R0, R1\n";  // Multiply n with factorial(n-1)
-        assembly_code += "JMP factorial_end\n";  // Jump to end of function
-
-        // Factorial Base Case: if n == 0 return 1
-        assembly_code += "factorial_base_case:\n";
-        assembly_code += "MOV R0, 1\n";  // Return 1 for base case
-
-        // End of function
-        assembly_code += "factorial_end:\n";
-    }
-
-    return assembly_code;
-}
-
-// Function to convert assembly code to binary
-std::string assembly_to_binary(const std::string& assembly_code) {
-    std::string binary_code;
-    std::istringstream stream(assembly_code);
+    // Lower "return e" as a jump back to the top if planRecursion allows it
+    bool tailRecursion(const Expr& e) {
+        if (top < 0) return false;
+        const Expr* other = nullptr;
+        const Expr* call = isSelfCall(e) ? &e : nullptr;
+        if (!call && accumulator >= 0) {
+            call = accumulatedCall(e, other);
+            if (call && (e.op == "*") != (accumulateOp == Op::Mul)) call = nullptr;
+        }
+        if (!call) return false;
+        if (call->kids.size() != params.size()) return false;  // call() reports it
+        // Expressions have no side effects, so x may be folded first; the
+        // parameters it reads then die before the arguments are computed
+        if (other) emit({accumulateOp, accumulator, accumulator, expr(*other)});
+        std::vector<int> values;
+        for (const auto& arg : call->kids) {
+            int v = expr(*arg);
+            if (arg->kind == Expr::Var) {  // the variable may be a parameter reassigned below
+                int t = newReg();
+                emit({Op::Copy, t, v});
+                v = t;
+            }
+            values.push_back(v);
+        }
+        for (size_t k = 0; k < params.size(); k++) emit({Op::Copy, params[k], values[k]});
+        jump(top);
+        return true;
+    }
+
+    // Jump to `target` if the truth of e equals jumpIf; otherwise fall through.
+    void branch(const Expr& e, bool jumpIf, int target) {
+        if (e.kind == Expr::Num) {
+            if ((e.value != 0) == jumpIf) jump(target);
+            return;
+        }
+        if (e.kind == Expr::Unary && e.op == "!") return branch(*e.kids[0], !jumpIf, target);
+        if (e.kind == Expr::Binary) {
+            const Expr& l = *e.kids[0];
+            const Expr& r = *e.kids[1];
+            if (e.op == "==" || e.op == "!=") {
+                bool takeOnEqual = (e.op == "==") == jumpIf;
+                int a = expr(l);
+                int b = isSmall(r) ? -1 : expr(r);
+                if (takeOnEqual) {
+                    jumpEq(a, b, (int32_t)r.value, target);
+                } else {
+                    int skip = newLabel();
+                    jumpEq(a, b, (int32_t)r.value, skip);
+                    jump(target);
+                    label(skip);
+                }
+                return;
+            }
+            if (e.op == "<" || e.op == "<=" || e.op == ">" || e.op == ">=") {
+                // SLT gives 0 or 1, so either outcome is one compare
+                int t = lessThan(e);
+                bool whenSet = e.op == "<" || e.op == ">";
+                jumpEq(t, -1, whenSet == jumpIf ? 1 : 0, target);
+                return;
+            }
+            if (e.op == "&&" || e.op == "||") {
+                bool isAnd = e.op == "&&";
+                if (isAnd != jumpIf) {  // either operand decides
+                    branch(l, jumpIf, target);
+                    branch(r, jumpIf, target);
+                } else {
+                    int skip = newLabel();
+                    branch(l, !jumpIf, skip);
+                    branch(r, jumpIf, target);
+                    label(skip);
+                }
+                return;
+            }
+        }
+        int v = expr(e);
+        if (jumpIf) {
+            int skip = newLabel();
+            jumpEq(v, -1, 0, skip);
+            jump(target);
+            label(skip);
+        } else {
+            jumpEq(v, -1, 0, target);
+        }
+    }
+
+    // SLT for a relational operator: l < r for < and >=, r < l for > and <=
+    int lessThan(const Expr& e) {
+        bool swapped = e.op == ">" || e.op == "<=";
+        int a = expr(*e.kids[0]);
+        int b = expr(*e.kids[1]);
+        int t = newReg();
+        emit({Op::Slt, t, swapped ? b : a, swapped ? a : b});
+        return t;
+    }
+
+    int constant(int64_t value) {
+        int v = newReg();
+        emit({Op::Const, v, -1, -1, (int32_t)(uint32_t)value});
+        return v;
+    }
+
+    int expr(const Expr& e) {
+        switch (e.kind) {
+        case Expr::Num: return constant(e.value);
+        case Expr::Var: return lookup(e.op, e.line);
+        case Expr::Call: return call(e);
+        case Expr::Unary:
+            if (e.op == "-") {
+                int zero = constant(0);
+                int v = expr(*e.kids[0]);
+                int d = newReg();
+                emit({Op::Sub, d, zero, v});
+                return d;
+            }
+            break;  // "!" is a condition
+        case Expr::Binary: {
+            const Expr& l = *e.kids[0];
+            const Expr& r = *e.kids[1];
+            int shift;
+            if (e.op == "+" || e.op == "-" || e.op == "*") {
+                if (e.op == "-" && r.kind == Expr::Num && r.value == 1) {
+                    int d = newReg();
+                    emit({Op::Dec, d, expr(l)});
+                    return d;
+                }
+                int a = expr(l);
+                int b = expr(r);
+                int d = newReg();
+                emit({e.op == "+" ? Op::Add : e.op == "-" ? Op::Sub : Op::Mul, d, a, b});
+                return d;
+            }
+            if (e.op == "/" || e.op == "%") {
+                if (!powerOfTwo(r, shift) || shift > 30) {
+                    throw CompileError(e.line, "'" + e.op + "' needs a power-of-two constant divisor: the ISA has no divide");
+                }
+                int d = newReg();
+                emit({e.op == "/" ? Op::Div : Op::Rem, d, expr(l), -1, shift});
+                return d;
+            }
+            if (e.op == "<" || e.op == ">") return lessThan(e);
+            if (e.op == "<=" || e.op == ">=") {
+                int t = lessThan(e);
+                int one = constant(1);
+                int d = newReg();
+                emit({Op::Sub, d, one, t});
+                return d;
+            }
+            break;  // == != && || are conditions
+        }
+        }
+        // Boolean value of a condition: d = 1; if (e) skip; d = 0, or the
+        // other way round when that branch is cheaper
+        bool jumpIf = cheapBranch(e, true);
+        int d = newReg();
+        int done = newLabel();
+        emit({Op::Const, d, -1, -1, jumpIf ? 1 : 0});
+        branch(e, jumpIf, done);
+        emit({Op::Const, d, -1, -1, jumpIf ? 0 : 1});
+        label(done);
+        return d;
+    }
+
+    int call(const Expr& e) {
+        auto it = functions.find(e.op);
+        if (it == functions.end()) throw CompileError(e.line, "call to undeclared function '" + e.op + "'");
+        if (it->second->params.size() != e.kids.size()) {
+            throw CompileError(e.line, "'" + e.op + "' expects " + std::to_string(it->second->params.size()) + " argument(s)");
+        }
+        Instr c{Op::Call};
+        c.imm = ir.calls++;
+        emit({Op::ArgStart, -1, -1, -1, c.imm});  // saves for values live across the call go here
+        c.callee = e.op;
+        for (const auto& arg : e.kids) c.args.push_back(expr(*arg));
+        c.dst = it->second->returnsInt ? newReg() : -1;
+        int d = c.dst;
+        emit(std::move(c));
+        if (d < 0) d = constant(0);  // a void result used as a value
+        return d;
+    }
+
+    void assign(int target, const Stmt& s) {
+        if (s.op == "++" || s.op == "--") {
+            if (s.op == "--") {
+                emit({Op::Dec, target, target});
+            } else {
+                emit({Op::Add, target, target, constant(1)});
+            }
+            return;
+        }
+        if (s.op == "=") {
+            emit({Op::Copy, target, expr(*s.expr)});
+            return;
+        }
+        if (s.op == "-=" && s.expr->kind == Expr::Num && s.expr->value == 1) {
+            emit({Op::Dec, target, target});
+            return;
+        }
+        int v = expr(*s.expr);  // target op= e  ==>  target = target op e
+        emit({s.op == "+=" ? Op::Add : s.op == "-=" ? Op::Sub : Op::Mul, target, target, v});
+    }
+
+    void statement(const Stmt& s) {
+        switch (s.kind) {
+        case Stmt::Block:
+            scopes.emplace_back();
+            for (const auto& child : s.body) {
+                statement(*child);
+                if (!fallsThrough()) break;  // the rest is unreachable
+            }
+            scopes.pop_back();
+            break;
+        case Stmt::Decl: {
+            int v = newReg();
+            if (s.expr) emit({Op::Copy, v, expr(*s.expr)});
+            else emit({Op::Const, v, -1, -1, 0});
+            scopes.back()[s.name] = v;
+            break;
+        }
+        case Stmt::Assign:
+            assign(lookup(s.name, s.line), s);
+            break;
+        case Stmt::ExprStmt:
+            expr(*s.expr);
+            break;
+        case Stmt::If: {
+            const Stmt& then = *s.body[0];
+            const Stmt* otherwise = s.body.size() > 1 ? s.body[1].get() : nullptr;
+            int end = newLabel();
+            if (cheapBranch(*s.expr, false)) {
+                int elseLabel = otherwise ? newLabel() : end;
+                branch(*s.expr, false, elseLabel);
+                statement(then);
+                if (otherwise) {
+                    if (fallsThrough()) jump(end);
+                    label(elseLabel);
+                    statement(*otherwise);
+                }
+            } else if (!otherwise && alwaysReturns(then)) {
+                int thenLabel = newLabel();  // taken path goes out of line
+                branch(*s.expr, true, thenLabel);
+                deferred.push_back({thenLabel, &then, scopes, loops});
+            } else {
+                int thenLabel = newLabel();
+                branch(*s.expr, true, thenLabel);
+                if (otherwise) statement(*otherwise);
+                if (fallsThrough()) jump(end);
+                label(thenLabel);
+                statement(then);
+            }
+            label(end);
+            break;
+        }
+        case Stmt::While:
+        case Stmt::For: {
+            // Rotated: the test sits at the bottom and branches back
+            bool isFor = s.kind == Stmt::For;
+            scopes.emplace_back();
+            if (isFor && s.body[0]) statement(*s.body[0]);
+            int body = newLabel(), test = newLabel(), step = isFor ? newLabel() : test, end = newLabel();
+            jump(test);
+            label(body);
+            loops.push_back({step, end});
+            statement(*s.body[isFor ? 2 : 0]);
+            loops.pop_back();
+            if (isFor) {
+                label(step);
+                if (s.body[1]) statement(*s.body[1]);
+            }
+            label(test);
+            if (s.expr) branch(*s.expr, true, body);
+            else jump(body);
+            label(end);
+            scopes.pop_back();
+            break;
+        }
+        case Stmt::Return:
+            if (s.expr && !returnsInt) throw CompileError(s.line, "return with a value in a void function");
+            if (s.expr && tailRecursion(*s.expr)) break;
+            if (s.expr && accumulator >= 0) {
+                const Expr& e = *s.expr;
+                int32_t identity = accumulateOp == Op::Mul ? 1 : 0;
+                int v = accumulator;
+                if (e.kind != Expr::Num || e.value != identity) {
+                    v = newReg();
+                    emit({accumulateOp, v, accumulator, expr(e)});
+                }
+                emit({Op::Ret, -1, v});
+                break;
+            }
+            emit({Op::Ret, -1, s.expr ? expr(*s.expr) : -1});
+            break;
+        case Stmt::Break:
+        case Stmt::Continue:
+            if (loops.empty()) throw CompileError(s.line, "break or continue outside a loop");
+            jump(s.kind == Stmt::Break ? loops.back().second : loops.back().first);
+            break;
+        }
+    }
+};
+
+//--------------------------------------
+// SSA optimization
+//--------------------------------------
+// The IR is split into basic blocks and put into pruned SSA form (phis at
+// the iterated dominance frontier of each variable's definitions wherever
+// it is live, then renaming down the dominator tree). The passes below run
+// on that form and return how many instructions they changed, and the
+// result goes back to linear IR through one fresh temporary per phi: each
+// predecessor copies its operand into the temporary at its end and the
+// block copies the temporary into the phi's register at its start. The
+// temporaries are written nowhere else, so no edge needs splitting and
+// phis that swap values stay correct. The allocator's copy hints usually
+// put both ends of those copies in one register.
+struct Block {
+    std::vector<Instr> code;  // [Label] phis... body... [Jump | JumpEq | Ret]
+    std::vector<int> preds, succs;
+    bool dead = false;
+};
+
+struct SsaFunction {
+    IrFunction& ir;  // vreg and label counters; code is empty while in SSA form
+    std::vector<Block> blocks = {};
+    std::vector<int> idom = {};  // immediate dominator by block; -1 if unreachable
+    std::vector<int> rpo = {};   // reachable blocks in reverse postorder
+};
+
+static bool isTerminator(Op op) { return op == Op::Jump || op == Op::JumpEq || op == Op::Ret; }
+
+static void buildEdges(SsaFunction& s) {
+    std::vector<int> blockOf(s.ir.labels, -1);
+    for (size_t b = 0; b < s.blocks.size(); b++) {
+        const Block& block = s.blocks[b];
+        if (!block.dead && !block.code.empty() && block.code[0].op == Op::Label) blockOf[block.code[0].label] = (int)b;
+    }
+    for (Block& block : s.blocks) {
+        block.preds.clear();
+        block.succs.clear();
+    }
+    for (size_t b = 0; b < s.blocks.size(); b++) {
+        Block& block = s.blocks[b];
+        if (block.dead) continue;
+        auto add = [&](int to) {
+            if (to >= 0 && std::find(block.succs.begin(), block.succs.end(), to) == block.succs.end()) {
+                block.succs.push_back(to);
+                s.blocks[to].preds.push_back((int)b);
+            }
+        };
+        const Instr* last = block.code.empty() ? nullptr : &block.code.back();
+        if (last && (last->op == Op::Jump || last->op == Op::JumpEq)) add(blockOf[last->label]);
+        if (!last || (last->op != Op::Jump && last->op != Op::Ret)) {
+            size_t next = b + 1;
+            while (next < s.blocks.size() && s.blocks[next].dead) next++;
+            if (next < s.blocks.size()) add((int)next);
+        }
+    }
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm over reverse postorder
+static void computeDominators(SsaFunction& s) {
+    size_t n = s.blocks.size();
+    std::vector<int> post, index(n, -1);
+    std::vector<std::pair<int, size_t>> stack{{0, 0}};
+    std::vector<bool> seen(n);
+    seen[0] = true;
+    while (!stack.empty()) {
+        auto& [b, next] = stack.back();
+        if (next < s.blocks[b].succs.size()) {
+            int to = s.blocks[b].succs[next++];
+            if (!seen[to]) {
+                seen[to] = true;
+                stack.push_back({to, 0});
+            }
+        } else {
+            post.push_back(b);
+            stack.pop_back();
+        }
+    }
+    s.rpo.assign(post.rbegin(), post.rend());
+    for (size_t k = 0; k < s.rpo.size(); k++) index[s.rpo[k]] = (int)k;
+    s.idom.assign(n, -1);
+    s.idom[0] = 0;
+    auto intersect = [&](int a, int b) {
+        while (a != b) {
+            while (index[a] > index[b]) a = s.idom[a];
+            while (index[b] > index[a]) b = s.idom[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t k = 1; k < s.rpo.size(); k++) {
+            int b = s.rpo[k], idom = -1;
+            for (int p : s.blocks[b].preds) {
+                if (s.idom[p] < 0) continue;
+                idom = idom < 0 ? p : intersect(p, idom);
+            }
+            if (idom != s.idom[b]) {
+                s.idom[b] = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+static bool dominates(const SsaFunction& s, int a, int b) {
+    for (;;) {
+        if (a == b) return true;
+        if (b == 0 || s.idom[b] < 0) return false;
+        b = s.idom[b];
+    }
+}
+
+static std::vector<std::vector<int>> dominatorTree(const SsaFunction& s) {
+    std::vector<std::vector<int>> children(s.blocks.size());
+    for (int b : s.rpo) {
+        if (b != 0) children[s.idom[b]].push_back(b);
+    }
+    return children;
+}
+
+// Mark blocks no longer reachable from the entry dead and drop the phi
+// operands of edges that went away
+static void removeDeadBlocks(SsaFunction& s) {
+    buildEdges(s);
+    std::vector<bool> reached(s.blocks.size());
+    std::vector<int> work{0};
+    reached[0] = true;
+    while (!work.empty()) {
+        int b = work.back();
+        work.pop_back();
+        for (int to : s.blocks[b].succs) {
+            if (!reached[to]) {
+                reached[to] = true;
+                work.push_back(to);
+            }
+        }
+    }
+    for (size_t b = 0; b < s.blocks.size(); b++) {
+        if (!reached[b] && !s.blocks[b].dead) {
+            s.blocks[b].dead = true;
+            s.blocks[b].code.clear();
+        }
+    }
+    buildEdges(s);
+    for (Block& block : s.blocks) {
+        for (Instr& in : block.code) {
+            if (in.op != Op::Phi) continue;
+            for (size_t k = in.from.size(); k-- > 0;) {
+                if (std::find(block.preds.begin(), block.preds.end(), in.from[k]) == block.preds.end()) {
+                    in.from.erase(in.from.begin() + k);
+                    in.args.erase(in.args.begin() + k);
+                }
+            }
+        }
+    }
+    computeDominators(s);
+}
+
+static SsaFunction enterSsa(IrFunction& f) {
+    SsaFunction s{f};
+    // Block 0 holds the parameters, so the entry has no predecessors
+    s.blocks.emplace_back();
+    size_t i = 0;
+    for (; i < f.code.size() && f.code[i].op == Op::Param; i++) s.blocks[0].code.push_back(std::move(f.code[i]));
+    bool open = false;
+    for (; i < f.code.size(); i++) {
+        Instr& in = f.code[i];
+        if (!open || (in.op == Op::Label && !s.blocks.back().code.empty())) s.blocks.emplace_back();
+        open = !isTerminator(in.op);
+        s.blocks.back().code.push_back(std::move(in));
+    }
+    f.code.clear();
+    buildEdges(s);
+    computeDominators(s);
+    size_t n = s.blocks.size();
+    int vars = f.vregs;
+
+    // Variables live into each block, before renaming
+    std::vector<std::vector<bool>> liveIn(n, std::vector<bool>(vars));
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t b = n; b-- > 0;) {
+            std::vector<bool> live(vars);
+            for (int to : s.blocks[b].succs) {
+                for (int v = 0; v < vars; v++) live[v] = live[v] || liveIn[to][v];
+            }
+            for (auto in = s.blocks[b].code.rbegin(); in != s.blocks[b].code.rend(); ++in) {
+                if (defOf(*in) >= 0) live[defOf(*in)] = false;
+                forEachUse(*in, [&](int v) { live[v] = true; });
+            }
+            if (live != liveIn[b]) {
+                liveIn[b] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+
+    // Dominance frontiers, then phis where a variable is live
+    std::vector<std::set<int>> frontier(n);
+    for (int b : s.rpo) {
+        if (s.blocks[b].preds.size() < 2) continue;
+        for (int p : s.blocks[b].preds) {
+            for (int runner = p; runner != s.idom[b]; runner = s.idom[runner]) frontier[runner].insert(b);
+        }
+    }
+    std::vector<std::vector<int>> defBlocks(vars);
+    for (size_t b = 0; b < n; b++) {
+        for (const Instr& in : s.blocks[b].code) {
+            if (defOf(in) >= 0) defBlocks[defOf(in)].push_back((int)b);
+        }
+    }
+    std::vector<std::vector<int>> phis(n);  // variables
+    for (int v = 0; v < vars; v++) {
+        std::vector<bool> hasPhi(n), queued(n);
+        std::vector<int> work = defBlocks[v];
+        for (int b : work) queued[b] = true;
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            for (int y : frontier[b]) {
+                if (hasPhi[y] || !liveIn[y][v]) continue;
+                hasPhi[y] = true;
+                phis[y].push_back(v);
+                if (!queued[y]) {
+                    queued[y] = true;
+                    work.push_back(y);
+                }
+            }
+        }
+    }
+    for (size_t b = 0; b < n; b++) {
+        std::vector<Instr>& code = s.blocks[b].code;
+        size_t at = !code.empty() && code[0].op == Op::Label ? 1 : 0;
+        for (int v : phis[b]) {
+            Instr phi{Op::Phi, v, v};  // a: the variable, until renamed
+            phi.from = s.blocks[b].preds;
+            phi.args.assign(phi.from.size(), -1);
+            code.insert(code.begin() + at++, std::move(phi));
+        }
+    }
+
+    // Renaming
+    std::vector<std::vector<int>> current(vars);
+    int undefined = f.vregs++;  // read before any definition
+    bool readUndefined = false;
+    auto valueOf = [&](int v) {
+        if (!current[v].empty()) return current[v].back();
+        readUndefined = true;
+        return undefined;
+    };
+    std::vector<std::vector<int>> children = dominatorTree(s);
+    std::function<void(int)> rename = [&](int b) {
+        std::vector<int> pushed;
+        for (Instr& in : s.blocks[b].code) {
+            if (in.op != Op::Phi) forEachUse(in, [&](int& v) { v = valueOf(v); });
+            int d = defOf(in);
+            if (d >= 0) {
+                in.dst = f.vregs++;
+                current[d].push_back(in.dst);
+                pushed.push_back(d);
+            }
+        }
+        for (int to : s.blocks[b].succs) {
+            for (Instr& phi : s.blocks[to].code) {
+                if (phi.op != Op::Phi) continue;
+                for (size_t k = 0; k < phi.from.size(); k++) {
+                    if (phi.from[k] == b) phi.args[k] = valueOf(phi.a);
+                }
+            }
+        }
+        for (int c : children[b]) rename(c);
+        for (int d : pushed) current[d].pop_back();
+    };
+    rename(0);
+    if (readUndefined) s.blocks[0].code.push_back({Op::Const, undefined, -1, -1, 0});
+    for (Block& block : s.blocks) {
+        for (Instr& in : block.code) {
+            if (in.op == Op::Phi) in.a = -1;
+        }
+    }
+    return s;
+}
+
+static void leaveSsa(SsaFunction& s) {
+    IrFunction& f = s.ir;
+    std::vector<std::vector<Instr>> tails(s.blocks.size());
+    for (Block& block : s.blocks) {
+        for (Instr& in : block.code) {
+            if (in.op != Op::Phi) continue;
+            int t = f.vregs++;
+            for (size_t k = 0; k < in.args.size(); k++) tails[in.from[k]].push_back({Op::Copy, t, in.args[k]});
+            in = {Op::Copy, in.dst, t};
+        }
+    }
+    f.code.clear();
+    for (size_t b = 0; b < s.blocks.size(); b++) {
+        std::vector<Instr>& code = s.blocks[b].code;
+        bool terminated = !code.empty() && isTerminator(code.back().op);
+        for (size_t i = 0; i + (terminated ? 1 : 0) < code.size(); i++) f.code.push_back(std::move(code[i]));
+        for (Instr& copy : tails[b]) f.code.push_back(std::move(copy));
+        if (terminated) f.code.push_back(std::move(code.back()));
+    }
+    s.blocks.clear();
+}
+
+// Instructions that become machine code
+static size_t countInstructions(const std::vector<Instr>& code) {
+    return std::count_if(code.begin(), code.end(), [](const Instr& in) {
+        return in.op != Op::Label && in.op != Op::Param && in.op != Op::ArgStart && in.op != Op::Phi;
+    });
+}
+
+static size_t countInstructions(const SsaFunction& s) {
+    size_t count = 0;
+    for (const Block& block : s.blocks) count += countInstructions(block.code);
+    return count;
+}
+
+// Rewrites every use through `replacement` (-1: unchanged), following chains
+static void replaceUses(SsaFunction& s, const std::vector<int>& replacement) {
+    auto resolve = [&](int v) {
+        while (v >= 0 && v < (int)replacement.size() && replacement[v] >= 0) v = replacement[v];
+        return v;
+    };
+    for (Block& block : s.blocks) {
+        for (Instr& in : block.code) forEachUse(in, [&](int& v) { v = resolve(v); });
+    }
+}
+
+// Constant folding and propagation, copy propagation, algebraic identities
+// and branches on constants, repeated until nothing changes. Constants
+// that fit CMP's signed 16-bit immediate are folded into JumpEq.
+static size_t foldConstants(SsaFunction& s) {
+    size_t changed = 0;
+    for (bool again = true; again;) {
+        again = false;
+        bool branchesChanged = false;
+        std::vector<int> replacement(s.ir.vregs, -1);
+        std::vector<bool> known(s.ir.vregs);
+        std::vector<uint32_t> value(s.ir.vregs);
+        for (const Block& block : s.blocks) {
+            for (const Instr& in : block.code) {
+                if (in.op == Op::Const) {
+                    known[in.dst] = true;
+                    value[in.dst] = (uint32_t)in.imm;
+                }
+            }
+        }
+        auto resolve = [&](int v) {
+            while (replacement[v] >= 0) v = replacement[v];
+            return v;
+        };
+        for (int b : s.rpo) {
+            std::vector<Instr> code;
+            for (Instr& in : s.blocks[b].code) {
+                forEachUse(in, [&](int& v) { v = resolve(v); });
+                auto makeConst = [&](uint32_t c) {
+                    in = {Op::Const, in.dst, -1, -1, (int32_t)c};
+                    known[in.dst] = true;
+                    value[in.dst] = c;
+                    changed++;
+                    again = true;
+                };
+                auto replaceWith = [&](int v) {
+                    replacement[in.dst] = v;
+                    if (known[v]) {
+                        known[in.dst] = true;
+                        value[in.dst] = value[v];
+                    }
+                    changed++;
+                    again = true;
+                };
+                bool ka = in.a >= 0 && known[in.a], kb = in.b >= 0 && known[in.b];
+                uint32_t a = ka ? value[in.a] : 0, c = kb ? value[in.b] : 0;
+                switch (in.op) {
+                case Op::Copy:
+                    replaceWith(in.a);
+                    continue;
+                case Op::Phi: {
+                    int same = -1;
+                    bool unique = true, constant = true;
+                    for (int v : in.args) {
+                        if (v == in.dst) continue;
+                        if (same < 0) same = v;
+                        unique = unique && v == same;
+                        constant = constant && known[v] && known[same] && value[v] == value[same];
+                    }
+                    if (same >= 0 && unique) {
+                        replaceWith(same);
+                        continue;
+                    }
+                    if (same >= 0 && constant) makeConst(value[same]);
+                    break;
+                }
+                case Op::Add:
+                    if (ka && kb) makeConst(a + c);
+                    else if (ka && a == 0) { replaceWith(in.b); continue; }
+                    else if (kb && c == 0) { replaceWith(in.a); continue; }
+                    break;
+                case Op::Sub:
+                    if (ka && kb) makeConst(a - c);
+                    else if (kb && c == 0) { replaceWith(in.a); continue; }
+                    else if (in.a == in.b) makeConst(0);
+                    break;
+                case Op::Mul:
+                    if (ka && kb) makeConst(a * c);
+                    else if ((ka && a == 0) || (kb && c == 0)) makeConst(0);
+                    else if (ka && a == 1) { replaceWith(in.b); continue; }
+                    else if (kb && c == 1) { replaceWith(in.a); continue; }
+                    break;
+                case Op::Slt:
+                    if (ka && kb) makeConst((int32_t)a < (int32_t)c);
+                    else if (in.a == in.b) makeConst(0);
+                    break;
+                case Op::Dec:
+                    if (ka) makeConst(a - 1);
+                    break;
+                case Op::Shl:
+                case Op::Srl:
+                    if (ka) makeConst(in.op == Op::Shl ? a << in.imm : a >> in.imm);
+                    else if (in.imm == 0) { replaceWith(in.a); continue; }
+                    break;
+                case Op::Div:
+                case Op::Rem:
+                    if (ka) {
+                        int32_t x = (int32_t)a, d = (int32_t)1 << in.imm;
+                        makeConst((uint32_t)(in.op == Op::Div ? x / d : x % d));
+                    } else if (in.imm == 0) {
+                        if (in.op == Op::Div) { replaceWith(in.a); continue; }
+                        makeConst(0);
+                    }
+                    break;
+                case Op::JumpEq: {
+                    if (in.b >= 0 && ka && !kb) {
+                        std::swap(in.a, in.b);
+                        std::swap(ka, kb);
+                        std::swap(a, c);
+                    }
+                    if (in.b >= 0 && kb && (int32_t)c >= -32768 && (int32_t)c <= 32767) {
+                        in.imm = (int32_t)c;
+                        in.b = -1;
+                        changed++;
+                        again = true;
+                    }
+                    bool decided = in.a == in.b || (ka && (in.b < 0 || kb));
+                    if (!decided) break;
+                    bool taken = in.a == in.b || a == (in.b < 0 ? (uint32_t)in.imm : c);
+                    changed++;
+                    again = branchesChanged = true;
+                    if (!taken) continue;
+                    in = {Op::Jump, -1, -1, -1, 0, in.label};
+                    break;
+                }
+                default:
+                    break;
+                }
+                code.push_back(std::move(in));
+            }
+            s.blocks[b].code = std::move(code);
+        }
+        replaceUses(s, replacement);
+        if (branchesChanged) removeDeadBlocks(s);
+    }
+    return changed;
+}
+
+// Mark and sweep from the instructions with effects
+static size_t eliminateDeadCode(SsaFunction& s) {
+    std::vector<const Instr*> def(s.ir.vregs, nullptr);
+    std::vector<bool> needed(s.ir.vregs);
+    std::vector<int> work;
+    auto need = [&](int v) {
+        if (!needed[v]) {
+            needed[v] = true;
+            work.push_back(v);
+        }
+    };
+    for (const Block& block : s.blocks) {
+        for (const Instr& in : block.code) {
+            if (defOf(in) >= 0) def[defOf(in)] = &in;
+            if (!isPure(in.op)) forEachUse(in, need);
+        }
+    }
+    while (!work.empty()) {
+        int v = work.back();
+        work.pop_back();
+        if (def[v]) forEachUse(*def[v], need);
+    }
+    size_t removed = 0;
+    for (Block& block : s.blocks) {
+        auto dead = [&](const Instr& in) { return isPure(in.op) && !needed[in.dst]; };
+        removed += std::count_if(block.code.begin(), block.code.end(), dead);
+        block.code.erase(std::remove_if(block.code.begin(), block.code.end(), dead), block.code.end());
+    }
+    return removed;
+}
+
+// Dominator-scoped value numbering of pure instructions. Constants are left
+// alone: rematerializing one costs the same single instruction as a move,
+// and sharing it would tie up a register. Constant operands are compared
+// by value, so x + 1 matches x + 1 whichever LI produced the 1.
+static size_t eliminateCommonSubexpressions(SsaFunction& s) {
+    using Key = std::tuple<Op, int64_t, int64_t, int32_t>;
+    std::vector<bool> known(s.ir.vregs);
+    std::vector<int32_t> value(s.ir.vregs);
+    for (const Block& block : s.blocks) {
+        for (const Instr& in : block.code) {
+            if (in.op == Op::Const) {
+                known[in.dst] = true;
+                value[in.dst] = in.imm;
+            }
+        }
+    }
+    auto operand = [&](int v) -> int64_t { return v >= 0 && known[v] ? (int64_t(1) << 40) + value[v] : v; };
+    std::map<Key, int> available;
+    std::vector<int> replacement(s.ir.vregs, -1);
+    size_t removed = 0;
+    std::vector<std::vector<int>> children = dominatorTree(s);
+    std::function<void(int)> visit = [&](int b) {
+        std::vector<Key> added;
+        std::vector<Instr> code;
+        for (Instr& in : s.blocks[b].code) {
+            forEachUse(in, [&](int& v) {
+                while (replacement[v] >= 0) v = replacement[v];
+            });
+            if (!isPure(in.op) || in.op == Op::Const || in.op == Op::Phi || in.op == Op::Copy) {
+                code.push_back(std::move(in));
+                continue;
+            }
+            int64_t x = operand(in.a), y = operand(in.b);
+            if ((in.op == Op::Add || in.op == Op::Mul) && y < x) std::swap(x, y);
+            Key key{in.op, x, y, in.imm};
+            auto found = available.find(key);
+            if (found != available.end()) {
+                replacement[in.dst] = found->second;
+                removed++;
+                continue;
+            }
+            available[key] = in.dst;
+            added.push_back(key);
+            code.push_back(std::move(in));
+        }
+        s.blocks[b].code = std::move(code);
+        for (int c : children[b]) visit(c);
+        for (const Key& key : added) available.erase(key);
+    };
+    visit(0);
+    replaceUses(s, replacement);
+    return removed;
+}
+
+// Most values live at once anywhere in the given blocks: liveness over the
+// SSA form, with each phi operand live at the end of its predecessor
+static size_t maxPressure(const SsaFunction& s, const std::vector<int>& within) {
+    size_t n = s.blocks.size();
+    int vregs = s.ir.vregs;
+    std::vector<std::vector<bool>> liveIn(n, std::vector<bool>(vregs));
+    auto liveOut = [&](size_t b) {
+        std::vector<bool> live(vregs);
+        for (int to : s.blocks[b].succs) {
+            for (const Instr& in : s.blocks[to].code) {
+                if (in.op != Op::Phi) continue;
+                for (size_t k = 0; k < in.from.size(); k++) {
+                    if (in.from[k] == (int)b) live[in.args[k]] = true;
+                }
+            }
+            for (int v = 0; v < vregs; v++) live[v] = live[v] || liveIn[to][v];
+        }
+        return live;
+    };
+    // Walks b backwards from its live-out set; returns the live-in set
+    auto walk = [&](size_t b, size_t* most) {
+        std::vector<bool> live = liveOut(b);
+        size_t count = std::count(live.begin(), live.end(), true);
+        if (most) *most = std::max(*most, count);
+        const std::vector<Instr>& code = s.blocks[b].code;
+        for (auto in = code.rbegin(); in != code.rend(); ++in) {
+            int d = defOf(*in);
+            if (d >= 0 && live[d]) {
+                live[d] = false;
+                count--;
+            }
+            if (in->op != Op::Phi) {
+                forEachUse(*in, [&](int v) {
+                    if (!live[v]) {
+                        live[v] = true;
+                        count++;
+                    }
+                });
+            }
+            if (most) *most = std::max(*most, count + (d >= 0 && in->op != Op::Phi ? 1 : 0));
+        }
+        return live;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t b = n; b-- > 0;) {
+            if (s.blocks[b].dead) continue;
+            std::vector<bool> live = walk(b, nullptr);
+            if (live != liveIn[b]) {
+                liveIn[b] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+    size_t most = 0;
+    for (int b : within) walk(b, &most);
+    return most;
+}
+
+// Natural loops, innermost first; pure instructions whose operands are all
+// defined outside the loop move to the end of its preheader (the single
+// block outside that enters the header and has no other successor).
+// Nothing traps, so hoisting from code the loop might not run is safe.
+// Hoisted values stay live through the whole loop and nothing can be
+// spilled, so while the loop would need more than NUM_REGISTERS values,
+// hoisted constants go back into the loop, the last hoisted first (a copy
+// stays in the preheader if hoisted code uses it); if that is not enough,
+// the loop is left as it was.
+static size_t hoistLoopInvariants(SsaFunction& s) {
+    std::map<int, std::set<int>> loops;  // header -> body
+    for (int t : s.rpo) {
+        for (int h : s.blocks[t].succs) {
+            if (!dominates(s, h, t)) continue;
+            std::set<int>& body = loops[h];
+            body.insert(h);
+            std::vector<int> work;
+            if (body.insert(t).second) work.push_back(t);
+            while (!work.empty()) {
+                int b = work.back();
+                work.pop_back();
+                for (int p : s.blocks[b].preds) {
+                    if (body.insert(p).second) work.push_back(p);
+                }
+            }
+        }
+    }
+    std::vector<std::pair<int, std::set<int>>> order(loops.begin(), loops.end());
+    std::stable_sort(order.begin(), order.end(), [](const auto& x, const auto& y) { return x.second.size() < y.second.size(); });
+
+    std::vector<int> rpoIndex(s.blocks.size(), -1);
+    for (size_t k = 0; k < s.rpo.size(); k++) rpoIndex[s.rpo[k]] = (int)k;
+    size_t hoisted = 0;
+    for (auto& [header, body] : order) {
+        int preheader = -1, entries = 0;
+        for (int p : s.blocks[header].preds) {
+            if (!body.count(p)) {
+                preheader = p;
+                entries++;
+            }
+        }
+        if (entries != 1 || s.blocks[preheader].succs.size() != 1) continue;
+
+        std::vector<int> blocks(body.begin(), body.end());
+        std::sort(blocks.begin(), blocks.end(), [&](int x, int y) { return rpoIndex[x] < rpoIndex[y]; });
+        std::vector<bool> inLoop(s.ir.vregs);
+        for (int b : blocks) {
+            for (const Instr& in : s.blocks[b].code) {
+                if (defOf(in) >= 0) inLoop[defOf(in)] = true;
+            }
+        }
+        // Invariant instructions in an order where operands come first
+        std::vector<std::pair<int, size_t>> found;  // block, index
+        std::set<std::pair<int, size_t>> taken;
+        for (bool again = true; again;) {
+            again = false;
+            for (int b : blocks) {
+                const std::vector<Instr>& code = s.blocks[b].code;
+                for (size_t i = 0; i < code.size(); i++) {
+                    const Instr& in = code[i];
+                    if (!isPure(in.op) || in.op == Op::Phi || taken.count({b, i})) continue;
+                    bool invariant = true;
+                    forEachUse(in, [&](int v) { invariant = invariant && !inLoop[v]; });
+                    if (!invariant) continue;
+                    inLoop[in.dst] = false;
+                    found.push_back({b, i});
+                    taken.insert({b, i});
+                    again = true;
+                }
+            }
+        }
+        if (found.empty()) continue;
+
+        std::map<int, std::vector<Instr>> original;
+        for (int b : blocks) original[b] = s.blocks[b].code;
+        original[preheader] = s.blocks[preheader].code;
+        std::vector<int> measured = blocks;
+        measured.push_back(preheader);
+        // Hoist the instructions selected by `keep`; constants left behind
+        // that hoisted code reads are copied into the preheader
+        auto hoist = [&](const std::vector<bool>& keep) {
+            std::map<int, int> copyOf;
+            std::vector<Instr> moved;
+            std::set<std::pair<int, size_t>> gone;
+            for (size_t k = 0; k < found.size(); k++) {
+                if (!keep[k]) continue;
+                Instr in = original[found[k].first][found[k].second];
+                forEachUse(in, [&](int& v) {
+                    for (size_t c = 0; c < found.size(); c++) {
+                        const Instr& con = original[found[c].first][found[c].second];
+                        if (keep[c] || con.dst != v) continue;
+                        if (!copyOf.count(v)) {
+                            copyOf[v] = s.ir.vregs++;
+                            moved.push_back({Op::Const, copyOf[v], -1, -1, con.imm});
+                        }
+                        v = copyOf[v];
+                    }
+                });
+                moved.push_back(std::move(in));
+                gone.insert(found[k]);
+            }
+            for (auto& [b, code] : original) {
+                s.blocks[b].code.clear();
+                for (size_t i = 0; i < code.size(); i++) {
+                    if (!gone.count({b, i})) s.blocks[b].code.push_back(code[i]);
+                }
+            }
+            std::vector<Instr>& target = s.blocks[preheader].code;
+            auto at = !target.empty() && isTerminator(target.back().op) ? target.end() - 1 : target.end();
+            target.insert(at, moved.begin(), moved.end());
+            return moved.size();
+        };
+        std::vector<bool> keep(found.size(), true);
+        size_t count = hoist(keep);
+        for (size_t k = found.size(); k-- > 0 && maxPressure(s, measured) > NUM_REGISTERS;) {
+            if (original[found[k].first][found[k].second].op != Op::Const) continue;
+            keep[k] = false;
+            count = hoist(keep);
+        }
+        if (maxPressure(s, measured) > NUM_REGISTERS) {
+            for (auto& [b, code] : original) s.blocks[b].code = code;
+            continue;
+        }
+        hoisted += count;
+    }
+    return hoisted;
+}
+
+// Signed division by 2^k rounds toward zero. With f = 1 - 2 * (x < 0),
+// x * f is |x| (INT_MIN stays 2^31, read unsigned), so
+// x / 2^k = ((x * f) >> k) * f with a logical shift, and
+// x % 2^k = x - (x / 2^k << k).
+static void expandDivision(const Instr& in, int& vregs, std::vector<Instr>& out) {
+    int k = in.imm;
+    if (k == 0) {
+        out.push_back(in.op == Op::Div ? Instr{Op::Copy, in.dst, in.a} : Instr{Op::Const, in.dst});
+        return;
+    }
+    int sign = vregs++, twice = vregs++, one = vregs++, factor = vregs++, magnitude = vregs++, shifted = vregs++;
+    int quotient = in.op == Op::Div ? in.dst : vregs++;
+    out.push_back({Op::Srl, sign, in.a, -1, 31});
+    out.push_back({Op::Shl, twice, sign, -1, 1});
+    out.push_back({Op::Const, one, -1, -1, 1});
+    out.push_back({Op::Sub, factor, one, twice});
+    out.push_back({Op::Mul, magnitude, in.a, factor});
+    out.push_back({Op::Srl, shifted, magnitude, -1, k});
+    out.push_back({Op::Mul, quotient, shifted, factor});
+    if (in.op == Op::Rem) {
+        int back = vregs++;
+        out.push_back({Op::Shl, back, quotient, -1, k});
+        out.push_back({Op::Sub, in.dst, in.a, back});
+    }
+}
+
+static void expandDivisions(IrFunction& f) {
+    std::vector<Instr> code;
+    for (Instr& in : f.code) {
+        if (in.op == Op::Div || in.op == Op::Rem) expandDivision(in, f.vregs, code);
+        else code.push_back(std::move(in));
+    }
+    f.code = std::move(code);
+}
+
+// Multiplication by a power-of-two constant becomes SHL, and division by
+// one becomes the shift sequence above, so later passes see its parts.
+static size_t reduceStrength(SsaFunction& s) {
+    std::vector<bool> known(s.ir.vregs);
+    std::vector<uint32_t> value(s.ir.vregs);
+    for (const Block& block : s.blocks) {
+        for (const Instr& in : block.code) {
+            if (in.op == Op::Const) {
+                known[in.dst] = true;
+                value[in.dst] = (uint32_t)in.imm;
+            }
+        }
+    }
+    size_t changed = 0;
+    for (Block& block : s.blocks) {
+        std::vector<Instr> code;
+        for (Instr& in : block.code) {
+            if (in.op == Op::Div || in.op == Op::Rem) {
+                expandDivision(in, s.ir.vregs, code);
+                changed++;
+                continue;
+            }
+            if (in.op == Op::Mul) {
+                for (int k = 0; k < 2; k++) {
+                    int c = k ? in.a : in.b, x = k ? in.b : in.a;
+                    if (!known[c] || value[c] < 2 || (value[c] & (value[c] - 1)) != 0) continue;
+                    int shift = 0;
+                    while ((1u << shift) != value[c]) shift++;
+                    in = {Op::Shl, in.dst, x, -1, shift};
+                    changed++;
+                    break;
+                }
+            }
+            code.push_back(std::move(in));
+        }
+        block.code = std::move(code);
+    }
+    return changed;
+}
+
+struct Pass {
+    const char* name;
+    int level;  // lowest -O level that runs it
+    size_t (*run)(SsaFunction&);
+};
+
+static const Pass PASSES[] = {
+    {"constant folding", 1, foldConstants},
+    {"strength reduction", 1, reduceStrength},
+    {"common subexpressions", 2, eliminateCommonSubexpressions},
+    {"loop-invariant motion", 2, hoistLoopInvariants},
+    {"constant folding", 2, foldConstants},
+    {"dead code", 1, eliminateDeadCode},
+};
+const size_t PASS_COUNT = sizeof(PASSES) / sizeof(PASSES[0]);
+
+// Instruction counts summed over the functions of a translation unit
+struct OptimizationReport {
+    struct Row {
+        std::string pass;
+        size_t instructions = 0, changed = 0;
+    };
+    struct Stalls {
+        std::string function;
+        size_t before = 0, after = 0;  // estimated stall cycles around scheduling
+    };
+    int level = MAX_OPT_LEVEL;
+    std::vector<Row> rows;  // "lowered", the passes in order, "emitted"
+    std::vector<std::string> notes;
+    std::string target;     // pipeline model the stalls are estimated for
+    std::vector<Stalls> stalls;
+    size_t inlineSites = 0, inlined = 0, inlineGrowth = 0, inlineBudget = 0;
+
+    void add(size_t row, const std::string& pass, size_t instructions, size_t changed = 0) {
+        if (rows.size() <= row) rows.resize(row + 1);
+        rows[row].pass = pass;
+        rows[row].instructions += instructions;
+        rows[row].changed += changed;
+    }
+};
+
+// Lowered IR -> IR ready for register allocation at the given level. A
+// pass above the level still gets a report row, unchanged, so the rows of
+// functions compiled at different levels add up.
+static void optimize(IrFunction& f, int level, OptimizationReport* report) {
+    size_t count = countInstructions(f.code);
+    if (report) report->add(0, "lowered", count);
+    if (level > 0) {
+        SsaFunction s = enterSsa(f);
+        for (size_t p = 0; p < PASS_COUNT; p++) {
+            size_t changed = 0;
+            if (PASSES[p].level <= level) {
+                changed = PASSES[p].run(s);
+                count = countInstructions(s);
+            }
+            if (report) report->add(1 + p, PASSES[p].name, count, changed);
+        }
+        leaveSsa(s);
+    } else if (report) {
+        for (size_t p = 0; p < PASS_COUNT; p++) report->add(1 + p, PASSES[p].name, count);
+    }
+    expandDivisions(f);
+}
+
+//--------------------------------------
+// Inlining
+//--------------------------------------
+// Runs on lowered IR at -O2, bottom-up over the call graph, so a callee's
+// own calls are already flattened when it is copied into its callers. For
+// a site calling a function with n arguments:
+//   overhead = CALL, RET, n argument moves, the result move and a
+//              save/restore pair = 5 + n instructions
+//   growth   = callee size - overhead
+// The site is inlined if growth <= 0, or if frequency * overhead >= growth
+// and the unit's total growth stays within INLINE_BUDGET percent of its
+// lowered size (plus INLINE_SLACK). Frequency is LOOP_WEIGHT to the power of
+// the site's loop depth or, given a profile (the linker's --profile-out
+// file), the callee's recorded calls spread over its static call sites.
+// A call into the caller's own recursive cycle is inlined RECURSIVE_UNROLL
+// levels deep at most, which unrolls the recursion that many times.
+const int INLINE_LEVEL = 2;
+const double LOOP_WEIGHT = 8;
+const size_t INLINE_BUDGET = 50;
+const size_t INLINE_SLACK = 32;
+const int RECURSIVE_UNROLL = 1;
+const int MAX_INLINE_DEPTH = 4;  // inlined into an inlined body into ...
+
+bool InlineProfile::read(const std::string& path, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot open";
+        return false;
+    }
     std::string line;
+    for (size_t n = 1; std::getline(in, line); n++) {
+        std::istringstream record(line);
+        std::string kind, name;
+        uint64_t count;
+        if (!(record >> kind) || kind != "call") continue;
+        if (!(record >> name >> count)) {
+            error = "malformed record " + std::to_string(n);
+            return false;
+        }
+        calls[name] += count;
+    }
+    return true;
+}
+
+struct InlineStats {
+    size_t sites = 0, inlined = 0;  // calls considered (to functions with a body here)
+    size_t growth = 0, budget = 0;  // instructions
+};
 
-    while (std::getline(stream, line)) {
-        // Dummy translation for the example: 
-        // Just converting the assembly instructions to binary codes (simplified).
-        std::cout<<"THIS IS FROM HLL_ASM!!!!!!!!!____NOT ASM_BIN!!!!";
-        if (line == "MOV R0, 0") binary_code += "0000000000000001\n"; // MOV
-        else if (line == "CMP R0, 0") binary_code += "0000000000000010\n"; // CMP
-        else if (line == "JE factorial_base_case") binary_code += "0000000000000011\n"; // JE
-        else if (line == "PUSH R0") binary_code += "0000000000000100\n"; // PUSH
-        else if (line == "DEC R0") binary_code += "0000000000000101\n"; // DEC
-        else if (line == "CALL factorial") binary_code += "0000000000000110\n"; // CALL
-        else if (line == "POP R1") binary_code += "0000000000000111\n"; // POP
-        else if (line == "MUL R0, R0, R1") binary_code += "0000000000001000\n"; // MUL
-        else if (line == "JMP factorial_end") binary_code += "0000000000001001\n"; // JMP
-        else if (line == "MOV R0, 1") binary_code += "0000000000001010\n"; // MOV base case
-        std::cout<<"THIS IS FROM HLL_ASM!!!!!!!!!____NOT ASM_BIN!!!!";
+// Loop nesting depth of each instruction, from the backward branches
+static std::vector<int> loopDepths(const IrFunction& f) {
+    std::vector<size_t> labelAt(f.labels, f.code.size());
+    for (size_t i = 0; i < f.code.size(); i++) {
+        if (f.code[i].op == Op::Label) labelAt[f.code[i].label] = i;
     }
+    std::vector<int> delta(f.code.size() + 1, 0);
+    for (size_t j = 0; j < f.code.size(); j++) {
+        const Instr& in = f.code[j];
+        if ((in.op == Op::Jump || in.op == Op::JumpEq) && labelAt[in.label] <= j) {
+            delta[labelAt[in.label]]++;
+            delta[j + 1]--;
+        }
+    }
+    std::vector<int> depth(f.code.size());
+    for (size_t i = 0, d = 0; i < f.code.size(); i++) depth[i] = d += delta[i];
+    return depth;
+}
 
-    return binary_code;
+// Replace the call at `site` with a copy of `callee`: parameters become
+// copies of the arguments and each return a copy to the result and a jump
+// past the body. The callee's calls get fresh ids, recorded in `depth` one
+// level below the inlined call.
+static void inlineCall(IrFunction& f, size_t site, const IrFunction& callee, std::map<int, int>& depth) {
+    Instr call = f.code[site];
+    int vbase = f.vregs, lbase = f.labels, cbase = f.calls;
+    int end = lbase + callee.labels;
+    f.vregs += callee.vregs;
+    f.labels += callee.labels + 1;
+    f.calls += callee.calls;
+    std::vector<Instr> body;
+    for (Instr in : callee.code) {
+        if (in.dst >= 0) in.dst += vbase;
+        if (in.a >= 0) in.a += vbase;
+        if (in.b >= 0) in.b += vbase;
+        for (int& v : in.args) v += vbase;
+        if (in.label >= 0) in.label += lbase;
+        if (in.op == Op::Call || in.op == Op::ArgStart) {
+            in.imm += cbase;
+            depth[in.imm] = depth[call.imm] + 1;
+        }
+        if (in.op == Op::Param) {
+            in = {Op::Copy, in.dst, call.args[in.imm]};
+        } else if (in.op == Op::Ret) {
+            if (call.dst >= 0) body.push_back(in.a >= 0 ? Instr{Op::Copy, call.dst, in.a} : Instr{Op::Const, call.dst});
+            in = {Op::Jump, -1, -1, -1, 0, end};
+        }
+        body.push_back(std::move(in));
+    }
+    body.push_back({Op::Label, -1, -1, -1, 0, end});
+    f.code.erase(f.code.begin() + site);
+    f.code.insert(f.code.begin() + site, body.begin(), body.end());
+    for (size_t i = 0; i < site; i++) {
+        if (f.code[i].op == Op::ArgStart && f.code[i].imm == call.imm) {
+            f.code.erase(f.code.begin() + i);
+            break;
+        }
+    }
 }
 
-int main() {
-    std::string cpp_code;
+// Inline into every function of `lowered`; returns the new bodies.
+static std::map<std::string, IrFunction> inlineCalls(const std::map<std::string, IrFunction>& lowered,
+                                                     const InlineProfile* profile, InlineStats& stats) {
+    // Strongly connected components of the call graph (Tarjan); they come
+    // out callees first
+    std::map<std::string, std::set<std::string>> callees;
+    std::map<std::string, size_t> staticSites, size;
+    size_t total = 0;
+    for (const auto& [name, f] : lowered) {
+        for (const Instr& in : f.code) {
+            if (in.op != Op::Call || !lowered.count(in.callee)) continue;
+            callees[name].insert(in.callee);
+            staticSites[in.callee]++;
+        }
+        total += size[name] = countInstructions(f.code);
+    }
+    std::map<std::string, int> component, index, low;
+    std::vector<std::string> stack, order;
+    std::set<std::string> onStack;
+    int next = 0, components = 0;
+    std::function<void(const std::string&)> visit = [&](const std::string& v) {
+        index[v] = low[v] = next++;
+        stack.push_back(v);
+        onStack.insert(v);
+        for (const std::string& w : callees[v]) {
+            if (!index.count(w)) {
+                visit(w);
+                low[v] = std::min(low[v], low[w]);
+            } else if (onStack.count(w)) {
+                low[v] = std::min(low[v], index[w]);
+            }
+        }
+        if (low[v] != index[v]) return;
+        for (std::string w; w != v;) {
+            w = stack.back();
+            stack.pop_back();
+            onStack.erase(w);
+            component[w] = components;
+            order.push_back(w);
+        }
+        components++;
+    };
+    for (const auto& entry : lowered) {
+        if (!index.count(entry.first)) visit(entry.first);
+    }
 
-    // Take input C++ code
-    std::cout << "Enter C++ code (e.g., recursive function): ";
-    std::getline(std::cin, cpp_code);
+    stats.budget = total * INLINE_BUDGET / 100 + INLINE_SLACK;
+    std::map<std::string, IrFunction> done;
+    for (const std::string& name : order) {
+        IrFunction f = lowered.at(name);
+        size_t inlinedBefore = stats.inlined;
+        std::map<int, int> depth;  // call id -> inlining depth; 0 in the source
+        std::set<int> declined;
+        for (;;) {
+            std::vector<int> loops = loopDepths(f);
+            size_t best = 0;
+            double bestScore = 0;
+            int bestGrowth = 0;
+            bool found = false;
+            for (size_t i = 0; i < f.code.size(); i++) {
+                const Instr& in = f.code[i];
+                if (in.op != Op::Call || !lowered.count(in.callee) || declined.count(in.imm)) continue;
+                bool recursive = component[in.callee] == component[name];
+                int limit = recursive ? RECURSIVE_UNROLL : MAX_INLINE_DEPTH;
+                const IrFunction& body = done.count(in.callee) ? done.at(in.callee) : lowered.at(in.callee);
+                int overhead = 5 + (int)in.args.size();
+                int growth = (int)countInstructions(body.code) - overhead;
+                double frequency = std::pow(LOOP_WEIGHT, loops[i]);
+                if (profile) {
+                    auto it = profile->calls.find(in.callee);
+                    frequency = it == profile->calls.end() ? 0 : (double)it->second / staticSites[in.callee];
+                }
+                double score = frequency * overhead - growth;
+                bool fits = growth <= 0 || (score >= 0 && stats.growth + growth <= stats.budget);
+                if (depth[in.imm] >= limit || !fits) {
+                    declined.insert(in.imm);
+                    continue;
+                }
+                if (!found || score > bestScore) {
+                    found = true;
+                    best = i;
+                    bestScore = score;
+                    bestGrowth = growth;
+                }
+            }
+            if (!found) break;
+            const std::string& callee = f.code[best].callee;
+            inlineCall(f, best, done.count(callee) ? done.at(callee) : lowered.at(callee), depth);
+            stats.inlined++;
+            if (bestGrowth > 0) stats.growth += bestGrowth;
+        }
+        stats.sites += stats.inlined + declined.size() - inlinedBefore;
+        done[name] = std::move(f);
+    }
+    return done;
+}
 
-    // Convert to assembly
-    std::string assembly_code = cpp_to_assembly(cpp_code);
-    std::cout << "Converted Assembly Code:\n" << assembly_code << std::endl;
+//--------------------------------------
+// Liveness and register allocation
+//--------------------------------------
+// Drop instructions no path from the entry reaches (code after a return,
+// the arm of a constant condition). Their uses have no reaching definition
+// and would otherwise each hold a register across the dead region.
+static void removeUnreachable(IrFunction& f) {
+    size_t n = f.code.size();
+    std::vector<size_t> labelAt(f.labels, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (f.code[i].op == Op::Label) labelAt[f.code[i].label] = i;
+    }
+    std::vector<bool> reached(n);
+    std::vector<size_t> work;
+    if (n > 0) work.push_back(0);
+    while (!work.empty()) {
+        size_t i = work.back();
+        work.pop_back();
+        if (reached[i]) continue;
+        reached[i] = true;
+        const Instr& in = f.code[i];
+        if (in.op == Op::Jump || in.op == Op::JumpEq) work.push_back(labelAt[in.label]);
+        if (in.op != Op::Jump && in.op != Op::Ret && i + 1 < n) work.push_back(i + 1);
+    }
+    std::vector<Instr> code;
+    for (size_t i = 0; i < n; i++) {
+        if (reached[i]) code.push_back(std::move(f.code[i]));
+    }
+    f.code = std::move(code);
+}
+
+// Live-out set of every instruction, by iterating over basic blocks to a
+// fixed point and then walking each block backwards.
+static std::vector<std::vector<bool>> liveness(const IrFunction& f) {
+    size_t n = f.code.size();
+    std::vector<size_t> labelAt(f.labels, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (f.code[i].op == Op::Label) labelAt[f.code[i].label] = i;
+    }
+    auto successors = [&](size_t i, size_t out[2]) {
+        const Instr& in = f.code[i];
+        size_t k = 0;
+        if (in.op == Op::Jump || in.op == Op::JumpEq) out[k++] = labelAt[in.label];
+        if (in.op != Op::Jump && in.op != Op::Ret && i + 1 < n) out[k++] = i + 1;
+        return k;
+    };
+    std::vector<std::vector<bool>> liveIn(n, std::vector<bool>(f.vregs)), liveOut = liveIn;
+    std::vector<int> uses;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = n; i-- > 0;) {
+            std::vector<bool> out(f.vregs);
+            size_t succ[2];
+            for (size_t k = 0, m = successors(i, succ); k < m; k++) {
+                const std::vector<bool>& in = liveIn[succ[k]];
+                for (int v = 0; v < f.vregs; v++) out[v] = out[v] || in[v];
+            }
+            std::vector<bool> in = out;
+            int d = defOf(f.code[i]);
+            if (d >= 0) in[d] = false;
+            usesOf(f.code[i], uses);
+            for (int u : uses) in[u] = true;
+            if (in != liveIn[i] || out != liveOut[i]) {
+                liveIn[i] = std::move(in);
+                liveOut[i] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+    return liveOut;
+}
+
+// Push every value live across a call before the call's arguments are
+// evaluated (at its ArgStart) and pop it afterwards. The value is dead in
+// between, so its register is free for the arguments. A value defined
+// while the arguments are evaluated is pushed just before the call.
+static void insertCallSaves(IrFunction& f) {
+    std::vector<std::vector<bool>> liveOut = liveness(f);
+    std::map<int32_t, size_t> startOf, callOf;  // by call id
+    for (size_t i = 0; i < f.code.size(); i++) {
+        if (f.code[i].op == Op::ArgStart) startOf[f.code[i].imm] = i;
+        if (f.code[i].op == Op::Call) callOf[f.code[i].imm] = i;
+    }
+    std::map<size_t, std::vector<int>> early, late;  // by call
+    std::map<size_t, size_t> startAt;
+    for (const auto& [id, i] : callOf) startAt[i] = startOf.count(id) ? startOf[id] : i;
+    for (const auto& [id, i] : callOf) {
+        const Instr& call = f.code[i];
+        size_t start = startAt[i];
+        std::vector<bool> inArguments(f.vregs);
+        for (size_t j = start; j < i; j++) {
+            if (defOf(f.code[j]) >= 0) inArguments[defOf(f.code[j])] = true;
+        }
+        for (int v = 0; v < f.vregs; v++) {
+            if (liveOut[i][v] && v != call.dst) (inArguments[v] ? late : early)[i].push_back(v);
+        }
+    }
+    // A call nested in another's arguments need not save what the outer
+    // call already pushed at its start, unless the outer arguments read it
+    // after the inner call returns
+    std::vector<int> uses;
+    for (auto& [i, saves] : early) {
+        for (const auto& [j, outer] : early) {
+            if (j <= i || startAt[j] > startAt[i]) continue;
+            auto redundant = [&](int v) {
+                if (std::find(outer.begin(), outer.end(), v) == outer.end()) return false;
+                for (size_t k = i + 1; k <= j; k++) {
+                    usesOf(f.code[k], uses);
+                    if (std::find(uses.begin(), uses.end(), v) != uses.end()) return false;
+                }
+                return true;
+            };
+            saves.erase(std::remove_if(saves.begin(), saves.end(), redundant), saves.end());
+        }
+    }
+    std::vector<Instr> code;
+    for (size_t i = 0; i < f.code.size(); i++) {
+        Instr& in = f.code[i];
+        if (in.op == Op::ArgStart) {
+            auto call = callOf.find(in.imm);
+            if (call != callOf.end()) {
+                for (int v : early[call->second]) code.push_back({Op::Save, -1, v});
+            }
+            continue;
+        }
+        if (in.op != Op::Call) {
+            code.push_back(std::move(in));
+            continue;
+        }
+        for (int v : late[i]) code.push_back({Op::Save, -1, v});
+        code.push_back(std::move(in));
+        for (auto v = late[i].rbegin(); v != late[i].rend(); ++v) code.push_back({Op::Restore, *v});
+        for (auto v = early[i].rbegin(); v != early[i].rend(); ++v) code.push_back({Op::Restore, *v});
+    }
+    f.code = std::move(code);
+}
+
+// Give each web (definitions joined by the uses they reach) its own
+// virtual register. A value restored after a call then becomes a fresh
+// register that is free to land somewhere other than where it was saved
+// from.
+static void splitWebs(IrFunction& f) {
+    size_t n = f.code.size();
+    std::vector<size_t> defs;  // instruction of each definition
+    std::vector<int> defAt(n, -1);
+    for (size_t i = 0; i < n; i++) {
+        if (defOf(f.code[i]) >= 0) {
+            defAt[i] = (int)defs.size();
+            defs.push_back(i);
+        }
+    }
+    std::vector<size_t> labelAt(f.labels, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (f.code[i].op == Op::Label) labelAt[f.code[i].label] = i;
+    }
+    std::vector<std::vector<size_t>> preds(n);
+    for (size_t i = 0; i < n; i++) {
+        const Instr& in = f.code[i];
+        if (in.op == Op::Jump || in.op == Op::JumpEq) preds[labelAt[in.label]].push_back(i);
+        if (in.op != Op::Jump && in.op != Op::Ret && i + 1 < n) preds[i + 1].push_back(i);
+    }
+
+    // Reaching definitions
+    std::vector<std::vector<bool>> out(n, std::vector<bool>(defs.size()));
+    auto reachingIn = [&](size_t i) {
+        std::vector<bool> in(defs.size());
+        for (size_t p : preds[i]) {
+            for (size_t d = 0; d < defs.size(); d++) in[d] = in[d] || out[p][d];
+        }
+        return in;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 0; i < n; i++) {
+            std::vector<bool> next = reachingIn(i);
+            int v = defOf(f.code[i]);
+            if (v >= 0) {
+                for (size_t d = 0; d < defs.size(); d++) {
+                    if (next[d] && defOf(f.code[defs[d]]) == v) next[d] = false;
+                }
+                next[defAt[i]] = true;
+            }
+            if (next != out[i]) {
+                out[i] = std::move(next);
+                changed = true;
+            }
+        }
+    }
 
-    // Convert assembly code to binary
-    std::string binary_code = assembly_to_binary(assembly_code);
-    std::cout << "Converted Binary Code:\n" << binary_code << std::endl;
+    // Union the definitions that reach a common use
+    std::vector<int> parent(defs.size());
+    for (size_t d = 0; d < defs.size(); d++) parent[d] = (int)d;
+    std::function<int(int)> root = [&](int d) { return parent[d] == d ? d : parent[d] = root(parent[d]); };
+    std::vector<int> uses;
+    std::vector<std::vector<int>> useDef(n);  // a reaching definition per use, or -1
+    for (size_t i = 0; i < n; i++) {
+        usesOf(f.code[i], uses);
+        std::vector<bool> in = reachingIn(i);
+        for (int v : uses) {
+            int first = -1;
+            for (size_t d = 0; d < defs.size(); d++) {
+                if (!in[d] || defOf(f.code[defs[d]]) != v) continue;
+                if (first < 0) first = (int)d;
+                else parent[root((int)d)] = root(first);
+            }
+            useDef[i].push_back(first);
+        }
+    }
+
+    // Renumber
+    std::vector<int> webReg(defs.size(), -1);
+    int count = 0;
+    auto regOfDef = [&](int d) {
+        int r = root(d);
+        if (webReg[r] < 0) webReg[r] = count++;
+        return webReg[r];
+    };
+    for (size_t i = 0; i < n; i++) {
+        Instr& in = f.code[i];
+        size_t k = 0;
+        forEachUse(in, [&](int& v) {  // same order as usesOf
+            int d = useDef[i][k++];
+            v = d >= 0 ? regOfDef(d) : count++;
+        });
+        if (defAt[i] >= 0) in.dst = regOfDef(defAt[i]);
+    }
+    f.vregs = count;
+}
+
+// Merge the two sides of a copy into one virtual register when neither is
+// defined while the other is live (Chaitin's test; a copy between them is
+// no conflict), and drop the copy. Parameters are never merged with each
+// other, since they are all defined at once on entry. The merged value's
+// live range is the union of the two, so it can be updated in place.
+static void coalesceCopies(IrFunction& f) {
+    std::vector<std::vector<bool>> liveOut = liveness(f);
+    std::vector<std::vector<size_t>> defs(f.vregs);
+    std::vector<bool> param(f.vregs);
+    for (size_t i = 0; i < f.code.size(); i++) {
+        int d = defOf(f.code[i]);
+        if (d >= 0) defs[d].push_back(i);
+        if (f.code[i].op == Op::Param) param[f.code[i].dst] = true;
+    }
+    std::vector<int> merged(f.vregs, -1);
+    auto find = [&](int v) {
+        while (merged[v] >= 0) v = merged[v];
+        return v;
+    };
+    auto conflicts = [&](int x, int y) {  // is y live where x is defined?
+        for (size_t i : defs[x]) {
+            const Instr& in = f.code[i];
+            if (in.op == Op::Copy && find(in.a) == y) continue;
+            if (liveOut[i][y]) return true;
+        }
+        return false;
+    };
+    for (Instr& in : f.code) {
+        if (in.op != Op::Copy) continue;
+        int d = find(in.dst), a = find(in.a);
+        if (d == a || (param[d] && param[a]) || conflicts(d, a) || conflicts(a, d)) continue;
+        merged[a] = d;
+        param[d] = param[d] || param[a];
+        defs[d].insert(defs[d].end(), defs[a].begin(), defs[a].end());
+        for (std::vector<bool>& live : liveOut) {
+            if (live[a]) live[d] = true;
+        }
+    }
+    std::vector<Instr> code;
+    for (Instr& in : f.code) {
+        forEachUse(in, [&](int& v) { v = find(v); });
+        if (in.dst >= 0) in.dst = find(in.dst);
+        if (in.op == Op::Copy && in.dst == in.a) continue;
+        code.push_back(std::move(in));
+    }
+    f.code = std::move(code);
+}
+
+// Linear scan over live ranges with holes. Instruction i reads its
+// operands at point 2i and writes its result at 2i+1, so a result may
+// take the register of an operand that dies there. Virtual registers are
+// visited in order of their first point and get their hinted register
+// (parameter, argument or return position, or a copy's source or
+// destination) if it is free over the whole range, otherwise the highest
+// free one.
+struct OutOfRegisters : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
 
+static std::vector<int> allocateRegisters(const IrFunction& f) {
+    std::vector<std::vector<bool>> liveOut = liveness(f);
+    size_t n = f.code.size();
+    std::vector<std::vector<int>> points(f.vregs);
+    std::vector<int> uses;
+    std::vector<bool> liveIn(f.vregs);
+    for (size_t i = 0; i < n; i++) {
+        const Instr& in = f.code[i];
+        usesOf(in, uses);
+        int d = defOf(in);
+        for (int v = 0; v < f.vregs; v++) {
+            bool used = std::find(uses.begin(), uses.end(), v) != uses.end();
+            if (used || (liveOut[i][v] && v != d)) points[v].push_back((int)(2 * i));
+            if (liveOut[i][v] || v == d) points[v].push_back((int)(2 * i + 1));
+        }
+    }
+
+    std::vector<int> hint(f.vregs, -1), copyOf(f.vregs, -1), copiedTo(f.vregs, -1);
+    for (const Instr& in : f.code) {
+        if (in.op == Op::Param) hint[in.dst] = in.imm;
+    }
+    for (const Instr& in : f.code) {
+        if (in.op == Op::Call) {
+            for (size_t k = 0; k < in.args.size(); k++) {
+                if (hint[in.args[k]] < 0) hint[in.args[k]] = (int)k;
+            }
+            if (in.dst >= 0 && hint[in.dst] < 0) hint[in.dst] = 0;
+        } else if (in.op == Op::Ret && in.a >= 0 && hint[in.a] < 0) {
+            hint[in.a] = 0;
+        } else if (in.op == Op::Copy || in.op == Op::Dec) {
+            copyOf[in.dst] = in.a;
+            copiedTo[in.a] = in.dst;
+        }
+    }
+
+    std::vector<int> order;
+    for (int v = 0; v < f.vregs; v++) {
+        if (!points[v].empty()) order.push_back(v);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return points[a][0] < points[b][0]; });
+
+    std::vector<std::vector<bool>> busy(NUM_REGISTERS, std::vector<bool>(2 * n + 2));
+    std::vector<int> reg(f.vregs, -1);
+    auto fits = [&](int v, int r) {
+        if (r < 0) return false;
+        for (int p : points[v]) {
+            if (busy[r][p]) return false;
+        }
+        return true;
+    };
+    for (int v : order) {
+        int r = -1;
+        if (fits(v, hint[v])) r = hint[v];
+        else if (copyOf[v] >= 0 && fits(v, reg[copyOf[v]])) r = reg[copyOf[v]];
+        else if (copiedTo[v] >= 0 && fits(v, reg[copiedTo[v]])) r = reg[copiedTo[v]];
+        for (int c = NUM_REGISTERS - 1; c >= 0 && r < 0; c--) {
+            if (fits(v, c)) r = c;
+        }
+        if (r < 0) {
+            throw OutOfRegisters("function '" + f.name + "': more than " + std::to_string(NUM_REGISTERS) +
+                                 " values live at once (there is no memory to spill to)");
+        }
+        reg[v] = r;
+        for (int p : points[v]) busy[r][p] = true;
+    }
+    return reg;
+}
+
+//--------------------------------------
+// Instruction scheduling
+//--------------------------------------
+// The emitter builds machine instructions, not text, so that they can be
+// reordered within basic blocks for a pipelined target before printing.
+// Mn, MachineInstr and PipelineModel are in HLL_to_Assembly.h
+static const PipelineModel TARGETS[] = {
+    {"flat", 1, 1, 1},     // every result is ready for the next instruction
+    {"classic", 1, 3, 2},  // five stages with forwarding, 3-cycle multiplier
+    {"deep", 2, 5, 3},     // no ALU forwarding, slow multiplier and load
+};
+const PipelineModel& DEFAULT_TARGET = TARGETS[1];
+
+const PipelineModel* findTarget(const std::string& name) {
+    for (const PipelineModel& t : TARGETS) {
+        if (name == t.name) return &t;
+    }
+    return nullptr;
+}
+
+// Resources an instruction reads and writes: R0-R7, the CMP flag, SP
+const int FLAG = NUM_REGISTERS, SP = NUM_REGISTERS + 1, RESOURCES = NUM_REGISTERS + 2;
+
+static void resourcesOf(const MachineInstr& in, std::vector<int>& uses, std::vector<int>& defs) {
+    uses.clear();
+    defs.clear();
+    switch (in.op) {
+    case Mn::Label: case Mn::Jmp:
+        break;
+    case Mn::Li: case Mn::Clr:
+        defs = {in.rd};
+        break;
+    case Mn::Move: case Mn::Shl: case Mn::Srl:
+        uses = {in.ra};
+        defs = {in.rd};
+        break;
+    case Mn::Add: case Mn::Sub: case Mn::Mul: case Mn::Slt:
+        uses = {in.ra, in.rb};
+        defs = {in.rd};
+        break;
+    case Mn::Dec:
+        uses = {in.rd};
+        defs = {in.rd};
+        break;
+    case Mn::Cmp:
+        uses = {in.ra};
+        if (in.rb >= 0) uses.push_back(in.rb);
+        defs = {FLAG};
+        break;
+    case Mn::Je:
+        uses = {FLAG};
+        break;
+    case Mn::Call:  // arguments in, result out, every register clobbered
+        for (int r = 0; r < RESOURCES; r++) {
+            if (r != FLAG) uses.push_back(r);
+            defs.push_back(r);
+        }
+        break;
+    case Mn::Ret:
+        uses = {0, SP};
+        break;
+    case Mn::Push:
+        uses = {in.ra, SP};
+        defs = {SP};
+        break;
+    case Mn::Pop:
+        uses = {SP};
+        defs = {in.rd, SP};
+        break;
+    }
+}
+
+static int latency(const MachineInstr& in, int resource, const PipelineModel& model) {
+    if (resource == SP || in.op == Mn::Call) return 1;
+    if (in.op == Mn::Mul) return model.multiply;
+    if (in.op == Mn::Pop) return model.load;
+    return model.alu;
+}
+
+static bool endsBlock(Mn op) {
+    return op == Mn::Je || op == Mn::Jmp || op == Mn::Call || op == Mn::Ret;
+}
+
+// In-order issue, one instruction per cycle. A label may be reached from
+// anywhere and a call runs for many cycles, so everything is taken to be
+// ready after either.
+struct PipelineState {
+    int cycle = 0;
+    int ready[RESOURCES] = {};
+    size_t stalls = 0;
+
+    void issue(const MachineInstr& in, const PipelineModel& model) {
+        if (in.op == Mn::Label) {
+            reset();
+            return;
+        }
+        std::vector<int> uses, defs;
+        resourcesOf(in, uses, defs);
+        int at = cycle;
+        for (int r : uses) at = std::max(at, ready[r]);
+        stalls += at - cycle;
+        cycle = at + 1;
+        for (int r : defs) ready[r] = at + latency(in, r, model);
+        if (in.op == Mn::Call) reset();
+    }
+
+    void reset() {
+        for (int& r : ready) r = cycle;
+    }
+};
+
+static size_t countStalls(const std::vector<MachineInstr>& code, const PipelineModel& model) {
+    PipelineState state;
+    for (const MachineInstr& in : code) state.issue(in, model);
+    return state.stalls;
+}
+
+// List scheduling of code[begin, end), a block with no labels whose only
+// control transfer, if any, is the last instruction, starting from
+// `state`. Dependences: a read waits for the latest earlier write of the
+// resource (its latency), and a write stays after earlier reads and
+// writes of it; PUSH, POP and CALL stay in order through SP. Each cycle
+// the instruction that can issue soonest goes next, ties broken by the
+// longest latency-weighted path to the end of the block. Returns the
+// new order as indices into code.
+static std::vector<size_t> scheduleBlock(const std::vector<MachineInstr>& code, size_t begin, size_t end,
+                                         const PipelineState& state, const PipelineModel& model) {
+    size_t n = end - begin;
+    std::vector<std::vector<std::pair<size_t, int>>> succs(n);  // (node, minimum issue distance)
+    std::vector<int> preds(n, 0), earliest(n, state.cycle);
+    std::vector<int> lastDef(RESOURCES, -1);
+    std::vector<std::vector<size_t>> readers(RESOURCES);
+    std::vector<int> uses, defs;
+    auto edge = [&](size_t from, size_t to, int distance) {
+        succs[from].push_back({to, distance});
+        preds[to]++;
+    };
+    for (size_t j = 0; j < n; j++) {
+        const MachineInstr& in = code[begin + j];
+        resourcesOf(in, uses, defs);
+        for (int r : uses) {
+            if (lastDef[r] >= 0) edge(lastDef[r], j, latency(code[begin + lastDef[r]], r, model));
+            else earliest[j] = std::max(earliest[j], state.ready[r]);
+        }
+        for (int r : defs) {
+            for (size_t reader : readers[r]) {
+                if (reader != j) edge(reader, j, 1);
+            }
+            if (lastDef[r] >= 0) edge(lastDef[r], j, 1);
+        }
+        for (int r : uses) readers[r].push_back(j);
+        for (int r : defs) {
+            lastDef[r] = (int)j;
+            readers[r].clear();
+        }
+        if (endsBlock(in.op)) {
+            for (size_t i = 0; i < j; i++) edge(i, j, 1);
+        }
+    }
+    std::vector<int> height(n, 1);
+    for (size_t j = n; j-- > 0;) {
+        for (const auto& s : succs[j]) height[j] = std::max(height[j], s.second + height[s.first]);
+    }
+
+    std::vector<size_t> order;
+    std::vector<bool> done(n, false);
+    int cycle = state.cycle;
+    while (order.size() < n) {
+        size_t best = n;
+        int bestAt = 0;
+        for (size_t j = 0; j < n; j++) {
+            if (done[j] || preds[j] > 0) continue;
+            int at = std::max(cycle, earliest[j]);
+            if (best == n || at < bestAt || (at == bestAt && height[j] > height[best])) {
+                best = j;
+                bestAt = at;
+            }
+        }
+        done[best] = true;
+        order.push_back(begin + best);
+        cycle = bestAt + 1;
+        for (const auto& s : succs[best]) {
+            earliest[s.first] = std::max(earliest[s.first], bestAt + s.second);
+            preds[s.first]--;
+        }
+    }
+    return order;
+}
+
+// Schedule each block of a function, keeping the original order of any
+// block the schedule would not make faster.
+static void scheduleFunction(std::vector<MachineInstr>& code, const PipelineModel& model) {
+    std::vector<MachineInstr> out;
+    out.reserve(code.size());
+    PipelineState state;
+    for (size_t begin = 0; begin < code.size();) {
+        if (code[begin].op == Mn::Label) {
+            state.issue(code[begin], model);
+            out.push_back(code[begin++]);
+            continue;
+        }
+        size_t end = begin;
+        while (end < code.size() && code[end].op != Mn::Label && !endsBlock(code[end].op)) end++;
+        if (end < code.size() && code[end].op != Mn::Label) end++;
+
+        std::vector<size_t> order = scheduleBlock(code, begin, end, state, model);
+        PipelineState original = state, scheduled = state;
+        for (size_t i = begin; i < end; i++) original.issue(code[i], model);
+        for (size_t i : order) scheduled.issue(code[i], model);
+        if (scheduled.stalls < original.stalls) {
+            for (size_t i : order) out.push_back(code[i]);
+            state = scheduled;
+        } else {
+            out.insert(out.end(), code.begin() + begin, code.begin() + end);
+            state = original;
+        }
+        begin = end;
+    }
+    code.swap(out);
+}
+
+//--------------------------------------
+// Code generation
+//--------------------------------------
+class Emitter {
+public:
+    struct Emitted {
+        size_t instructions = 0;
+        size_t stallsBefore = 0, stallsAfter = 0;  // estimated for the target
+    };
+
+    Emitter(std::vector<MachineInstr>& out, const PipelineModel& target) : out(out), target(target) {}
+
+    // Generate, schedule when `schedule` is set, and append one function to
+    // the output
+    Emitted function(const IrFunction& f, const std::vector<int>& reg, bool schedule) {
+        code.clear();
+        label(f.name);
+        std::vector<std::vector<bool>> liveOut = liveness(f);
+        targeted.assign(f.labels, false);
+        for (size_t k = 0; k < f.code.size(); k++) {
+            const Instr& in = f.code[k];
+            if (in.op == Op::JumpEq || (in.op == Op::Jump && !jumpsToNext(f, k, in.label))) targeted[in.label] = true;
+        }
+        size_t i = 0;
+        // Incoming arguments: one parallel move from R0.. into place
+        std::vector<std::pair<int, int>> moves;
+        for (; i < f.code.size() && f.code[i].op == Op::Param; i++) {
+            int v = f.code[i].dst;
+            bool used = false;
+            for (size_t j = i; j < f.code.size() && !used; j++) used = liveOut[j][v];
+            if (used && reg[v] != f.code[i].imm) moves.push_back({reg[v], f.code[i].imm});
+        }
+        parallelMove(moves);
+        for (; i < f.code.size(); i++) {
+            const Instr& in = f.code[i];
+            int rd = in.dst >= 0 ? reg[in.dst] : -1;
+            int ra = in.a >= 0 ? reg[in.a] : -1, rb = in.b >= 0 ? reg[in.b] : -1;
+            switch (in.op) {
+            case Op::Param:
+                break;
+            case Op::Const:
+                if (rd < 0) break;  // dead
+                if (in.imm == 0) emit({Mn::Clr, rd});
+                else emit({Mn::Li, rd, -1, -1, in.imm});
+                break;
+            case Op::Copy:
+                if (rd >= 0 && rd != ra) emit({Mn::Move, rd, ra});
+                break;
+            case Op::Add: emit({Mn::Add, rd, ra, rb}); break;
+            case Op::Sub: emit({Mn::Sub, rd, ra, rb}); break;
+            case Op::Mul: emit({Mn::Mul, rd, ra, rb}); break;
+            case Op::Slt: emit({Mn::Slt, rd, ra, rb}); break;
+            case Op::Shl: emit({Mn::Shl, rd, ra, -1, in.imm}); break;
+            case Op::Srl: emit({Mn::Srl, rd, ra, -1, in.imm}); break;
+            case Op::Dec:
+                if (rd != ra) emit({Mn::Move, rd, ra});
+                emit({Mn::Dec, rd});
+                break;
+            case Op::Label:
+                if (targeted[in.label]) label(labelName(f, in.label));
+                break;
+            case Op::Jump:
+                if (!jumpsToNext(f, i, in.label)) emit({Mn::Jmp, -1, -1, -1, 0, labelName(f, in.label)});
+                break;
+            case Op::JumpEq:
+                emit({Mn::Cmp, -1, ra, rb, in.imm});
+                emit({Mn::Je, -1, -1, -1, 0, labelName(f, in.label)});
+                break;
+            case Op::Call: {
+                moves.clear();
+                for (size_t k = 0; k < in.args.size(); k++) {
+                    if (reg[in.args[k]] != (int)k) moves.push_back({(int)k, reg[in.args[k]]});
+                }
+                parallelMove(moves);
+                size_t ret = tailCallReturn(f, reg, i);
+                if (ret) {  // the callee returns straight to our caller
+                    emit({Mn::Jmp, -1, -1, -1, 0, in.callee});
+                    i = ret;
+                    break;
+                }
+                emit({Mn::Call, -1, -1, -1, 0, in.callee});
+                if (rd > 0) emit({Mn::Move, rd, 0});
+                break;
+            }
+            case Op::Ret:
+                if (ra > 0) emit({Mn::Move, 0, ra});
+                emit({Mn::Ret});
+                break;
+            case Op::Save: emit({Mn::Push, -1, ra}); break;
+            case Op::Restore: emit({Mn::Pop, rd}); break;
+            case Op::Div: case Op::Rem: case Op::ArgStart: case Op::Phi:
+                break;  // expanded or resolved before this point
+            }
+        }
+
+        Emitted result;
+        result.stallsBefore = result.stallsAfter = countStalls(code, target);
+        if (schedule) {
+            scheduleFunction(code, target);
+            result.stallsAfter = countStalls(code, target);
+        }
+        for (MachineInstr& m : code) {
+            if (m.op != Mn::Label) result.instructions++;
+            out.push_back(std::move(m));
+        }
+        return result;
+    }
+
+private:
+    std::vector<MachineInstr>& out;
+    const PipelineModel& target;
+    std::vector<MachineInstr> code;  // the current function
+    std::vector<bool> targeted;      // labels some emitted branch refers to
+
+    static std::string labelName(const IrFunction& f, int l) { return "." + f.name + "_" + std::to_string(l); }
+    void emit(MachineInstr m) { code.push_back(std::move(m)); }
+    void label(const std::string& name) { code.push_back({Mn::Label, -1, -1, -1, 0, name}); }
+
+    // Is everything between instruction i and label l just labels?
+    static bool jumpsToNext(const IrFunction& f, size_t i, int l) {
+        for (size_t j = i + 1; j < f.code.size() && f.code[j].op == Op::Label; j++) {
+            if (f.code[j].label == l) return true;
+        }
+        return false;
+    }
+
+    // If call i is followed, through labels nothing branches to, by a RET
+    // of its result, the index of that RET; otherwise 0. Nothing is on the
+    // stack at a call's return in that case, since nothing is live.
+    size_t tailCallReturn(const IrFunction& f, const std::vector<int>& reg, size_t i) const {
+        const Instr& call = f.code[i];
+        size_t j = i + 1;
+        while (j < f.code.size() && f.code[j].op == Op::Label && !targeted[f.code[j].label]) j++;
+        if (j == f.code.size() || f.code[j].op != Op::Ret) return 0;
+        const Instr& ret = f.code[j];
+        if (ret.a < 0) return call.dst < 0 || reg[call.dst] < 0 ? j : 0;
+        return ret.a == call.dst && reg[call.dst] == 0 ? j : 0;
+    }
+
+    // Registers (dst, src) all at once. A move whose destination no other
+    // move still reads goes first; a cycle is broken through a free
+    // register or, with all eight taken, by swapping with ADD/SUB.
+    void parallelMove(std::vector<std::pair<int, int>> moves) {
+        while (!moves.empty()) {
+            bool progress = false;
+            for (size_t k = 0; k < moves.size(); k++) {
+                int dst = moves[k].first;
+                bool read = std::any_of(moves.begin(), moves.end(), [&](const auto& m) { return m.second == dst; });
+                if (read) continue;
+                emit({Mn::Move, dst, moves[k].second});
+                moves.erase(moves.begin() + k);
+                progress = true;
+                break;
+            }
+            if (progress) continue;
+            int dst = moves[0].first, src = moves[0].second;
+            int scratch = -1;
+            for (int r = 0; r < NUM_REGISTERS && scratch < 0; r++) {
+                bool taken = std::any_of(moves.begin(), moves.end(), [&](const auto& m) { return m.first == r || m.second == r; });
+                if (!taken) scratch = r;
+            }
+            if (scratch >= 0) {
+                emit({Mn::Move, scratch, dst});
+                for (auto& m : moves) {
+                    if (m.second == dst) m.second = scratch;
+                }
+                continue;
+            }
+            emit({Mn::Add, dst, dst, src});
+            emit({Mn::Sub, src, dst, src});
+            emit({Mn::Sub, dst, dst, src});
+            for (auto& m : moves) {
+                if (m.second == dst) m.second = src;
+                else if (m.second == src) m.second = dst;
+            }
+            moves.erase(std::remove_if(moves.begin(), moves.end(), [](const auto& m) { return m.first == m.second; }),
+                        moves.end());
+        }
+    }
+};
+
+std::vector<MachineInstr> compileProgram(const std::string& cpp_code, int level, OptimizationReport* report,
+                                         const PipelineModel& target, const InlineProfile* profile) {
+    Parser parser(tokenize(cpp_code));
+    std::vector<FunctionDecl> program = parser.program();
+    std::map<std::string, const FunctionDecl*> decls;
+    for (const FunctionDecl& f : program) {
+        auto it = decls.find(f.name);
+        if (it != decls.end() && it->second->body && f.body) throw CompileError(f.line, "redefinition of '" + f.name + "'");
+        if (it == decls.end() || f.body) decls[f.name] = &f;
+    }
+
+    std::vector<MachineInstr> out;
+    Emitter emitter(out, target);
+    Lowering lowering(decls);
+    if (report) {
+        report->level = level;
+        report->target = target.name;
+    }
+    std::map<std::string, IrFunction> lowered, inlined;
+    for (const FunctionDecl& f : program) {
+        if (!f.body) continue;
+        IrFunction ir = lowering.lower(f);
+        removeUnreachable(ir);
+        lowered[f.name] = std::move(ir);
+    }
+    InlineStats inlining;
+    if (level >= INLINE_LEVEL) inlined = inlineCalls(lowered, profile, inlining);
+    if (report) {
+        report->inlineSites += inlining.sites;
+        report->inlined += inlining.inlined;
+        report->inlineGrowth += inlining.growth;
+        report->inlineBudget += inlining.budget;
+    }
+
+    for (const FunctionDecl& f : program) {
+        if (!f.body) continue;
+        bool withInlining = level >= INLINE_LEVEL;
+        for (int at = level;;) {
+            OptimizationReport passes;
+            IrFunction ir = withInlining ? inlined[f.name] : lowered[f.name];
+            if (withInlining) removeUnreachable(ir);
+            optimize(ir, at, &passes);
+            insertCallSaves(ir);
+            splitWebs(ir);
+            if (at > 0) coalesceCopies(ir);
+            std::vector<int> reg;
+            try {
+                reg = allocateRegisters(ir);
+            } catch (const OutOfRegisters&) {
+                if (withInlining) withInlining = false;
+                else if (at-- == 0) throw;
+                continue;
+            }
+            bool fellBack = at < level || (level >= INLINE_LEVEL && !withInlining);
+            Emitter::Emitted emitted = emitter.function(ir, reg, at > 0);
+            if (report) {
+                for (size_t row = 0; row < passes.rows.size(); row++) {
+                    report->add(row, passes.rows[row].pass, passes.rows[row].instructions, passes.rows[row].changed);
+                }
+                report->add(passes.rows.size(), "emitted", emitted.instructions);
+                report->stalls.push_back({f.name, emitted.stallsBefore, emitted.stallsAfter});
+                if (fellBack) {
+                    report->notes.push_back(f.name + ": too many live values at -O" + std::to_string(level) +
+                                            ", compiled at -O" + std::to_string(at) +
+                                            (at >= INLINE_LEVEL ? " without inlining" : ""));
+                }
+            }
+            break;
+        }
+    }
+    return out;
+}
+
+static void print(std::ostream& out, const MachineInstr& m) {
+    auto r = [](int n) { return "R" + std::to_string(n); };
+    switch (m.op) {
+    case Mn::Label: out << m.target << ":\n"; return;
+    case Mn::Move: out << "MOVE " << r(m.rd) << ", " << r(m.ra); break;
+    case Mn::Li: out << "LI " << r(m.rd) << ", " << m.imm; break;
+    case Mn::Clr: out << "CLR " << r(m.rd); break;
+    case Mn::Add: out << "ADD " << r(m.rd) << ", " << r(m.ra) << ", " << r(m.rb); break;
+    case Mn::Sub: out << "SUB " << r(m.rd) << ", " << r(m.ra) << ", " << r(m.rb); break;
+    case Mn::Mul: out << "MUL " << r(m.rd) << ", " << r(m.ra) << ", " << r(m.rb); break;
+    case Mn::Slt: out << "SLT " << r(m.rd) << ", " << r(m.ra) << ", " << r(m.rb); break;
+    case Mn::Shl: out << "SHL " << r(m.rd) << ", " << r(m.ra) << ", " << m.imm; break;
+    case Mn::Srl: out << "SRL " << r(m.rd) << ", " << r(m.ra) << ", " << m.imm; break;
+    case Mn::Dec: out << "DEC " << r(m.rd); break;
+    case Mn::Cmp: out << "CMP " << r(m.ra) << ", " << (m.rb >= 0 ? r(m.rb) : std::to_string(m.imm)); break;
+    case Mn::Je: out << "JE " << m.target; break;
+    case Mn::Jmp: out << "JMP " << m.target; break;
+    case Mn::Call: out << "CALL " << m.target; break;
+    case Mn::Ret: out << "RET"; break;
+    case Mn::Push: out << "PUSH " << r(m.ra); break;
+    case Mn::Pop: out << "POP " << r(m.rd); break;
+    }
+    out << "\n";
+}
+
+std::string printAssembly(const std::vector<MachineInstr>& code) {
+    std::ostringstream out;
+    for (const MachineInstr& m : code) print(out, m);
+    return out.str();
+}
+
+std::string cpp_to_assembly(const std::string& cpp_code, int level, OptimizationReport* report,
+                            const PipelineModel& target, const InlineProfile* profile) {
+    return printAssembly(compileProgram(cpp_code, level, report, target, profile));
+}
+
+void printReport(std::ostream& os, const OptimizationReport& report) {
+    os << "Optimization report (-O" << report.level << "):\n";
+    char buffer[128];
+    snprintf(buffer, sizeof buffer, "  %-24s %12s %7s %8s\n", "pass", "instructions", "delta", "changed");
+    os << buffer;
+    for (size_t row = 0; row < report.rows.size(); row++) {
+        const OptimizationReport::Row& r = report.rows[row];
+        bool isPass = row >= 1 && row <= PASS_COUNT;
+        if (isPass && PASSES[row - 1].level > report.level) continue;
+        if (row == 0) {
+            snprintf(buffer, sizeof buffer, "  %-24s %12zu\n", r.pass.c_str(), r.instructions);
+        } else {
+            long delta = (long)r.instructions - (long)report.rows[row - 1].instructions;
+            if (isPass) {
+                snprintf(buffer, sizeof buffer, "  %-24s %12zu %+7ld %8zu\n", r.pass.c_str(), r.instructions, delta, r.changed);
+            } else {
+                snprintf(buffer, sizeof buffer, "  %-24s %12zu %+7ld\n", r.pass.c_str(), r.instructions, delta);
+            }
+        }
+        os << buffer;
+    }
+    for (const std::string& note : report.notes) os << "  note: " << note << "\n";
+    if (report.level >= INLINE_LEVEL) {
+        os << "Inlined " << report.inlined << " of " << report.inlineSites << " call site(s), +" << report.inlineGrowth
+           << " instruction(s) of a " << report.inlineBudget << " budget\n";
+    }
+
+    os << "Estimated stall cycles (" << report.target << " pipeline):\n";
+    snprintf(buffer, sizeof buffer, "  %-24s %12s %7s\n", "function", "unscheduled", "after");
+    os << buffer;
+    size_t before = 0, after = 0;
+    for (const OptimizationReport::Stalls& f : report.stalls) {
+        snprintf(buffer, sizeof buffer, "  %-24s %12zu %7zu\n", f.function.c_str(), f.before, f.after);
+        os << buffer;
+        before += f.before;
+        after += f.after;
+    }
+    snprintf(buffer, sizeof buffer, "  %-24s %12zu %7zu\n", "total", before, after);
+    os << buffer;
+}
+
+}  // namespace htoa
+
+#ifndef TOOLCHAIN_LIBRARY
+using namespace htoa;
+
+int main(int argc, char* argv[]) {
+    // Usage: htoa [-O0|-O1|-O2] [--target flat|classic|deep] [--profile run.prof] [--stats]
+    //             [-o output.asm] [input.cpp]
+    // Reads standard input when no input is given; the default output,
+    // input.asm, is the assembler's default input. --target picks the
+    // pipeline model blocks are scheduled for. --profile takes call counts
+    // for the inliner from a linker --profile-out run. --stats prints the
+    // instruction count after each optimization pass, what was inlined and
+    // the estimated stall cycles per function to stderr.
+    std::string inputPath, outputPath = "input.asm";
+    int level = MAX_OPT_LEVEL;
+    const PipelineModel* target = &DEFAULT_TARGET;
+    InlineProfile profile;
+    std::string profilePath;
+    bool stats = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) outputPath = argv[++i];
+        else if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' && arg[2] <= '0' + MAX_OPT_LEVEL) level = arg[2] - '0';
+        else if (arg == "--stats") stats = true;
+        else if (arg == "--target" && i + 1 < argc) {
+            target = findTarget(argv[++i]);
+            if (!target) {
+                std::cerr << "Unknown target " << argv[i] << "; known:";
+                for (const PipelineModel& t : TARGETS) std::cerr << " " << t.name;
+                std::cerr << std::endl;
+                return 1;
+            }
+        } else if (arg == "--profile" && i + 1 < argc) profilePath = argv[++i];
+        else inputPath = arg;
+    }
+    std::string error;
+    if (!profilePath.empty() && !profile.read(profilePath, error)) {
+        std::cerr << profilePath << ": " << error << std::endl;
+        return 1;
+    }
+
+    std::stringstream source;
+    if (inputPath.empty()) {
+        source << std::cin.rdbuf();
+    } else {
+        std::ifstream in(inputPath);
+        if (!in) {
+            std::cerr << "Error opening " << inputPath << std::endl;
+            return 1;
+        }
+        source << in.rdbuf();
+    }
+
+    std::string assembly_code;
+    OptimizationReport report;
+    try {
+        assembly_code = cpp_to_assembly(source.str(), level, stats ? &report : nullptr, *target,
+                                        profilePath.empty() ? nullptr : &profile);
+    } catch (const std::runtime_error& e) {
+        std::cerr << (inputPath.empty() ? "<stdin>" : inputPath) << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(outputPath);
+    out << assembly_code;
+    if (!out) {
+        std::cerr << "Error writing " << outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "Converted Assembly Code:\n" << assembly_code;
+    if (stats) printReport(std::cerr, report);
     return 0;
 }
+#endif
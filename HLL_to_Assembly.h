@@ -0,0 +1,75 @@
+#ifndef HLL_TO_ASSEMBLY_H
+#define HLL_TO_ASSEMBLY_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Library interface of the compiler (HLL_to_Assembly.cpp). Toolchain.cpp
+// links against it; the htoa tool is the same source with its main().
+namespace htoa {
+
+const int MAX_OPT_LEVEL = 2;
+
+// Machine instructions as the code generator emits them, one per line of
+// assembly text. Registers are R0-R7; -1 marks an operand the form does
+// not take.
+enum class Mn { Label, Move, Li, Clr, Add, Sub, Mul, Slt, Shl, Srl, Dec, Cmp, Je, Jmp, Call, Ret, Push, Pop };
+
+struct MachineInstr {
+    Mn op;
+    int rd = -1, ra = -1, rb = -1;
+    int64_t imm = 0;          // LI value, shift amount, CMP immediate when rb < 0
+    std::string target = {};  // label or callee; Label's name
+};
+
+// Cycles from an instruction's issue until its result can be used; 1 is
+// back to back. The core issues one instruction per cycle, in order, and
+// waits for operands that are not ready yet. There is no divide: / and %
+// by a constant are already shifts and multiplies.
+struct PipelineModel {
+    const char* name;
+    int alu;       // MOVE LI CLR ADD SUB SLT SHL SRL DEC CMP
+    int multiply;  // MUL
+    int load;      // POP, load-use
+};
+
+extern const PipelineModel& DEFAULT_TARGET;
+
+// nullptr if there is no model by that name
+const PipelineModel* findTarget(const std::string& name);
+
+// The "call <function> <count>" records of a linker profile; the others
+// are skipped.
+struct InlineProfile {
+    std::map<std::string, uint64_t> calls;
+
+    bool read(const std::string& path, std::string& error);
+};
+
+struct OptimizationReport;
+
+// Compile a C-subset translation unit at -O`level` to machine
+// instructions, functions in source order. A function whose optimized code
+// needs more than eight registers is compiled again without inlining, then
+// one level lower at a time. From -O1 up, blocks are scheduled for
+// `target`; at -O2, call sites are inlined using `profile` for their
+// frequencies if given. Throws std::runtime_error with a line number on
+// the first error.
+std::vector<MachineInstr> compileProgram(const std::string& cpp_code, int level = MAX_OPT_LEVEL,
+                                         OptimizationReport* report = nullptr,
+                                         const PipelineModel& target = DEFAULT_TARGET,
+                                         const InlineProfile* profile = nullptr);
+
+// The assembly text for `code`, one instruction or label per line
+std::string printAssembly(const std::vector<MachineInstr>& code);
+
+// compileProgram, then printAssembly
+std::string cpp_to_assembly(const std::string& cpp_code, int level = MAX_OPT_LEVEL,
+                            OptimizationReport* report = nullptr, const PipelineModel& target = DEFAULT_TARGET,
+                            const InlineProfile* profile = nullptr);
+
+}  // namespace htoa
+
+#endif
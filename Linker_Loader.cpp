@@ -1,138 +1,1745 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <string>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <csetjmp>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include "Object_Format.h"
+#include "Linker_Loader.h"
+
+namespace linkload {
 
 // Symbol structure for representing each symbol (function or variable)
 struct Symbol {
     std::string name;
     uint32_t address;  // The address where the symbol is located
     bool isDefined;    // If true, the symbol is defined in this object
+    bool isGlobal = true;
+    bool isSection = false;
+    int object = -1;   // Defining object, for the linker's global table
+};
+
+// A typed relocation against one word of the code section
+struct Relocation {
+    uint32_t offset;   // byte offset of the word in the code section
+    uint32_t symbol;   // index into ObjectFile::symbols
+    uint32_t type;     // RELOC_ABS16 or RELOC_WORD32
+    int32_t addend;
 };
 
 // ObjectFile structure representing an object file
 struct ObjectFile {
-    std::vector<std::string> codeSection;  // Assembly code for the object file
+    std::string path;
+    std::vector<uint32_t> codeSection;    // Machine code, host byte order
     std::vector<uint32_t> dataSection;    // Variables/data
-    std::map<std::string, Symbol> symbolTable;  // Symbols and their addresses
+    std::vector<Symbol> symbols;          // Symbols in file order; relocations index this
+    std::vector<Relocation> relocations;  // Code relocations
+
+    // Read an object written by the assembler (Object_Format.h). The file is
+    // mapped read-only and decoded straight from the mapping.
+    bool load(const std::string& file, std::string& error) {
+        path = file;
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open";
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)(4 * OBJ_HEADER_WORDS)) {
+            close(fd);
+            error = "not an object file";
+            return false;
+        }
+        size_t size = (size_t)st.st_size;
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            error = "cannot map";
+            return false;
+        }
+        bool ok = parse(static_cast<const uint8_t*>(map), size, error);
+        munmap(map, size);
+        return ok;
+    }
+
+    // Decode an object already in memory; `name` stands in for the path.
+    bool read(const std::string& name, const uint8_t* data, size_t size, std::string& error) {
+        path = name;
+        if (size < 4 * OBJ_HEADER_WORDS) {
+            error = "not an object file";
+            return false;
+        }
+        return parse(data, size, error);
+    }
+
+private:
+    bool parse(const uint8_t* base, size_t size, std::string& error) {
+        if (readBE32(base) != OBJ_MAGIC || readBE32(base + 4) != OBJ_VERSION) {
+            error = "not an object file";
+            return false;
+        }
+        uint64_t sectionCount = readBE32(base + 8);
+        uint64_t symbolCount = readBE32(base + 12);
+        uint64_t relocCount = readBE32(base + 16);
+        uint64_t stringSize = readBE32(base + 20);
+        uint64_t sectionsAt = 4 * OBJ_HEADER_WORDS;
+        uint64_t symbolsAt = sectionsAt + 4 * OBJ_SECTION_WORDS * sectionCount;
+        uint64_t relocsAt = symbolsAt + 4 * OBJ_SYMBOL_WORDS * symbolCount;
+        uint64_t stringsAt = relocsAt + 4 * OBJ_RELOC_WORDS * relocCount;
+        if (stringsAt + stringSize > size) {
+            error = "truncated object file";
+            return false;
+        }
+        const char* strings = reinterpret_cast<const char*>(base + stringsAt);
+        auto name = [&](uint32_t offset) {
+            if (offset >= stringSize) return std::string();
+            return std::string(strings + offset, strnlen(strings + offset, stringSize - offset));
+        };
+
+        // Only .text is produced today; other sections are ignored
+        uint32_t textIndex = OBJ_UNDEF;
+        for (uint32_t i = 0; i < sectionCount; i++) {
+            const uint8_t* h = base + sectionsAt + 4 * OBJ_SECTION_WORDS * i;
+            uint32_t offset = readBE32(h + 8), bytes = readBE32(h + 12);
+            if (readBE32(h + 4) != SECTION_TEXT || textIndex != OBJ_UNDEF) continue;
+            if ((uint64_t)offset + bytes > size || bytes % 4 != 0) {
+                error = "bad section header";
+                return false;
+            }
+            textIndex = i;
+            codeSection.resize(bytes / 4);
+            for (uint32_t w = 0; w < bytes / 4; w++) codeSection[w] = readBE32(base + offset + 4 * w);
+        }
+
+        symbols.reserve(symbolCount);
+        for (uint32_t i = 0; i < symbolCount; i++) {
+            const uint8_t* e = base + symbolsAt + 4 * OBJ_SYMBOL_WORDS * i;
+            uint32_t section = readBE32(e + 4), flags = readBE32(e + 12);
+            bool defined = section != OBJ_UNDEF;
+            if (defined && section != textIndex) {
+                error = "symbol in unsupported section";
+                return false;
+            }
+            uint32_t value = readBE32(e + 8);
+            if (defined && (value % 4 != 0 || value / 4 > codeSection.size())) {
+                error = "bad symbol " + std::to_string(i);
+                return false;
+            }
+            symbols.push_back({name(readBE32(e)), value, defined,
+                               (flags & SYM_GLOBAL) != 0, (flags & SYM_SECTION) != 0});
+        }
+
+        relocations.reserve(relocCount);
+        for (uint32_t i = 0; i < relocCount; i++) {
+            const uint8_t* r = base + relocsAt + 4 * OBJ_RELOC_WORDS * i;
+            Relocation rel = {readBE32(r + 4), readBE32(r + 8), readBE32(r + 12), (int32_t)readBE32(r + 16)};
+            if (readBE32(r) != textIndex || rel.offset % 4 != 0 || rel.offset / 4 >= codeSection.size() ||
+                rel.symbol >= symbolCount || (rel.type != RELOC_ABS16 && rel.type != RELOC_WORD32)) {
+                error = "bad relocation " + std::to_string(i);
+                return false;
+            }
+            relocations.push_back(rel);
+        }
+        return true;
+    }
+};
+
+// Fixed set of worker threads. forEach(n, task) runs task(0) .. task(n-1)
+// on the workers and the calling thread, handing out indices from an
+// atomic counter so uneven tasks balance, and returns when all are done.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads) {
+        for (unsigned i = 1; i < threads; i++) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    unsigned size() const { return (unsigned)workers.size() + 1; }
+
+    void forEach(size_t n, const std::function<void(size_t)>& task) {
+        if (workers.empty() || n <= 1) {
+            for (size_t i = 0; i < n; i++) task(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &task;
+            jobSize = n;
+            next = 0;
+            busy = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return busy == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    const std::function<void(size_t)>* job = nullptr;
+    size_t jobSize = 0;
+    std::atomic<size_t> next{0};
+    size_t busy = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void drain() {
+        for (size_t i; (i = next.fetch_add(1)) < jobSize;) (*job)(i);
+    }
+
+    void workerLoop() {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            drain();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) finished.notify_one();
+        }
+    }
+};
+
+// Global symbol table split into shards by name hash, so each shard can be
+// filled by its own task and read concurrently afterwards.
+class SymbolTable {
+public:
+    static const size_t SHARDS = 64;
+
+    static size_t shardOf(const std::string& name) { return std::hash<std::string>()(name) % SHARDS; }
+
+    std::unordered_map<std::string, Symbol>& shard(size_t s) { return shards[s]; }
+    const std::unordered_map<std::string, Symbol>& shard(size_t s) const { return shards[s]; }
+
+    const Symbol* find(const std::string& name) const {
+        const auto& table = shards[shardOf(name)];
+        auto it = table.find(name);
+        return it == table.end() ? nullptr : &it->second;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& table : shards) n += table.size();
+        return n;
+    }
+
+private:
+    std::unordered_map<std::string, Symbol> shards[SHARDS];
+};
+
+// A function-sized piece of an object's code. With --gc-sections or --icf
+// each object is split at its global symbols, so an atom runs from one
+// global symbol to the next ('.' labels stay inside their function);
+// otherwise the whole object is one atom.
+struct Atom {
+    uint32_t object;
+    uint32_t start, end;          // byte offsets in the object's code
+    std::string name;             // first global symbol, or the object path; blocks
+                                  // cut at a local label are "function.label"
+    uint32_t function = 0;        // atom that starts the enclosing function
+    bool fallsThrough = false;    // last word is not JMP/RET: runs into the next atom
+    bool live = true;
+    uint32_t foldedInto = 0;      // own index unless folded by ICF
+    uint32_t address = 0;
+};
+
+// A resolved relocation target: an atom and a byte offset into it
+struct Target {
+    uint32_t atom = 0;
+    uint32_t delta = 0;
+    bool resolved = false;
+    int32_t import = -1;          // PLT entry, for symbols bound to a shared library
+};
+
+const int32_t IMPORT_PENDING = -2;
+
+// Export table of a shared library image (Object_Format.h)
+struct LibraryImage {
+    std::string path;
+    uint32_t base = 0;
+    uint32_t textSize = 0;
+    uint32_t textOffset = 0;      // file offset of the text words
+    std::unordered_map<std::string, uint32_t> exports;
+};
+
+// Parse an ALIB image from memory. The linker needs only the exports; the
+// loader also copies the text from textOffset.
+static bool parseLibrary(const uint8_t* data, size_t size, LibraryImage& lib, std::string& error) {
+    if (size < 4 * LIBRARY_HEADER_WORDS || readBE32(data) != LIBRARY_MAGIC || readBE32(data + 4) != LIBRARY_VERSION) {
+        error = "not a shared library";
+        return false;
+    }
+    lib.base = readBE32(data + 8);
+    lib.textSize = readBE32(data + 12);
+    uint64_t exportCount = readBE32(data + 16), stringSize = readBE32(data + 20);
+    uint64_t exportsAt = 4 * LIBRARY_HEADER_WORDS, stringsAt = exportsAt + 8 * exportCount;
+    uint64_t textAt = stringsAt + stringSize;
+    if (textAt + lib.textSize > size || lib.textSize % 4 != 0) {
+        error = "truncated shared library";
+        return false;
+    }
+    lib.textOffset = (uint32_t)textAt;
+    const char* strings = reinterpret_cast<const char*>(data + stringsAt);
+    for (uint64_t i = 0; i < exportCount; i++) {
+        uint32_t name = readBE32(data + exportsAt + 8 * i);
+        if (name >= stringSize) continue;
+        lib.exports[std::string(strings + name, strnlen(strings + name, stringSize - name))] =
+            readBE32(data + exportsAt + 8 * i + 4);
+    }
+    return true;
+}
+
+// Read a whole file through a private read-only mapping.
+template <typename F>
+static bool withMappedFile(const std::string& path, std::string& error, F use) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        error = "empty file";
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        error = "cannot map";
+        return false;
+    }
+    bool ok = use(static_cast<const uint8_t*>(map), size);
+    munmap(map, size);
+    return ok;
+}
+
+// Execution profile for profile-guided layout, keyed by atom name. Text,
+// one record per line:
+//   block <name> <count>              times the block was entered
+//   call <function> <count>           times the function was called
+//   edge <caller> <callee> <count>    calls from one function to another
+struct Profile {
+    std::unordered_map<std::string, uint64_t> blocks;
+    std::unordered_map<std::string, uint64_t> calls;
+    std::map<std::pair<std::string, std::string>, uint64_t> edges;
+
+    bool empty() const { return blocks.empty(); }
+
+    bool read(const std::string& path, std::string& error) {
+        std::ifstream in(path);
+        if (!in) {
+            error = "cannot open";
+            return false;
+        }
+        std::string kind, name, callee;
+        uint64_t count;
+        for (size_t line = 1; in >> kind; line++) {
+            bool ok = false;
+            if (kind == "block") ok = (bool)(in >> name >> count) && (blocks[name] += count, true);
+            else if (kind == "call") ok = (bool)(in >> name >> count) && (calls[name] += count, true);
+            else if (kind == "edge") ok = (bool)(in >> name >> callee >> count) && (edges[{name, callee}] += count, true);
+            if (!ok) {
+                error = "malformed record " + std::to_string(line);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool write(const std::string& path) const {
+        std::map<std::string, uint64_t> sortedBlocks(blocks.begin(), blocks.end());
+        std::map<std::string, uint64_t> sortedCalls(calls.begin(), calls.end());
+        std::ofstream out(path);
+        for (const auto& b : sortedBlocks) out << "block " << b.first << " " << b.second << "\n";
+        for (const auto& c : sortedCalls) out << "call " << c.first << " " << c.second << "\n";
+        for (const auto& e : edges) out << "edge " << e.first.first << " " << e.first.second << " " << e.second << "\n";
+        return (bool)out;
+    }
+};
+
+const uint32_t ICACHE_LINE = 64;          // guest I-cache line, for the layout report
+const uint32_t CLUSTER_LIMIT = 4096;      // call-chain clusters stop growing at a page
+
+struct LayoutReport {
+    uint32_t hotBytes = 0, coldBytes = 0;
+    uint32_t linesBefore = 0, linesAfter = 0;  // I-cache lines holding executed code
+    size_t clusters = 0;
+};
+
+struct LinkSavings {
+    uint32_t gcBytes = 0;         // unreachable code dropped
+    uint32_t icfBytes = 0;        // code folded into an identical copy
 };
 
 // Linker class to link object files into an executable
+//
+// Linking runs in phases, parallel across the thread pool where the work
+// is per object or per shard:
+//  1. symbol collection: each object buckets its global definitions by
+//     shard, then each shard is filled from every object in command-line
+//     order, so the first definition wins deterministically;
+//  2. atoms and relocation targets: each object is cut into atoms and
+//     every relocation is resolved to (atom, offset);
+//  3. optional section GC (reachability from the entry symbol over
+//     relocation and fall-through edges) and identical code folding;
+//  4. layout: live atoms get addresses in `order`, and the output buffer is
+//     allocated once;
+//  5. copy + relocation: each object copies its live atoms into place and
+//     patches them.
+// Diagnostics are kept per task and merged in object order, so output and
+// messages do not depend on the number of threads.
 class Linker {
 public:
-    std::vector<std::string> finalCode;  // Merged and relocated code
+    std::vector<uint32_t> finalCode;    // Merged and relocated code
     std::vector<uint32_t> finalData;    // Merged data
-    std::map<std::string, Symbol> finalSymbols;  // Final symbol table
+    SymbolTable finalSymbols;           // Global definitions
+    std::vector<std::string> errors;    // Load, duplicate and undefined symbol diagnostics
+    uint32_t textBase = 0x1000;         // Code is linked to start here
+    size_t relocationCount = 0;
+    bool gcSections = false;            // drop atoms unreachable from the entry
+    bool foldIdentical = false;         // fold byte-identical atoms
+    std::vector<Atom> atoms;
+    std::vector<LinkSavings> savings;   // per object
+    bool shared = false;                // build a shared library: export every global
+    std::vector<LibraryImage> libraries;  // resolve leftovers against these, through the PLT
+    std::vector<std::string> imports;   // PLT entry k binds imports[k]
+    uint32_t pltAddress = 0;
+    bool splitBlocks = false;           // also cut atoms at local labels (basic blocks)
+    Profile profile;                    // non-empty: lay out by profile (implies splitBlocks)
+    LayoutReport layoutReport;
+
+    bool addLibrary(const std::string& path) {
+        LibraryImage lib;
+        lib.path = path;
+        std::string error;
+        if (!withMappedFile(path, error, [&](const uint8_t* data, size_t size) {
+                return parseLibrary(data, size, lib, error);
+            })) {
+            errors.push_back(path + ": " + error);
+            return false;
+        }
+        libraries.push_back(std::move(lib));
+        return true;
+    }
 
-    void link(const std::vector<ObjectFile>& objectFiles) {
-        uint32_t currentAddress = 0x1000;  // Start at a fixed address (e.g., 0x1000 for code section)
+    explicit Linker(unsigned threads = 1) : pool(std::max(1u, threads)) {}
 
-        // Iterate over each object file to combine code, resolve symbols, and relocate
-        for (const auto& objFile : objectFiles) {
-            // Resolve symbols and relocate code
-            for (const auto& code : objFile.codeSection) {
-                std::string resolvedCode = resolveSymbols(code, objFile.symbolTable);
-                finalCode.push_back(resolvedCode);
-                currentAddress += 4;  // Assuming each instruction is 4 bytes
+    // Read object files in parallel. Returns false if any failed to load.
+    bool load(const std::vector<std::string>& paths, std::vector<ObjectFile>& objectFiles) {
+        objectFiles.assign(paths.size(), ObjectFile());
+        std::vector<std::string> loadErrors(paths.size());
+        pool.forEach(paths.size(), [&](size_t i) {
+            if (!objectFiles[i].load(paths[i], loadErrors[i])) loadErrors[i] = paths[i] + ": " + loadErrors[i];
+        });
+        for (auto& error : loadErrors) {
+            if (!error.empty()) errors.push_back(std::move(error));
+        }
+        return errors.empty();
+    }
+
+    // Returns false (with errors filled in) if the objects cannot be linked.
+    bool link(const std::vector<ObjectFile>& objectFiles) {
+        size_t count = objectFiles.size();
+        if (!profile.empty()) splitBlocks = true;
+
+        // Symbol collection: global definitions bucketed by shard
+        std::vector<std::vector<std::vector<uint32_t>>> byShard(count);
+        pool.forEach(count, [&](size_t i) {
+            byShard[i].resize(SymbolTable::SHARDS);
+            const auto& symbols = objectFiles[i].symbols;
+            for (uint32_t s = 0; s < symbols.size(); s++) {
+                if (symbols[s].isDefined && symbols[s].isGlobal && !symbols[s].isSection) {
+                    byShard[i][SymbolTable::shardOf(symbols[s].name)].push_back(s);
+                }
+            }
+        });
+
+        // Fill each shard in object order; later definitions are duplicates.
+        // Addresses stay object-relative until layout.
+        struct Located {
+            size_t object;
+            uint32_t symbol;
+            std::string message;
+        };
+        std::vector<std::vector<Located>> duplicates(SymbolTable::SHARDS);
+        pool.forEach(SymbolTable::SHARDS, [&](size_t s) {
+            auto& table = finalSymbols.shard(s);
+            for (size_t i = 0; i < count; i++) {
+                for (uint32_t index : byShard[i][s]) {
+                    const Symbol& symbol = objectFiles[i].symbols[index];
+                    Symbol global = symbol;
+                    global.object = (int)i;
+                    auto inserted = table.emplace(symbol.name, std::move(global));
+                    if (!inserted.second) {
+                        duplicates[s].push_back({i, index, "duplicate symbol '" + symbol.name + "' in " +
+                                                 objectFiles[i].path + " (first defined in " +
+                                                 objectFiles[inserted.first->second.object].path + ")"});
+                    }
+                }
+            }
+        });
+        std::vector<Located> duplicateList;
+        for (auto& list : duplicates) {
+            for (auto& d : list) duplicateList.push_back(std::move(d));
+        }
+        std::sort(duplicateList.begin(), duplicateList.end(), [](const Located& a, const Located& b) {
+            return a.object != b.object ? a.object < b.object : a.symbol < b.symbol;
+        });
+        for (auto& d : duplicateList) errors.push_back(std::move(d.message));
+
+        // Atoms
+        std::vector<std::vector<Atom>> objectAtoms(count);
+        pool.forEach(count, [&](size_t i) { objectAtoms[i] = splitAtoms(objectFiles[i], (uint32_t)i); });
+        atomBegin.assign(count + 1, 0);
+        for (size_t i = 0; i < count; i++) atomBegin[i + 1] = atomBegin[i] + (uint32_t)objectAtoms[i].size();
+        atoms.clear();
+        atoms.reserve(atomBegin[count]);
+        for (size_t i = 0; i < count; i++) {
+            for (auto& atom : objectAtoms[i]) {
+                atom.foldedInto = (uint32_t)atoms.size();
+                atom.function += atomBegin[i];
+                atoms.push_back(std::move(atom));
             }
+        }
+
+        // Relocation targets, in offset order per object
+        relocOrder.assign(count, {});
+        relocAtom.assign(count, {});
+        targets.assign(count, {});
+        std::vector<std::vector<std::pair<uint32_t, std::string>>> unresolved(count);
+        pool.forEach(count, [&](size_t i) { resolveTargets(objectFiles, i, unresolved[i]); });
+
+        if (gcSections) collectGarbage();
 
-            // Merge data and symbols
-            for (const auto& data : objFile.dataSection) {
-                finalData.push_back(data);
+        // Number the imports used by live code, in object order
+        std::unordered_map<std::string, int32_t> importIndex;
+        imports.clear();
+        for (size_t i = 0; i < count; i++) {
+            for (uint32_t k = 0; k < relocOrder[i].size(); k++) {
+                Target& target = targets[i][k];
+                if (target.import != IMPORT_PENDING || !atoms[relocAtom[i][k]].live) continue;
+                const std::string& name = objectFiles[i].symbols[objectFiles[i].relocations[relocOrder[i][k]].symbol].name;
+                auto inserted = importIndex.emplace(name, (int32_t)imports.size());
+                if (inserted.second) imports.push_back(name);
+                target.import = inserted.first->second;
             }
+        }
+
+        if (foldIdentical) foldIdenticalAtoms(objectFiles);
 
-            for (const auto& symbol : objFile.symbolTable) {
-                if (!symbol.second.isDefined) {
-                    // Relocate symbol address in the final symbol table
-                    finalSymbols[symbol.first] = {symbol.first, currentAddress};
-                    currentAddress += 4;  // Assuming 4 bytes for each variable
+        // Layout
+        if (!profile.empty()) orderByProfile();
+        if (order.size() != atoms.size()) {
+            order.resize(atoms.size());
+            for (uint32_t a = 0; a < atoms.size(); a++) order[a] = a;
+        }
+        uint32_t cursor = textBase;
+        for (uint32_t a : order) {
+            Atom& atom = atoms[a];
+            if (!atom.live || atom.foldedInto != a) continue;
+            atom.address = cursor;
+            cursor += atom.end - atom.start;
+        }
+        pltAddress = cursor;  // the PLT opens the data segment
+        if (!profile.empty()) layoutReport.linesAfter = hotLines(order);
+        savings.assign(count, LinkSavings());
+        for (uint32_t a = 0; a < atoms.size(); a++) {
+            Atom& atom = atoms[a];
+            if (!atom.live) savings[atom.object].gcBytes += atom.end - atom.start;
+            else if (atom.foldedInto != a) {
+                atom.address = atoms[atom.foldedInto].address;
+                savings[atom.object].icfBytes += atom.end - atom.start;
+            }
+        }
+
+        // Final symbol addresses; symbols in dropped atoms go away
+        pool.forEach(SymbolTable::SHARDS, [&](size_t s) {
+            auto& table = finalSymbols.shard(s);
+            for (auto it = table.begin(); it != table.end();) {
+                uint32_t a = atomAt(it->second.object, it->second.address);
+                if (!atoms[a].live) {
+                    it = table.erase(it);
+                    continue;
                 }
+                it->second.address = atoms[a].address + (it->second.address - atoms[a].start);
+                ++it;
+            }
+        });
+
+        // Copy and relocate each object's live atoms into place
+        std::vector<size_t> dataBase(count);
+        size_t dataSize = imports.size();
+        for (size_t i = 0; i < count; i++) {
+            dataBase[i] = dataSize;
+            dataSize += objectFiles[i].dataSection.size();
+        }
+        finalCode.assign((cursor - textBase) / 4, 0);
+        finalData.assign(dataSize, 0);
+        for (uint32_t k = 0; k < imports.size(); k++) finalData[k] = pltBindWord(k);
+        std::vector<std::vector<std::string>> objectErrors(count);
+        pool.forEach(count, [&](size_t i) {
+            const ObjectFile& objFile = objectFiles[i];
+            std::copy(objFile.dataSection.begin(), objFile.dataSection.end(), finalData.begin() + dataBase[i]);
+            for (uint32_t a = atomBegin[i]; a < atomBegin[i + 1]; a++) {
+                const Atom& atom = atoms[a];
+                if (!atom.live || atom.foldedInto != a) continue;
+                std::copy(objFile.codeSection.begin() + atom.start / 4, objFile.codeSection.begin() + atom.end / 4,
+                          finalCode.begin() + (atom.address - textBase) / 4);
+            }
+            for (uint32_t k = 0; k < relocOrder[i].size(); k++) {
+                const Atom& atom = atoms[relocAtom[i][k]];
+                if (!atom.live || atom.foldedInto != relocAtom[i][k]) continue;
+                const Relocation& rel = objFile.relocations[relocOrder[i][k]];
+                const Target& target = targets[i][k];
+                if (!target.resolved && target.import < 0) continue;
+                uint32_t value = target.resolved ? atoms[target.atom].address + target.delta
+                                                 : pltAddress + 4 * (uint32_t)target.import;
+                if (rel.type == RELOC_ABS16 && value > 0xFFFF) {
+                    objectErrors[i].push_back(objFile.path + ": relocation against '" +
+                                              objFile.symbols[rel.symbol].name + "' out of 16-bit range");
+                    continue;
+                }
+                applyRelocation(finalCode[(atom.address + rel.offset - atom.start - textBase) / 4], rel.type, value);
+            }
+        });
+        for (size_t i = 0; i < count; i++) {
+            relocationCount += objectFiles[i].relocations.size();
+            for (const auto& u : unresolved[i]) {
+                if (atoms[u.first].live) errors.push_back(u.second);
+            }
+            for (auto& error : objectErrors[i]) errors.push_back(std::move(error));
+        }
+        return errors.empty();
+    }
+
+    // Atom layout order; empty means input order. Set before link().
+    std::vector<uint32_t> order;
+
+    // Write the linked program as an ABIN image loading at textBase:
+    // version 2, or version 3 with the dynamic block if it imports from
+    // shared libraries. The entry point is "main" if defined, else the
+    // first word.
+    bool writeExecutable(const std::string& path) const {
+        return writeBytes(path, executableImage());
+    }
+
+    // The bytes writeExecutable would write
+    std::vector<uint8_t> executableImage() const {
+        const Symbol* main = finalSymbols.find("main");
+        std::vector<uint32_t> header = {IMAGE_MAGIC, imports.empty() ? IMAGE_VERSION_BASED : IMAGE_VERSION_DYNAMIC,
+                                        main ? main->address : textBase, (uint32_t)finalCode.size() * 4,
+                                        (uint32_t)finalData.size() * 4, 0, textBase};
+        std::string dynamic;
+        if (!imports.empty()) {
+            for (const LibraryImage& lib : libraries) dynamic += lib.path + '\0';
+            for (const std::string& name : imports) dynamic += name + '\0';
+            dynamic.resize((dynamic.size() + 3) & ~(size_t)3, '\0');
+            header.insert(header.end(), {pltAddress, (uint32_t)libraries.size(), (uint32_t)imports.size(),
+                                         (uint32_t)dynamic.size()});
+        }
+        return serialize(header, {&finalCode, &finalData}, dynamic);
+    }
+
+    // Turn per-word execution counts of the linked text and (call site,
+    // target) counts from a Loader run into a Profile keyed by atom name.
+    bool writeProfile(const std::string& path, const std::vector<uint64_t>& wordCounts,
+                      const std::map<std::pair<uint32_t, uint32_t>, uint64_t>& callCounts) const {
+        Profile out;
+        std::map<uint32_t, uint32_t> byAddress;  // placed atoms
+        for (uint32_t a = 0; a < atoms.size(); a++) {
+            const Atom& atom = atoms[a];
+            if (!atom.live || atom.foldedInto != a || atom.end == atom.start) continue;
+            byAddress[atom.address] = a;
+            size_t word = (atom.address - textBase) / 4;
+            if (word < wordCounts.size() && wordCounts[word] > 0) out.blocks[atom.name] = wordCounts[word];
+        }
+        auto atomAtAddress = [&](uint32_t address) -> const Atom* {
+            auto it = byAddress.upper_bound(address);
+            if (it == byAddress.begin()) return nullptr;
+            const Atom& atom = atoms[(--it)->second];
+            return address < atom.address + (atom.end - atom.start) ? &atom : nullptr;
+        };
+        for (const auto& call : callCounts) {
+            const Atom* site = atomAtAddress(call.first.first);
+            const Atom* target = atomAtAddress(call.first.second);
+            if (!site || !target) continue;  // into a shared library
+            const std::string& caller = atoms[site->function].name;
+            const std::string& callee = atoms[target->function].name;
+            out.calls[callee] += call.second;
+            out.edges[{caller, callee}] += call.second;
+        }
+        return out.write(path);
+    }
+
+    // Write a shared library (ALIB) exporting every global symbol.
+    bool writeLibrary(const std::string& path) const {
+        std::vector<std::pair<std::string, uint32_t>> exports;
+        for (size_t s = 0; s < SymbolTable::SHARDS; s++) {
+            for (const auto& entry : finalSymbols.shard(s)) {
+                exports.push_back({entry.first, entry.second.address});
             }
         }
+        std::sort(exports.begin(), exports.end());
+        std::string strings;
+        std::vector<uint32_t> table;
+        for (const auto& e : exports) {
+            table.push_back((uint32_t)strings.size());
+            table.push_back(e.second);
+            strings += e.first + '\0';
+        }
+        strings.resize((strings.size() + 3) & ~(size_t)3, '\0');
+        std::vector<uint32_t> header = {LIBRARY_MAGIC, LIBRARY_VERSION, textBase, (uint32_t)finalCode.size() * 4,
+                                        (uint32_t)exports.size(), (uint32_t)strings.size()};
+        header.insert(header.end(), table.begin(), table.end());
+        std::vector<uint32_t> text = finalCode;
+        return writeBytes(path, serialize(header, {}, strings, &text));
     }
 
 private:
-    std::string resolveSymbols(const std::string& code, const std::map<std::string, Symbol>& symbolTable) {
-        // Resolve any symbols in the code
-        std::string resolvedCode = code;
-        for (const auto& symbol : symbolTable) {
-            size_t pos = resolvedCode.find(symbol.first);
-            if (pos != std::string::npos) {
-                // Replace the symbol with its address
-                resolvedCode.replace(pos, symbol.first.length(), std::to_string(symbol.second.address));
+    ThreadPool pool;
+
+    // Big-endian words of `header`, then `sections`, then raw `tail` bytes,
+    // then the `after` words.
+    static std::vector<uint8_t> serialize(const std::vector<uint32_t>& header,
+                                          std::initializer_list<const std::vector<uint32_t>*> sections,
+                                          const std::string& tail, const std::vector<uint32_t>* after = nullptr) {
+        std::vector<uint8_t> bytes;
+        auto put = [&](uint32_t w) {
+            uint8_t b[4] = {(uint8_t)(w >> 24), (uint8_t)(w >> 16), (uint8_t)(w >> 8), (uint8_t)w};
+            bytes.insert(bytes.end(), b, b + 4);
+        };
+        for (uint32_t w : header) put(w);
+        for (const auto* section : sections) {
+            for (uint32_t w : *section) put(w);
+        }
+        bytes.insert(bytes.end(), tail.begin(), tail.end());
+        if (after) {
+            for (uint32_t w : *after) put(w);
+        }
+        return bytes;
+    }
+
+    static bool writeBytes(const std::string& path, const std::vector<uint8_t>& bytes) {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+        return (bool)out;
+    }
+
+    bool exportedByLibrary(const std::string& name) const {
+        for (const LibraryImage& lib : libraries) {
+            if (lib.exports.count(name)) return true;
+        }
+        return false;
+    }
+
+    std::vector<uint32_t> atomBegin;                 // first atom of each object
+    std::vector<std::vector<uint32_t>> relocOrder;   // relocation indices sorted by offset
+    std::vector<std::vector<uint32_t>> relocAtom;    // atom holding each of those
+    std::vector<std::vector<Target>> targets;        // and what it points at
+
+    std::vector<Atom> splitAtoms(const ObjectFile& objFile, uint32_t object) const {
+        uint32_t size = (uint32_t)objFile.codeSection.size() * 4;
+        std::vector<std::pair<uint32_t, const Symbol*>> cuts = {{0, nullptr}};
+        if (gcSections || foldIdentical || splitBlocks) {
+            for (const Symbol& symbol : objFile.symbols) {
+                if (symbol.isDefined && (symbol.isGlobal || splitBlocks) && !symbol.isSection && symbol.address < size) {
+                    cuts.push_back({symbol.address, &symbol});
+                }
             }
+            // Stable: at offset 0 a symbol name replaces the object path;
+            // globals sort before local labels at the same offset
+            std::stable_sort(cuts.begin() + 1, cuts.end(), [](const auto& a, const auto& b) {
+                return a.first != b.first ? a.first < b.first : a.second->isGlobal > b.second->isGlobal;
+            });
+        }
+        std::vector<Atom> list;
+        const std::string* function = &objFile.path;
+        for (const auto& cut : cuts) {
+            bool global = cut.second && cut.second->isGlobal;
+            if (global) function = &cut.second->name;
+            if (!list.empty() && list.back().start == cut.first) {
+                if (global && list.back().name == objFile.path) list.back().name = *function;
+                continue;
+            }
+            Atom atom;
+            atom.object = object;
+            atom.start = cut.first;
+            atom.name = !cut.second ? objFile.path : global ? *function : *function + cut.second->name;
+            atom.function = global || list.empty() ? (uint32_t)list.size() : list.back().function;
+            list.push_back(std::move(atom));
+        }
+        for (size_t k = 0; k < list.size(); k++) {
+            Atom& atom = list[k];
+            atom.end = k + 1 < list.size() ? list[k + 1].start : size;
+            if (atom.end > atom.start) {
+                uint32_t last = objFile.codeSection[atom.end / 4 - 1] >> 28;
+                atom.fallsThrough = last != 0x4 && last != 0x6 && k + 1 < list.size();  // not JMP/RET
+            }
+        }
+        return list;
+    }
+
+    // Execution count of an atom under the profile
+    uint64_t entered(uint32_t a) const {
+        auto it = profile.blocks.find(atoms[a].name);
+        return it == profile.blocks.end() ? 0 : it->second;
+    }
+
+    // I-cache lines covered by executed atoms when laid out in `layoutOrder`
+    uint32_t hotLines(const std::vector<uint32_t>& layoutOrder) const {
+        uint32_t cursor = textBase, lines = 0, lastLine = ~0u;
+        for (uint32_t a : layoutOrder) {
+            const Atom& atom = atoms[a];
+            if (!atom.live || atom.foldedInto != a) continue;
+            uint32_t size = atom.end - atom.start;
+            if (size > 0 && entered(a) > 0) {
+                uint32_t first = cursor / ICACHE_LINE, last = (cursor + size - 1) / ICACHE_LINE;
+                lines += last - first + 1 - (first == lastLine ? 1 : 0);
+                lastLine = last;
+            }
+            cursor += size;
+        }
+        return lines;
+    }
+
+    // Profile-guided layout. Atoms joined by fall-through form chains,
+    // which move as a unit. Chains that never ran go to a cold section at
+    // the end of the text. The hot chains of each function are clustered
+    // by call-chain clustering (C3): functions are visited hottest first
+    // and each is appended to the cluster of its most frequent caller
+    // while that stays within CLUSTER_LIMIT bytes; clusters are then
+    // ordered by density (executed instructions per byte). The entry
+    // function is never moved behind another.
+    void orderByProfile() {
+        std::vector<uint32_t> input(atoms.size());
+        for (uint32_t a = 0; a < atoms.size(); a++) input[a] = a;
+        layoutReport = LayoutReport();
+        layoutReport.linesBefore = hotLines(input);
+
+        struct Chain {
+            uint32_t first, last;  // atom range, inclusive
+            bool hot = false;
+        };
+        struct Function {
+            std::vector<uint32_t> chains;  // hot chains, in input order
+            uint64_t weight = 0;           // executed instructions
+            uint32_t size = 0;
+            uint32_t cluster = 0;
+        };
+        std::vector<Chain> chains;
+        std::map<uint32_t, Function> functions;  // by entry atom
+        for (uint32_t a = 0; a < atoms.size(); a++) {
+            if (a == 0 || !atoms[a - 1].fallsThrough) chains.push_back({a, a});
+            Chain& chain = chains.back();
+            chain.last = a;
+            const Atom& atom = atoms[a];
+            if (!atom.live || atom.foldedInto != a) continue;
+            uint64_t count = entered(a);
+            uint32_t size = atom.end - atom.start;
+            chain.hot |= count > 0;
+            Function& f = functions[atoms[chain.first].function];
+            f.weight += count * (size / 4);
+            f.size += size;
+            (count > 0 ? layoutReport.hotBytes : layoutReport.coldBytes) += size;
+        }
+        const Symbol* main = finalSymbols.find("main");
+        uint32_t entry = atoms[main ? atomAt(main->object, main->address) : 0].function;
+        for (uint32_t c = 0; c < chains.size(); c++) {
+            if (chains[c].first <= entry && entry <= chains[c].last) chains[c].hot = true;  // stays in front
+            if (chains[c].hot) functions[atoms[chains[c].first].function].chains.push_back(c);
+        }
+
+        // One cluster per hot function
+        std::unordered_map<std::string, uint32_t> byName;
+        std::vector<std::vector<uint32_t>> clusters;
+        std::vector<uint32_t> clusterSize;
+        std::vector<uint64_t> clusterWeight;
+        std::vector<uint32_t> hottest;
+        for (auto& entryAndFunction : functions) {
+            Function& f = entryAndFunction.second;
+            if (f.chains.empty()) continue;
+            byName[atoms[entryAndFunction.first].name] = entryAndFunction.first;
+            f.cluster = (uint32_t)clusters.size();
+            clusters.push_back({entryAndFunction.first});
+            clusterSize.push_back(f.size);
+            clusterWeight.push_back(f.weight);
+            hottest.push_back(entryAndFunction.first);
+        }
+        std::stable_sort(hottest.begin(), hottest.end(),
+                         [&](uint32_t a, uint32_t b) { return functions[a].weight > functions[b].weight; });
+
+        // Most frequent hot caller of each function
+        std::unordered_map<uint32_t, std::pair<uint32_t, uint64_t>> topCaller;
+        for (const auto& edge : profile.edges) {
+            auto caller = byName.find(edge.first.first), callee = byName.find(edge.first.second);
+            if (caller == byName.end() || callee == byName.end() || caller->second == callee->second) continue;
+            auto& top = topCaller[callee->second];
+            if (edge.second > top.second) top = {caller->second, edge.second};
+        }
+        for (uint32_t f : hottest) {
+            auto top = topCaller.find(f);
+            if (top == topCaller.end()) continue;
+            uint32_t from = functions[f].cluster, to = functions[top->second.first].cluster;
+            if (from == to || clusters[from].front() == entry || clusterSize[from] + clusterSize[to] > CLUSTER_LIMIT) {
+                continue;
+            }
+            for (uint32_t member : clusters[from]) {
+                functions[member].cluster = to;
+                clusters[to].push_back(member);
+            }
+            clusters[from].clear();
+            clusterSize[to] += clusterSize[from];
+            clusterWeight[to] += clusterWeight[from];
+        }
+
+        std::vector<uint32_t> clusterOrder;
+        for (uint32_t c = 0; c < clusters.size(); c++) {
+            if (!clusters[c].empty()) clusterOrder.push_back(c);
+        }
+        std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint32_t a, uint32_t b) {
+            bool entryA = clusters[a].front() == entry, entryB = clusters[b].front() == entry;
+            if (entryA != entryB) return entryA;
+            return (double)clusterWeight[a] / std::max(1u, clusterSize[a]) >
+                   (double)clusterWeight[b] / std::max(1u, clusterSize[b]);
+        });
+        layoutReport.clusters = clusterOrder.size();
+
+        // Hot text by cluster, then the cold chains, then the atoms that
+        // are not laid out at all
+        order.clear();
+        std::vector<uint8_t> placed(atoms.size(), 0);
+        auto place = [&](const Chain& chain) {
+            for (uint32_t a = chain.first; a <= chain.last; a++) {
+                order.push_back(a);
+                placed[a] = 1;
+            }
+        };
+        for (uint32_t c : clusterOrder) {
+            for (uint32_t f : clusters[c]) {
+                for (uint32_t chain : functions[f].chains) place(chains[chain]);
+            }
+        }
+        for (const Chain& chain : chains) {
+            if (!chain.hot) place(chain);
+        }
+    }
+
+    // Atom of `object` containing byte `offset` (an offset equal to the end
+    // of the code belongs to the last atom).
+    uint32_t atomAt(size_t object, uint32_t offset) const {
+        auto first = atoms.begin() + atomBegin[object], last = atoms.begin() + atomBegin[object + 1];
+        auto it = std::upper_bound(first, last, offset, [](uint32_t off, const Atom& a) { return off < a.start; });
+        return (uint32_t)(it - atoms.begin()) - 1;
+    }
+
+    // Resolve object i's relocations to atom targets. Undefined symbols are
+    // recorded against the referencing atom and reported only if it is live.
+    void resolveTargets(const std::vector<ObjectFile>& objectFiles, size_t i,
+                        std::vector<std::pair<uint32_t, std::string>>& unresolved) {
+        const ObjectFile& objFile = objectFiles[i];
+        std::vector<uint32_t>& sorted = relocOrder[i];
+        sorted.resize(objFile.relocations.size());
+        for (uint32_t k = 0; k < sorted.size(); k++) sorted[k] = k;
+        std::stable_sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+            return objFile.relocations[a].offset < objFile.relocations[b].offset;
+        });
+        relocAtom[i].resize(sorted.size());
+        targets[i].resize(sorted.size());
+        std::vector<uint8_t> reported(objFile.symbols.size(), 0);
+        for (uint32_t k = 0; k < sorted.size(); k++) {
+            const Relocation& rel = objFile.relocations[sorted[k]];
+            const Symbol& symbol = objFile.symbols[rel.symbol];
+            relocAtom[i][k] = atomAt(i, rel.offset);
+            size_t object = i;
+            uint32_t offset = symbol.address;
+            if (!symbol.isDefined) {
+                const Symbol* global = finalSymbols.find(symbol.name);
+                if (!global && !shared && exportedByLibrary(symbol.name)) {
+                    targets[i][k].import = IMPORT_PENDING;
+                    continue;
+                }
+                if (!global) {
+                    if (!reported[rel.symbol]) {
+                        reported[rel.symbol] = 1;
+                        unresolved.push_back({relocAtom[i][k], "undefined symbol '" + symbol.name +
+                                                                   "' referenced from " + objFile.path});
+                    }
+                    continue;
+                }
+                object = (size_t)global->object;
+                offset = global->address;
+            }
+            offset += (uint32_t)rel.addend;
+            uint32_t a = atomAt(object, offset);
+            targets[i][k] = {a, offset - atoms[a].start, true};
         }
-        return resolvedCode;
     }
+
+    // Mark atoms reachable from the entry ("main", else the first atom),
+    // or from every export of a shared library, through relocations and
+    // fall-through; the rest are dropped.
+    void collectGarbage() {
+        if (atoms.empty()) return;
+        for (Atom& atom : atoms) atom.live = false;
+        std::vector<uint32_t> work;
+        auto mark = [&](uint32_t a) {
+            if (!atoms[a].live) {
+                atoms[a].live = true;
+                work.push_back(a);
+            }
+        };
+        if (shared) {
+            for (size_t s = 0; s < SymbolTable::SHARDS; s++) {
+                for (const auto& entry : finalSymbols.shard(s)) mark(atomAt(entry.second.object, entry.second.address));
+            }
+        } else {
+            const Symbol* main = finalSymbols.find("main");
+            mark(main ? atomAt(main->object, main->address) : 0);
+        }
+        while (!work.empty()) {
+            uint32_t a = work.back();
+            work.pop_back();
+            const Atom& atom = atoms[a];
+            if (atom.fallsThrough) mark(a + 1);
+            const auto& sorted = relocOrder[atom.object];
+            const auto& holder = relocAtom[atom.object];
+            auto first = std::lower_bound(holder.begin(), holder.end(), a) - holder.begin();
+            for (size_t k = first; k < sorted.size() && holder[k] == a; k++) {
+                if (targets[atom.object][k].resolved) mark(targets[atom.object][k].atom);
+            }
+        }
+    }
+
+    // Fold live atoms whose words and relocation targets are identical.
+    // Atoms joined by fall-through keep their own copy. Equivalence classes
+    // start from the words and are refined through the targets' classes
+    // until nothing changes; each class keeps its first atom.
+    void foldIdenticalAtoms(const std::vector<ObjectFile>& objectFiles) {
+        size_t n = atoms.size();
+        std::vector<uint8_t> eligible(n, 0);
+        for (uint32_t a = 0; a < n; a++) {
+            const Atom& atom = atoms[a];
+            bool fallenInto = a > 0 && atoms[a - 1].object == atom.object && atoms[a - 1].fallsThrough;
+            eligible[a] = atom.live && atom.end > atom.start && !atom.fallsThrough && !fallenInto;
+        }
+        std::vector<uint32_t> cls(n);
+        for (uint32_t a = 0; a < n; a++) cls[a] = a;
+        for (int round = 0; round < 16; round++) {
+            std::map<std::vector<uint32_t>, uint32_t> classes;
+            std::vector<uint32_t> next = cls;
+            for (uint32_t a = 0; a < n; a++) {
+                if (!eligible[a]) continue;
+                auto inserted = classes.emplace(signature(objectFiles, a, cls), a);
+                next[a] = inserted.first->second;
+            }
+            if (next == cls) break;
+            cls.swap(next);
+        }
+        for (uint32_t a = 0; a < n; a++) atoms[a].foldedInto = cls[a];
+    }
+
+    // Words with relocated fields masked, then each relocation's position,
+    // type and target class (self references compare equal).
+    std::vector<uint32_t> signature(const std::vector<ObjectFile>& objectFiles, uint32_t a,
+                                    const std::vector<uint32_t>& cls) const {
+        const Atom& atom = atoms[a];
+        const ObjectFile& objFile = objectFiles[atom.object];
+        std::vector<uint32_t> sig(objFile.codeSection.begin() + atom.start / 4,
+                                  objFile.codeSection.begin() + atom.end / 4);
+        const auto& sorted = relocOrder[atom.object];
+        const auto& holder = relocAtom[atom.object];
+        auto first = std::lower_bound(holder.begin(), holder.end(), a) - holder.begin();
+        for (size_t k = first; k < sorted.size() && holder[k] == a; k++) {
+            const Relocation& rel = objFile.relocations[sorted[k]];
+            const Target& target = targets[atom.object][k];
+            uint32_t& word = sig[(rel.offset - atom.start) / 4];
+            word = rel.type == RELOC_ABS16 ? word & ~(0xFFFFu << 8) : 0;
+            uint32_t targetClass = target.import >= 0 ? 0xFFFFFFFD : !target.resolved ? 0xFFFFFFFE
+                                 : target.atom == a ? 0xFFFFFFFF : cls[target.atom];
+            uint32_t delta = target.import >= 0 ? (uint32_t)target.import : target.delta;
+            sig.insert(sig.end(), {rel.offset - atom.start, rel.type, targetClass, delta});
+        }
+        return sig;
+    }
+};
+
+//--------------------------------------
+// Demand-paged loader
+//--------------------------------------
+// The whole 32-bit guest address space is reserved PROT_NONE, so loading
+// costs the same whatever the image size: the image file is mmap'd and
+// the segment table recorded, nothing more. The first touch of a guest
+// page faults into loaderFaultHandler, which makes the page accessible
+// and fills it: text and data pages are decoded from the mapped file
+// (big-endian to host words), bss and stack pages are left as the zero
+// pages the kernel provides. Only touched pages become resident. Text is
+// read-only once populated. Below the stack sits a guard region that is
+// never populated, so running off the stack is a precise fault.
+const uint64_t LOADER_SPACE = 1ull << 32;
+const uint64_t STACK_TOP = LOADER_SPACE - 0x1000;  // initial SP; top page kept unmapped
+const uint64_t STACK_SIZE = 1 << 20;
+const uint64_t STACK_GUARD = 1 << 16;
+
+struct Segment {
+    uint64_t start, end;     // guest byte range
+    uint64_t fileOffset;     // ~0 for zero-filled (bss, stack)
+    bool writable;
 };
 
+// A shared library decoded once per host process into a shared memory
+// object; every Loader maps the same pages read-only at the library base.
+struct SharedLibrary {
+    LibraryImage image;
+    int fd = -1;
+    uint64_t mappedSize = 0;  // text size rounded up to whole pages
+
+    ~SharedLibrary() {
+        if (fd >= 0) close(fd);
+    }
+};
+
+static std::mutex sharedLibraryLock;
+static std::unordered_map<std::string, std::shared_ptr<SharedLibrary>> sharedLibraries;
+static std::atomic<size_t> sharedLibraryLoads{0};
+
+// Return the library at `path`, decoding it on first use.
+static std::shared_ptr<SharedLibrary> acquireLibrary(const std::string& path, uint64_t pageSize, std::string& error) {
+    std::lock_guard<std::mutex> guard(sharedLibraryLock);
+    auto it = sharedLibraries.find(path);
+    if (it != sharedLibraries.end()) return it->second;
+
+    auto lib = std::make_shared<SharedLibrary>();
+    lib->image.path = path;
+    bool ok = withMappedFile(path, error, [&](const uint8_t* data, size_t size) {
+        if (!parseLibrary(data, size, lib->image, error)) return false;
+        if (lib->image.base % pageSize != 0) {
+            error = "library base is not page aligned";
+            return false;
+        }
+        std::string name = "/atob-lib-" + std::to_string(getpid()) + "-" + std::to_string(sharedLibraries.size());
+        lib->fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (lib->fd < 0) {
+            error = "cannot create shared memory";
+            return false;
+        }
+        shm_unlink(name.c_str());
+        lib->mappedSize = std::max<uint64_t>(pageSize, (lib->image.textSize + pageSize - 1) / pageSize * pageSize);
+        if (ftruncate(lib->fd, (off_t)lib->mappedSize) != 0) {
+            error = "cannot size shared memory";
+            return false;
+        }
+        void* map = mmap(nullptr, lib->mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, lib->fd, 0);
+        if (map == MAP_FAILED) {
+            error = "cannot map shared memory";
+            return false;
+        }
+        uint32_t* dst = static_cast<uint32_t*>(map);
+        for (uint32_t off = 0; off < lib->image.textSize; off += 4) {
+            *dst++ = readBE32(data + lib->image.textOffset + off);
+        }
+        munmap(map, lib->mappedSize);
+        return true;
+    });
+    if (!ok) return nullptr;
+    sharedLibraryLoads++;
+    sharedLibraries[path] = lib;
+    return lib;
+}
+
+class Loader;
+static thread_local Loader* activeLoader = nullptr;
+static void loaderFaultHandler(int sig, siginfo_t* info, void* context);
+
 // Loader class to load the executable into memory and execute it
 class Loader {
 public:
-    std::vector<uint32_t> memory;  // Simulated memory
-    uint32_t PC;                   // Program counter
-    uint32_t stackPointer;         // Stack pointer
+    uint32_t PC = 0;                // Program counter (byte address)
+    uint32_t stackPointer = (uint32_t)STACK_TOP;
+    uint32_t registers[16] = {};
+    bool equalFlag = false;         // set by CMP, tested by JE
+    uint64_t instructions = 0;      // retired guest instructions
+    bool trace = false;             // print each instruction as it executes
+    size_t pagesPopulated = 0;
+    size_t bindings = 0;            // PLT entries resolved
+    uint64_t sharedBytes = 0;       // library text mapped from the process-wide copy
+    std::vector<std::shared_ptr<SharedLibrary>> libraries;
+    std::vector<std::string> imports;  // by PLT entry
+    bool profiling = false;            // count executions; set before load()
+    std::vector<uint64_t> wordCounts;  // per text word
+    std::map<std::pair<uint32_t, uint32_t>, uint64_t> callCounts;  // (call site, target)
+
+    Loader() {
+        pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+        void* p = mmap(nullptr, LOADER_SPACE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) throw std::runtime_error("cannot reserve guest address space");
+        base = static_cast<uint8_t*>(p);
+        populated.assign(LOADER_SPACE / pageSize, 0);
+        static bool installed = [] {
+            struct sigaction sa = {};
+            sa.sa_sigaction = loaderFaultHandler;
+            sa.sa_flags = SA_SIGINFO;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGSEGV, &sa, nullptr);
+            sigaction(SIGBUS, &sa, nullptr);  // macOS reports PROT_NONE hits as SIGBUS
+            return true;
+        }();
+        (void)installed;
+    }
+
+    ~Loader() {
+        munmap(base, LOADER_SPACE);
+        if (image && mappedImage) munmap(const_cast<uint8_t*>(image), imageSize);
+    }
 
-    Loader() : PC(0x1000), stackPointer(0x7fffc) {
-        memory.resize(0x10000, 0);  // 64KB of memory
+    Loader(const Loader&) = delete;
+    Loader& operator=(const Loader&) = delete;
+
+    // Map an ABIN image (Object_Format.h) and set up its segments.
+    bool load(const std::string& path, std::string& error) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open";
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)(4 * IMAGE_HEADER_WORDS)) {
+            close(fd);
+            error = "not an executable image";
+            return false;
+        }
+        imageSize = (size_t)st.st_size;
+        void* map = mmap(nullptr, imageSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            error = "cannot map";
+            return false;
+        }
+        image = static_cast<const uint8_t*>(map);
+        mappedImage = true;
+        return setUp(error);
     }
 
-    void loadExecutable(const std::vector<std::string>& code, const std::vector<uint32_t>& data) {
-        // Load the code section into memory
-        for (size_t i = 0; i < code.size(); ++i) {
-            memory[PC + i] = stringToInstruction(code[i]);  // Convert each assembly instruction to machine code
+    // Load an ABIN image that is already in memory. Pages are still filled
+    // from it on first touch, so it must outlive execute().
+    bool load(const uint8_t* data, size_t size, std::string& error) {
+        if (size < 4 * IMAGE_HEADER_WORDS) {
+            error = "not an executable image";
+            return false;
         }
+        image = data;
+        imageSize = size;
+        return setUp(error);
+    }
 
-        // Load the data section into memory
-        for (size_t i = 0; i < data.size(); ++i) {
-            memory[stackPointer + i] = data[i];  // Place data into the memory area near the stack
+    // Called from the fault handler: populate the page holding host address
+    // `addr` if it belongs to a segment. Returns false for a real fault.
+    bool populate(const void* addr) {
+        uint64_t guest = (uint64_t)(static_cast<const uint8_t*>(addr) - base);
+        uint64_t page = guest / pageSize;
+        if (guest >= LOADER_SPACE || populated[page]) return false;
+        uint64_t start = page * pageSize, end = start + pageSize;
+        bool any = false, writable = false;
+        for (const Segment& seg : segments) {
+            if (seg.start < end && start < seg.end) {
+                any = true;
+                writable |= seg.writable;
+            }
+        }
+        if (!any) return false;
+        mprotect(base + start, pageSize, PROT_READ | PROT_WRITE);
+        for (const Segment& seg : segments) {
+            if (seg.fileOffset == ~0ull || seg.end <= start || end <= seg.start) continue;
+            uint64_t from = std::max(start, seg.start), to = std::min(end, seg.end);
+            const uint8_t* src = image + seg.fileOffset + (from - seg.start);
+            uint32_t* dst = reinterpret_cast<uint32_t*>(base + from);
+            for (uint64_t off = 0; off < to - from; off += 4) *dst++ = readBE32(src + off);
         }
+        if (!writable) mprotect(base + start, pageSize, PROT_READ);
+        populated[page] = 1;
+        pagesPopulated++;
+        return true;
     }
 
-    void execute() {
-        // Start executing the code (for simplicity, we assume each instruction is 4 bytes)
-        while (PC < memory.size()) {
-            uint32_t instruction = memory[PC];
-            // For simplicity, we assume a simple function to decode and execute instructions
-            executeInstruction(instruction);
-            PC += 4;
+    bool contains(const void* addr) const {
+        const uint8_t* p = static_cast<const uint8_t*>(addr);
+        return p >= base && p < base + LOADER_SPACE;
+    }
+
+    // Run from the entry point until the entry frame returns or a fault.
+    // Returns false on a fault or an illegal instruction.
+    bool execute() {
+        activeLoader = this;
+        if (sigsetjmp(faultEnv, 1) != 0) {
+            activeLoader = nullptr;
+            uint64_t guardLow = STACK_TOP - STACK_SIZE - STACK_GUARD;
+            bool stackOverflow = faultAddress >= guardLow && faultAddress < STACK_TOP - STACK_SIZE;
+            std::cerr << (stackOverflow ? "Stack overflow" : "Segmentation fault") << " at address 0x"
+                      << std::hex << faultAddress << " (PC = 0x" << PC << ")" << std::dec << std::endl;
+            return false;
         }
+        bool ok = true;
+        for (;;) {
+            if (PC % 4 != 0) {
+                std::cerr << "Misaligned PC 0x" << std::hex << PC << std::dec << std::endl;
+                ok = false;
+                break;
+            }
+            uint32_t instruction = word(PC);
+            if (trace) {
+                std::cout << "Executing instruction at PC = " << PC << ": " << instruction << std::endl;
+            }
+            instructions++;
+            if (profiling && PC - profileBase < wordCounts.size() * 4) wordCounts[(PC - profileBase) / 4]++;
+            int status = executeInstruction(instruction);
+            if (status != 0) {
+                ok = status > 0;
+                break;
+            }
+        }
+        activeLoader = nullptr;
+        return ok;
     }
 
+    // Fault bookkeeping, for the handler
+    sigjmp_buf faultEnv;
+    volatile uint64_t faultAddress = 0;
+    uint8_t* base = nullptr;
+
 private:
-    uint32_t stringToInstruction(const std::string& instruction) {
-        // Convert the instruction string (e.g., "add $t0, $t1, $t2") to machine code
-        return std::stoi(instruction, nullptr, 16);  // For now, just a placeholder
+    uint64_t pageSize = 4096;
+    uint32_t profileBase = 0;
+    const uint8_t* image = nullptr;
+    size_t imageSize = 0;
+    bool mappedImage = false;  // image is our own mapping of a file
+    std::vector<Segment> segments;
+    std::vector<uint8_t> populated;  // one flag per guest page
+
+    // Check the image header and lay out its segments
+    bool setUp(std::string& error) {
+        uint32_t version = readBE32(image + 4);
+        if (readBE32(image) != IMAGE_MAGIC || version < IMAGE_VERSION || version > IMAGE_VERSION_DYNAMIC ||
+            (version == IMAGE_VERSION_DYNAMIC && imageSize < 4 * (IMAGE_HEADER_WORDS + 5))) {
+            error = "not an executable image";
+            return false;
+        }
+        uint64_t headerBytes = 4 * (IMAGE_HEADER_WORDS + (version == IMAGE_VERSION_BASED ? 1 : 0) +
+                                    (version == IMAGE_VERSION_DYNAMIC ? 5 : 0));
+        uint64_t entry = readBE32(image + 8);
+        uint64_t textSize = readBE32(image + 12), dataSize = readBE32(image + 16), bssSize = readBE32(image + 20);
+        uint64_t textBase = version >= IMAGE_VERSION_BASED ? readBE32(image + 24) : 0;
+        uint64_t dataBase = textBase + textSize, bssBase = dataBase + dataSize, bssEnd = bssBase + bssSize;
+        uint64_t dynamicSize = version == IMAGE_VERSION_DYNAMIC ? readBE32(image + 40) : 0;
+        if (headerBytes + textSize + dataSize + dynamicSize > imageSize || (textSize | dataSize | textBase) % 4 != 0) {
+            error = "truncated or misaligned image";
+            return false;
+        }
+        if (bssEnd > STACK_TOP - STACK_SIZE - STACK_GUARD) {
+            error = "image overlaps the stack";
+            return false;
+        }
+        if (version == IMAGE_VERSION_DYNAMIC &&
+            !loadLibraries(image + headerBytes + textSize + dataSize, dynamicSize, textBase, bssEnd, error)) {
+            return false;
+        }
+        segments = {
+            {textBase, dataBase, headerBytes, false},
+            {dataBase, bssBase, headerBytes + textSize, true},
+            {bssBase, bssEnd, ~0ull, true},
+            {STACK_TOP - STACK_SIZE, STACK_TOP, ~0ull, true},
+        };
+        PC = (uint32_t)entry;
+        stackPointer = (uint32_t)STACK_TOP;
+        profileBase = textBase;
+        if (profiling) wordCounts.assign(textSize / 4, 0);
+        return true;
     }
 
-    void executeInstruction(uint32_t instruction) {
-        // Placeholder for decoding and executing an instruction
-        std::cout << "Executing instruction at PC = " << PC << ": " << instruction << std::endl;
+    // Parse the dynamic block of a version 3 image and map each library's
+    // shared text read-only at its base. Library pages never fault.
+    bool loadLibraries(const uint8_t* block, uint64_t size, uint64_t imageStart, uint64_t imageEnd,
+                       std::string& error) {
+        uint32_t libraryCount = readBE32(image + 32), importCount = readBE32(image + 36);
+        const char* p = reinterpret_cast<const char*>(block);
+        const char* end = p + size;
+        std::vector<std::string> names;
+        for (uint32_t i = 0; i < libraryCount + importCount; i++) {
+            size_t length = strnlen(p, (size_t)(end - p));
+            if (p + length == end) {
+                error = "truncated dynamic block";
+                return false;
+            }
+            names.emplace_back(p, length);
+            p += length + 1;
+        }
+        imports.assign(names.begin() + libraryCount, names.end());
+        std::vector<std::pair<uint64_t, uint64_t>> ranges = {
+            {imageStart, imageEnd}, {STACK_TOP - STACK_SIZE - STACK_GUARD, LOADER_SPACE}};
+        for (uint32_t i = 0; i < libraryCount; i++) {
+            std::shared_ptr<SharedLibrary> lib = acquireLibrary(names[i], pageSize, error);
+            if (!lib) {
+                error = names[i] + ": " + error;
+                return false;
+            }
+            uint64_t start = lib->image.base, stop = start + lib->mappedSize;
+            for (const auto& range : ranges) {
+                if (start < range.second && range.first < stop) {
+                    error = names[i] + ": library overlaps the image or another library";
+                    return false;
+                }
+            }
+            ranges.push_back({start, stop});
+            if (mmap(base + start, lib->mappedSize, PROT_READ, MAP_SHARED | MAP_FIXED, lib->fd, 0) == MAP_FAILED) {
+                error = names[i] + ": cannot map";
+                return false;
+            }
+            std::fill(populated.begin() + start / pageSize, populated.begin() + stop / pageSize, 1);
+            sharedBytes += lib->image.textSize;
+            libraries.push_back(std::move(lib));
+        }
+        return true;
+    }
+
+    // SYS BIND: point PLT entry `index` (the word at PC) at the import's
+    // definition, then re-execute it as a direct jump.
+    int bind(uint32_t index) {
+        if (index < imports.size()) {
+            for (const auto& lib : libraries) {
+                auto it = lib->image.exports.find(imports[index]);
+                if (it == lib->image.exports.end()) continue;
+                if (it->second > 0xFFFF) break;
+                word(PC) = (0x4u << 28) | (it->second << 8);
+                bindings++;
+                return 0;
+            }
+        }
+        std::cerr << "Unresolved import " << (index < imports.size() ? "'" + imports[index] + "'" : std::to_string(index))
+                  << " at PC = 0x" << std::hex << PC << std::dec << std::endl;
+        return -1;
+    }
+
+    uint32_t& word(uint32_t address) { return *reinterpret_cast<uint32_t*>(base + address); }
+
+    void push(uint32_t value) {
+        stackPointer -= 4;
+        word(stackPointer) = value;
+    }
+
+    uint32_t pop() {
+        uint32_t value = word(stackPointer);
+        stackPointer += 4;
+        return value;
+    }
+
+    // Toolchain ISA (see Assembly_to_Binary.cpp). Returns 0 to continue,
+    // 1 when the entry frame returns, -1 on an illegal instruction.
+    int executeInstruction(uint32_t instruction) {
+        uint32_t op = instruction >> 28, rd = (instruction >> 24) & 0xF;
+        uint32_t rs1 = (instruction >> 20) & 0xF, rs2 = (instruction >> 16) & 0xF;
+        uint32_t imm = (instruction >> 8) & 0xFFFF, mode = instruction & 0xFF;
+        uint32_t simm = (uint32_t)(int32_t)(int16_t)imm;
+        uint32_t next = PC + 4;
+        switch (op) {
+        case 0x0:  // MOV
+            if (mode == 0x01) registers[rd] = simm;
+            else if (mode == 0x02) registers[rd] = imm << 16;
+            else if (mode == 0x03) registers[rd] = (registers[rd] & 0xFFFF0000) | imm;
+            else registers[rd] = registers[rs1];
+            break;
+        case 0x1: registers[rd] = registers[rs1] + registers[rs2]; break;  // ADD
+        case 0x2: registers[rd] = registers[rs1] - registers[rs2]; break;  // SUB
+        case 0x3: equalFlag = registers[rd] == (mode == 0x01 ? simm : registers[rs1]); break;  // CMP
+        case 0x4: next = imm; break;                                       // JMP
+        case 0x5:                                                          // CALL
+            if (profiling) callCounts[{PC, imm}]++;
+            push(next);
+            next = imm;
+            break;
+        case 0x6:                                                          // RET
+            if (stackPointer == STACK_TOP) return 1;
+            next = pop();
+            break;
+        case 0x7: push(registers[rd]); break;                              // PUSH
+        case 0x8: registers[rd] = pop(); break;                            // POP
+        case 0x9: registers[rd]--; break;                                  // DEC
+        case 0xA: registers[rd] = registers[rs1] * registers[rs2]; break;  // MUL
+        case 0xB: if (equalFlag) next = imm; break;                        // JE
+        case 0xC:                                                          // SHL
+            registers[rd] = registers[rs1] << ((mode == 0x01 ? imm : registers[rs2]) & 0x1F);
+            break;
+        case 0xD: registers[rd] = (int32_t)registers[rs1] < (int32_t)registers[rs2]; break;  // SLT
+        case 0xE:                                                          // SRL
+            registers[rd] = registers[rs1] >> ((mode == 0x01 ? imm : registers[rs2]) & 0x1F);
+            break;
+        case OP_SYS:
+            if (mode == SYS_BIND) return bind(imm);                        // PC stays on the patched entry
+            [[fallthrough]];
+        default:
+            std::cerr << "Illegal instruction 0x" << std::hex << instruction << " at PC = 0x" << PC
+                      << std::dec << std::endl;
+            return -1;
+        }
+        PC = next;
+        return 0;
     }
 };
 
-// Main function to simulate the entire process: translation, linking, loading, and execution
-int main() {
-    // Step 1: Create object files (simulated)
-    ObjectFile objFile1, objFile2;
-    
-    // Populate code sections, data sections, and symbol tables for two object files
-    objFile1.codeSection.push_back("li $t0, 5");
-    objFile1.symbolTable["var1"] = { "var1", 0x1000, true };
-    
-    objFile2.codeSection.push_back("add $t0, $t1, $t2");
-    objFile2.symbolTable["var2"] = { "var2", 0x2000, false };
-    
-    // Step 2: Link object files
+static void loaderFaultHandler(int sig, siginfo_t* info, void*) {
+    Loader* loader = activeLoader;
+    if (loader && loader->contains(info->si_addr)) {
+        if (loader->populate(info->si_addr)) return;  // retry the access
+        loader->faultAddress = (uint64_t)(static_cast<uint8_t*>(info->si_addr) - loader->base);
+        siglongjmp(loader->faultEnv, 1);
+    }
+    signal(sig, SIG_DFL);  // re-executing the access now crashes as usual
+}
+
+bool linkObjects(const std::vector<ObjectBuffer>& objects, const LinkOptions& options, std::vector<uint8_t>& image,
+                 std::vector<std::string>& errors) {
     Linker linker;
-    linker.link({ objFile1, objFile2 });
-    
+    linker.gcSections = options.gcSections;
+    linker.foldIdentical = options.foldIdentical;
+    bool ok = true;
+    for (const std::string& path : options.libraries) ok = linker.addLibrary(path) && ok;
+    std::vector<ObjectFile> objectFiles(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        std::string error;
+        if (!objectFiles[i].read(objects[i].name, objects[i].data, objects[i].size, error)) {
+            linker.errors.push_back(objects[i].name + ": " + error);
+            ok = false;
+        }
+    }
+    ok = ok && linker.link(objectFiles);
+    errors.insert(errors.end(), linker.errors.begin(), linker.errors.end());
+    if (!ok) return false;
+    image = linker.executableImage();
+    return true;
+}
+
+bool runImage(const uint8_t* data, size_t size, bool trace, Execution& execution, std::string& error) {
+    std::unique_ptr<Loader> loader;
+    try {
+        loader.reset(new Loader);
+    } catch (const std::runtime_error& e) {
+        error = std::string("loader: ") + e.what();
+        return false;
+    }
+    loader->trace = trace;
+    if (!loader->load(data, size, error)) return false;
+    execution.ok = loader->execute();
+    execution.result = loader->registers[0];
+    execution.instructions = loader->instructions;
+    return true;
+}
+
+}  // namespace linkload
+
+#ifndef TOOLCHAIN_LIBRARY
+using namespace linkload;
+
+// Main function to simulate the entire process: linking, loading, and execution
+int main(int argc, char* argv[]) {
+    // Usage: linker [-j threads] [-o a.out] [--gc-sections] [--icf] [--library lib.so]...
+    //               [--instances N] [--trace] file.o...           link, write, load and run
+    //               [--profile-out run.prof] [--profile run.prof]
+    //        linker --shared --base addr [-o lib.so] file.o...    link a shared library
+    //        linker --run [--instances N] [--trace] image.bin     load and run an image
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string outputPath = "a.out";
+    bool runOnly = false, trace = false, gcSections = false, foldIdentical = false, shared = false;
+    uint32_t libraryBase = 0;
+    unsigned instances = 1;
+    std::string profileIn, profileOut;
+    std::vector<std::string> paths, libraryPaths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) threads = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "-o" && i + 1 < argc) outputPath = argv[++i];
+        else if (arg == "--run") runOnly = true;
+        else if (arg == "--trace") trace = true;
+        else if (arg == "--gc-sections") gcSections = true;
+        else if (arg == "--icf") foldIdentical = true;
+        else if (arg == "--shared") shared = true;
+        else if (arg == "--base" && i + 1 < argc) libraryBase = (uint32_t)std::stoul(argv[++i], nullptr, 0);
+        else if (arg == "--library" && i + 1 < argc) libraryPaths.push_back(argv[++i]);
+        else if (arg == "--instances" && i + 1 < argc) instances = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--profile" && i + 1 < argc) profileIn = argv[++i];
+        else if (arg == "--profile-out" && i + 1 < argc) profileOut = argv[++i];
+        else paths.push_back(arg);
+    }
+    if (paths.empty() || (runOnly && paths.size() != 1) || (shared && (runOnly || libraryBase == 0)) ||
+        (!profileOut.empty() && (runOnly || shared || instances > 1))) {
+        std::cerr << "Usage: " << argv[0] << " [-j threads] [-o a.out] [--library lib.so]... [--instances N] [--trace]\n"
+                  << "       " << std::string(strlen(argv[0]), ' ') << " [--profile-out run.prof] [--profile run.prof] file.o...\n"
+                  << "       " << argv[0] << " --shared --base addr [-o lib.so] file.o...\n"
+                  << "       " << argv[0] << " --run [--instances N] [--trace] image.bin" << std::endl;
+        return 1;
+    }
+
+    std::string imagePath = runOnly ? paths[0] : outputPath;
+    Linker linker(runOnly ? 1 : threads);
+    if (!runOnly) {
+        // Step 1: Read the object files produced by the assembler (atob -c)
+        linker.gcSections = gcSections;
+        linker.foldIdentical = foldIdentical;
+        linker.shared = shared;
+        if (shared) linker.textBase = libraryBase;
+        std::vector<ObjectFile> objectFiles;
+        auto start = std::chrono::steady_clock::now();
+        bool linked = true;
+        std::string error;
+        if (!profileIn.empty() && !linker.profile.read(profileIn, error)) {
+            linker.errors.push_back(profileIn + ": " + error);
+            linked = false;
+        }
+        linker.splitBlocks = !profileOut.empty();
+        for (const auto& path : libraryPaths) linked = linker.addLibrary(path) && linked;
+        linked = linker.load(paths, objectFiles) && linked;
+
+        // Step 2: Link object files
+        linked = linked && linker.link(objectFiles);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        for (const auto& error : linker.errors) {
+            std::cerr << "error: " << error << std::endl;
+        }
+        if (!linked) {
+            return 1;
+        }
+        std::cout << "Linked " << objectFiles.size() << " object(s), " << linker.finalSymbols.size()
+                  << " global symbol(s), " << linker.relocationCount << " relocation(s) in " << ms << " ms" << std::endl;
+        if (gcSections || foldIdentical) {
+            uint32_t gcTotal = 0, icfTotal = 0;
+            for (size_t i = 0; i < objectFiles.size(); i++) {
+                const LinkSavings& saved = linker.savings[i];
+                if (saved.gcBytes + saved.icfBytes == 0) continue;
+                std::cout << "  " << objectFiles[i].path << ": " << saved.gcBytes << " byte(s) unreachable, "
+                          << saved.icfBytes << " byte(s) folded" << std::endl;
+                gcTotal += saved.gcBytes;
+                icfTotal += saved.icfBytes;
+            }
+            std::cout << "Saved " << gcTotal + icfTotal << " byte(s): " << gcTotal << " unreachable, "
+                      << icfTotal << " folded; text is " << linker.finalCode.size() * 4 << " byte(s)" << std::endl;
+        }
+        if (!linker.profile.empty()) {
+            const LayoutReport& layout = linker.layoutReport;
+            std::cout << "Profile layout: " << layout.clusters << " cluster(s), " << layout.hotBytes << " hot byte(s), "
+                      << layout.coldBytes << " cold byte(s) moved behind them; I-cache footprint "
+                      << layout.linesBefore << " -> " << layout.linesAfter << " line(s) of " << ICACHE_LINE
+                      << " bytes" << std::endl;
+        }
+        if (!linker.imports.empty()) {
+            std::cout << linker.imports.size() << " import(s) bound lazily through the PLT at 0x" << std::hex
+                      << linker.pltAddress << std::dec << std::endl;
+        }
+        if (!(shared ? linker.writeLibrary(outputPath) : linker.writeExecutable(outputPath))) {
+            std::cerr << "Error writing " << outputPath << std::endl;
+            return 1;
+        }
+        if (shared) return 0;
+    }
+
     // Step 3: Load executable into memory
-    Loader loader;
-    loader.loadExecutable(linker.finalCode, linker.finalData);
-    
+    if (instances > 1) {
+        // Independent guests on their own threads; shared libraries are
+        // decoded once and mapped into each of them.
+        std::vector<std::unique_ptr<Loader>> loaders(instances);
+        std::vector<std::string> errors(instances);
+        std::atomic<bool> ok{true};
+        auto start = std::chrono::steady_clock::now();
+        ThreadPool pool(threads);
+        pool.forEach(instances, [&](size_t i) {
+            try {
+                loaders[i].reset(new Loader);
+            } catch (const std::runtime_error& e) {
+                errors[i] = e.what();
+                ok = false;
+                return;
+            }
+            loaders[i]->trace = trace;
+            if (!loaders[i]->load(imagePath, errors[i]) || !loaders[i]->execute()) ok = false;
+        });
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        size_t pages = 0, bindings = 0;
+        uint64_t sharedBytes = 0;
+        for (size_t i = 0; i < instances; i++) {
+            if (!errors[i].empty()) std::cerr << imagePath << ": " << errors[i] << std::endl;
+            if (!loaders[i]) continue;
+            pages += loaders[i]->pagesPopulated;
+            bindings += loaders[i]->bindings;
+            sharedBytes += loaders[i]->sharedBytes;
+        }
+        std::cout << "Ran " << instances << " instance(s) in " << ms << " ms; " << pages << " private page(s), "
+                  << sharedBytes << " byte(s) of library text from " << sharedLibraryLoads << " shared load(s), "
+                  << bindings << " binding(s); R0 = " << (loaders[0] ? loaders[0]->registers[0] : 0) << std::endl;
+        return ok ? 0 : 1;
+    }
+
+    std::unique_ptr<Loader> owned;
+    try {
+        owned.reset(new Loader);
+    } catch (const std::runtime_error& e) {
+        std::cerr << "Loader: " << e.what() << std::endl;
+        return 1;
+    }
+    Loader& loader = *owned;
+    loader.trace = trace;
+    loader.profiling = !profileOut.empty();
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!loader.load(imagePath, error)) {
+        std::cerr << imagePath << ": " << error << std::endl;
+        return 1;
+    }
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
     // Step 4: Execute the program
-    loader.execute();
-    
-    return 0;
+    bool ok = loader.execute();
+    std::cout << "Loaded in " << loadMs << " ms; executed " << loader.instructions << " instruction(s), "
+              << loader.pagesPopulated << " page(s) populated; R0 = " << loader.registers[0] << std::endl;
+    if (!loader.imports.empty()) {
+        std::cout << loader.bindings << " of " << loader.imports.size() << " import(s) bound, "
+                  << loader.sharedBytes << " byte(s) of shared library text mapped" << std::endl;
+    }
+    if (!profileOut.empty() && !linker.writeProfile(profileOut, loader.wordCounts, loader.callCounts)) {
+        std::cerr << "Error writing " << profileOut << std::endl;
+        return 1;
+    }
+    return ok ? 0 : 1;
 }
+#endif
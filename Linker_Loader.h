@@ -0,0 +1,45 @@
+#ifndef LINKER_LOADER_H
+#define LINKER_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Library interface of the linker and loader (Linker_Loader.cpp).
+// Toolchain.cpp links against it; the linker tool is the same source with
+// its main().
+namespace linkload {
+
+// An AOBJ object held in memory; the name is for diagnostics
+struct ObjectBuffer {
+    std::string name;
+    const uint8_t* data;
+    size_t size;
+};
+
+struct LinkOptions {
+    bool gcSections = false;             // --gc-sections
+    bool foldIdentical = false;          // --icf
+    std::vector<std::string> libraries;  // ALIB files to resolve imports against
+};
+
+// Link objects into an ABIN image at the default text base. Returns false
+// with messages appended to `errors` on failure.
+bool linkObjects(const std::vector<ObjectBuffer>& objects, const LinkOptions& options, std::vector<uint8_t>& image,
+                 std::vector<std::string>& errors);
+
+struct Execution {
+    bool ok = false;            // main returned without a fault
+    uint32_t result = 0;        // R0 on return
+    uint64_t instructions = 0;  // guest instructions retired
+};
+
+// Load an ABIN image into a fresh guest and run main to completion; faults
+// are reported on stderr. Returns false with `error` set only if the image
+// could not be loaded.
+bool runImage(const uint8_t* data, size_t size, bool trace, Execution& execution, std::string& error);
+
+}  // namespace linkload
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef OBJECT_FORMAT_H
+#define OBJECT_FORMAT_H
+
+#include <cstdint>
+
+// Relocatable object format written by the assembler (atob -c) and read by
+// the linker. Every field is a big-endian u32, like the ABIN image.
+//
+//   header    magic "AOBJ", version, section count, symbol count,
+//             relocation count, string table size (bytes, multiple of 4)
+//   sections  name, type, file offset, size (bytes)
+//   symbols   name, section index (OBJ_UNDEF if undefined), value, flags
+//   relocs    section index, offset (bytes), symbol index, type, addend
+//   strings   NUL-terminated names, padded to a multiple of 4
+//   contents  section bytes at their file offsets
+//
+// A relocation sets the field it names to symbol address + addend. Symbol 0
+// is the section symbol for .text, so references to local labels are
+// relocated against the section base with the label offset as addend.
+const uint32_t OBJ_MAGIC = 0x414F424A;  // "AOBJ"
+const uint32_t OBJ_VERSION = 1;
+const uint32_t OBJ_UNDEF = 0xFFFFFFFF;
+
+const uint32_t OBJ_HEADER_WORDS = 6;
+const uint32_t OBJ_SECTION_WORDS = 4;
+const uint32_t OBJ_SYMBOL_WORDS = 4;
+const uint32_t OBJ_RELOC_WORDS = 5;
+
+enum ObjSectionType : uint32_t {
+    SECTION_TEXT = 1,
+    SECTION_DATA = 2,
+    SECTION_BSS = 3
+};
+
+enum ObjSymbolFlags : uint32_t {
+    SYM_LOCAL = 0x0,    // no flags: visible only within its object
+    SYM_GLOBAL = 0x1,   // visible to other objects
+    SYM_SECTION = 0x2   // the section itself; value 0
+};
+
+enum ObjRelocType : uint32_t {
+    RELOC_ABS16 = 1,    // 16-bit branch/jump target in bits [23:8]
+    RELOC_WORD32 = 2    // the whole word
+};
+
+// Executable image (ABIN), also all big-endian u32:
+//   magic "ABIN", version, entry point (byte address), text size,
+//   data size, bss size (bytes); version 2 adds the text load address.
+//   Then the text words, then the data words. Version 1 images (written
+//   by the assembler) load at address 0. Data follows text and bss
+//   follows data in the guest address space.
+//
+// Version 3 (dynamically linked) adds, after the load address: PLT
+// address, library count, import count and dynamic block size (bytes).
+// The dynamic block follows the data: NUL-terminated library paths, then
+// import names, padded to a multiple of 4. The PLT is the first import
+// count words of data; entry k starts as pltBindWord(k).
+const uint32_t IMAGE_MAGIC = 0x4142494E;  // "ABIN"
+const uint32_t IMAGE_VERSION = 1;
+const uint32_t IMAGE_VERSION_BASED = 2;
+const uint32_t IMAGE_VERSION_DYNAMIC = 3;
+const uint32_t IMAGE_HEADER_WORDS = 6;    // version 1; version 2 has 7, version 3 has 11
+
+// Shared library image (ALIB), linked at a fixed base address:
+//   magic "ALIB", version, base, text size (bytes), export count,
+//   string table size (bytes, multiple of 4); exports (name offset,
+//   address); the string table; the text words.
+const uint32_t LIBRARY_MAGIC = 0x414C4942;  // "ALIB"
+const uint32_t LIBRARY_VERSION = 1;
+const uint32_t LIBRARY_HEADER_WORDS = 6;
+
+// SYS (opcode 0xF) with mode SYS_BIND asks the loader to bind import
+// imm16: it looks the name up in the libraries and rewrites the word
+// into JMP <address>, so later calls through the PLT entry go direct.
+const uint32_t OP_SYS = 0xF;
+const uint32_t SYS_BIND = 0x01;
+
+inline uint32_t pltBindWord(uint32_t import) {
+    return (OP_SYS << 28) | ((import & 0xFFFF) << 8) | SYS_BIND;
+}
+
+inline uint32_t readBE32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Apply one relocation to a host-order instruction word.
+inline void applyRelocation(uint32_t& word, uint32_t type, uint32_t value) {
+    if (type == RELOC_ABS16) {
+        word = (word & ~(0xFFFFu << 8)) | ((value & 0xFFFF) << 8);
+    } else {
+        word = value;
+    }
+}
+
+#endif
@@ -0,0 +1,287 @@
+// Single-process toolchain: the library in Toolchain.h and the `tc` driver.
+// The tools are compiled separately with TOOLCHAIN_LIBRARY defined, which
+// leaves out their own main(), and used through their headers:
+//   g++ -std=c++17 -O2 -pthread -DTOOLCHAIN_LIBRARY -c HLL_to_Assembly.cpp Assembly_to_Binary.cpp Linker_Loader.cpp
+//   g++ -std=c++17 -O2 -pthread -o tc Toolchain.cpp HLL_to_Assembly.o Assembly_to_Binary.o Linker_Loader.o
+// Compile this file with -DTOOLCHAIN_LIBRARY as well to leave out the
+// driver and link the library into another program. CMakeLists.txt builds
+// both, the standalone tools and a smoke test (ctest).
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include "Toolchain.h"
+#include "HLL_to_Assembly.h"
+#include "Assembly_to_Binary.h"
+#include "Linker_Loader.h"
+
+namespace toolchain {
+
+bool compile(const std::string& name, const std::string& source, const Options& options, Assembly& assembly,
+             std::vector<std::string>& errors) {
+    int level = std::min(std::max(options.optLevel, 0), htoa::MAX_OPT_LEVEL);
+    const htoa::PipelineModel* target = htoa::findTarget(options.target);
+    if (!target) {
+        errors.push_back("unknown target '" + options.target + "'");
+        return false;
+    }
+    htoa::InlineProfile profile;
+    std::string error;
+    if (!options.profile.empty() && !profile.read(options.profile, error)) {
+        errors.push_back(options.profile + ": " + error);
+        return false;
+    }
+    try {
+        assembly.code = htoa::compileProgram(source, level, nullptr, *target,
+                                             options.profile.empty() ? nullptr : &profile);
+    } catch (const std::runtime_error& e) {
+        errors.push_back(name + ": " + e.what());
+        return false;
+    }
+    return true;
+}
+
+std::string listing(const Assembly& assembly) {
+    return htoa::printAssembly(assembly.code);
+}
+
+// A compiler instruction as the assembler's operands, in the order the
+// listing writes them
+static atob::Instruction operands(const htoa::MachineInstr& m) {
+    using htoa::Mn;
+    switch (m.op) {
+    case Mn::Move: return {atob::PSEUDO_MOVE, m.rd, m.ra};
+    case Mn::Li: return {atob::PSEUDO_LI, m.rd, -1, -1, m.imm};
+    case Mn::Clr: return {atob::PSEUDO_CLR, m.rd};
+    case Mn::Add: return {atob::OP_ADD, m.rd, m.ra, m.rb};
+    case Mn::Sub: return {atob::OP_SUB, m.rd, m.ra, m.rb};
+    case Mn::Mul: return {atob::OP_MUL, m.rd, m.ra, m.rb};
+    case Mn::Slt: return {atob::OP_SLT, m.rd, m.ra, m.rb};
+    case Mn::Shl: return {atob::OP_SHL, m.rd, m.ra, -1, m.imm};
+    case Mn::Srl: return {atob::OP_SRL, m.rd, m.ra, -1, m.imm};
+    case Mn::Dec: return {atob::OP_DEC, m.rd};
+    case Mn::Cmp: return {atob::OP_CMP, m.ra, m.rb, -1, m.imm};
+    case Mn::Je: return {atob::OP_JE, -1, -1, -1, 0, m.target};
+    case Mn::Jmp: return {atob::OP_JMP, -1, -1, -1, 0, m.target};
+    case Mn::Call: return {atob::OP_CALL, -1, -1, -1, 0, m.target};
+    case Mn::Push: return {atob::OP_PUSH, m.ra};
+    case Mn::Pop: return {atob::OP_POP, m.rd};
+    case Mn::Ret:
+    case Mn::Label:
+        break;
+    }
+    return {atob::OP_RET};
+}
+
+static bool objectFrom(const std::string& name, const atob::AssembledProgram& prog, Object& object,
+                       std::vector<std::string>& errors) {
+    for (const atob::Diagnostic& d : prog.diagnostics) {
+        errors.push_back(name + ": line " + std::to_string(d.line) + ": " + d.message);
+    }
+    if (!prog.diagnostics.empty()) return false;
+    object.name = name;
+    object.bytes = atob::objectBytes(prog);
+    return true;
+}
+
+bool assemble(const std::string& name, const Assembly& assembly, const Options& options, Object& object,
+              std::vector<std::string>& errors) {
+    atob::AssembledProgram prog;
+    int line = 0;  // of the instruction in the listing, for diagnostics
+    for (const htoa::MachineInstr& m : assembly.code) {
+        line++;
+        if (m.op == htoa::Mn::Label) atob::defineLabel(m.target, line, prog);
+        else atob::assembleInstruction(operands(m), line, prog);
+    }
+    prog.lines = line;
+    atob::finishProgram(prog, true, options.peephole);
+    return objectFrom(name, prog, object, errors);
+}
+
+bool assemble(const std::string& name, const std::string& source, const Options& options, Object& object,
+              std::vector<std::string>& errors) {
+    return objectFrom(name, atob::assembleSource(source, true, options.peephole), object, errors);
+}
+
+bool link(const std::vector<Object>& objects, const Options& options, Image& image,
+          std::vector<std::string>& errors) {
+    std::vector<linkload::ObjectBuffer> buffers;
+    for (const Object& object : objects) buffers.push_back({object.name, object.bytes.data(), object.bytes.size()});
+    linkload::LinkOptions linkOptions;
+    linkOptions.gcSections = options.gcSections;
+    linkOptions.foldIdentical = options.foldIdentical;
+    linkOptions.libraries = options.libraries;
+    return linkload::linkObjects(buffers, linkOptions, image.bytes, errors);
+}
+
+bool run(const Image& image, const Options& options, RunResult& result, std::vector<std::string>& errors) {
+    linkload::Execution execution;
+    std::string error;
+    if (!linkload::runImage(image.bytes.data(), image.bytes.size(), options.trace, execution, error)) {
+        errors.push_back(error);
+        return false;
+    }
+    result.ok = execution.ok;
+    result.result = execution.result;
+    result.instructions = execution.instructions;
+    return result.ok;
+}
+
+bool build(const std::vector<std::pair<std::string, std::string>>& sources, const Options& options,
+           RunResult& result, std::vector<std::string>& errors) {
+    std::vector<Object> objects(sources.size());
+    bool ok = true;
+    for (size_t i = 0; i < sources.size(); i++) {
+        Assembly assembly;
+        ok = compile(sources[i].first, sources[i].second, options, assembly, errors) &&
+             assemble(sources[i].first, assembly, options, objects[i], errors) && ok;
+    }
+    Image image;
+    return ok && link(objects, options, image, errors) && run(image, options, result, errors);
+}
+
+}  // namespace toolchain
+
+#ifndef TOOLCHAIN_LIBRARY
+static bool readFile(const std::string& path, std::string& contents) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool writeFile(const std::string& path, const char* data, size_t size) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(data, (std::streamsize)size);
+    return (bool)out;
+}
+
+int main(int argc, char* argv[]) {
+    // Usage: tc [-O0|-O1|-O2] [--target name] [--profile run.prof] [--peephole] [--gc-sections] [--icf] [--library lib.so]...
+    //           [--trace] [-S] [-c] [-o a.out] [--no-run] [--repeat N] file...
+    // Files ending in .asm are assembled, .o files are linked as they are,
+    // anything else is compiled as C. Nothing is written unless asked: -S
+    // saves each compiled unit as <stem>.asm, -c each object as <stem>.o
+    // and -o the linked image. --repeat runs the whole pipeline N times and
+    // reports the mean time per stage.
+    toolchain::Options options;
+    bool saveAssembly = false, saveObjects = false, runImage = true;
+    std::string imagePath;
+    unsigned repeat = 1;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.size() == 3 && arg.compare(0, 2, "-O") == 0 && arg[2] >= '0' && arg[2] <= '0' + htoa::MAX_OPT_LEVEL) {
+            options.optLevel = arg[2] - '0';
+        } else if (arg == "--target" && i + 1 < argc) options.target = argv[++i];
+        else if (arg == "--profile" && i + 1 < argc) options.profile = argv[++i];
+        else if (arg == "--peephole") options.peephole = true;
+        else if (arg == "--gc-sections") options.gcSections = true;
+        else if (arg == "--icf") options.foldIdentical = true;
+        else if (arg == "--library" && i + 1 < argc) options.libraries.push_back(argv[++i]);
+        else if (arg == "--trace") options.trace = true;
+        else if (arg == "-S") saveAssembly = true;
+        else if (arg == "-c") saveObjects = true;
+        else if (arg == "-o" && i + 1 < argc) imagePath = argv[++i];
+        else if (arg == "--no-run") runImage = false;
+        else if (arg == "--repeat" && i + 1 < argc) repeat = std::max(1, std::stoi(argv[++i]));
+        else paths.push_back(arg);
+    }
+    if (paths.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-O0|-O1|-O2] [--target name] [--profile run.prof] [--peephole]\n"
+                  << "       " << std::string(strlen(argv[0]), ' ')
+                  << " [--gc-sections] [--icf] [--library lib.so]... [--trace] [-S] [-c] [-o a.out] [--no-run] [--repeat N] file..."
+                  << std::endl;
+        return 1;
+    }
+
+    enum Kind { SOURCE, ASSEMBLY, OBJECT };
+    auto endsWith = [](const std::string& s, const char* suffix) {
+        size_t n = strlen(suffix);
+        return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+    };
+    auto stem = [](const std::string& path) {
+        std::string base = path.substr(path.find_last_of('/') + 1);
+        return base.substr(0, base.find_last_of('.'));
+    };
+    std::vector<Kind> kinds;
+    std::vector<std::string> inputs(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        kinds.push_back(endsWith(paths[i], ".asm") ? ASSEMBLY : endsWith(paths[i], ".o") ? OBJECT : SOURCE);
+        if (!readFile(paths[i], inputs[i])) {
+            std::cerr << "Error opening " << paths[i] << std::endl;
+            return 1;
+        }
+    }
+
+    // Stage times in ms, summed over the repetitions
+    double compileMs = 0, assembleMs = 0, linkMs = 0, runMs = 0;
+    auto since = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::vector<std::string> errors;
+    std::vector<toolchain::Assembly> compiled(paths.size());
+    std::vector<toolchain::Object> objects(paths.size());
+    toolchain::Image image;
+    toolchain::RunResult result;
+    bool ok = true;
+    for (unsigned r = 0; r < repeat && ok; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (kinds[i] == SOURCE) ok = toolchain::compile(paths[i], inputs[i], options, compiled[i], errors) && ok;
+        }
+        compileMs += since(start);
+        if (!ok) break;
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (kinds[i] == SOURCE) ok = toolchain::assemble(paths[i], compiled[i], options, objects[i], errors) && ok;
+            else if (kinds[i] == ASSEMBLY) ok = toolchain::assemble(paths[i], inputs[i], options, objects[i], errors) && ok;
+            else objects[i] = {paths[i], std::vector<uint8_t>(inputs[i].begin(), inputs[i].end())};
+        }
+        assembleMs += since(start);
+        if (!ok) break;
+
+        start = std::chrono::steady_clock::now();
+        ok = toolchain::link(objects, options, image, errors);
+        linkMs += since(start);
+        if (!ok || !runImage) continue;
+
+        start = std::chrono::steady_clock::now();
+        ok = toolchain::run(image, options, result, errors);
+        runMs += since(start);
+    }
+    for (const std::string& error : errors) std::cerr << "error: " << error << std::endl;
+    if (!ok) return 1;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::string text = saveAssembly && kinds[i] == SOURCE ? toolchain::listing(compiled[i]) : std::string();
+        if (saveAssembly && kinds[i] == SOURCE && !writeFile(stem(paths[i]) + ".asm", text.data(), text.size())) {
+            std::cerr << "Error writing " << stem(paths[i]) << ".asm" << std::endl;
+            return 1;
+        }
+        const std::vector<uint8_t>& bytes = objects[i].bytes;
+        if (saveObjects && kinds[i] != OBJECT &&
+            !writeFile(stem(paths[i]) + ".o", reinterpret_cast<const char*>(bytes.data()), bytes.size())) {
+            std::cerr << "Error writing " << stem(paths[i]) << ".o" << std::endl;
+            return 1;
+        }
+    }
+    if (!imagePath.empty() &&
+        !writeFile(imagePath, reinterpret_cast<const char*>(image.bytes.data()), image.bytes.size())) {
+        std::cerr << "Error writing " << imagePath << std::endl;
+        return 1;
+    }
+
+    double total = compileMs + assembleMs + linkMs + runMs;
+    std::cout << (repeat > 1 ? "Mean of " + std::to_string(repeat) + " runs: " : "") << total / repeat
+              << " ms (compile " << compileMs / repeat << ", assemble " << assembleMs / repeat << ", link "
+              << linkMs / repeat << ", load and run " << runMs / repeat << ")";
+    if (runImage) std::cout << "; executed " << result.instructions << " instruction(s); R0 = " << result.result;
+    std::cout << std::endl;
+    return 0;
+}
+#endif
@@ -0,0 +1,84 @@
+#ifndef TOOLCHAIN_H
+#define TOOLCHAIN_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "HLL_to_Assembly.h"
+
+// The compiler (HLL_to_Assembly.cpp), assembler (Assembly_to_Binary.cpp)
+// and linker/loader (Linker_Loader.cpp) as one in-process library, built by
+// Toolchain.cpp against the tools' headers. Stages hand each other memory:
+// the compiler's machine instructions, which the assembler encodes without
+// going through text, then AOBJ objects and an ABIN image in the formats of
+// Object_Format.h, so a buffer can be saved as the file the standalone tool
+// would have written. Nothing is read from or written to disk except
+// shared libraries named in Options and what the caller saves.
+//
+// Every call returns false on failure with messages appended to `errors`,
+// each prefixed with the unit name where there is one.
+namespace toolchain {
+
+struct Options {
+    int optLevel = 2;                    // compiler -O level, 0..2
+    std::string target = "classic";      // pipeline model to schedule for (htoa --target)
+    std::string profile;                 // call counts for the inliner (htoa --profile), if any
+    bool peephole = false;               // assembler peephole pass (atob -O)
+    bool gcSections = false;             // linker --gc-sections
+    bool foldIdentical = false;          // linker --icf
+    std::vector<std::string> libraries;  // ALIB files to resolve imports against
+    bool trace = false;                  // print each guest instruction as it runs
+};
+
+// A compiled unit, as the compiler's machine instructions
+struct Assembly {
+    std::vector<htoa::MachineInstr> code;
+};
+
+// A relocatable object (AOBJ)
+struct Object {
+    std::string name;  // for diagnostics
+    std::vector<uint8_t> bytes;
+};
+
+// A linked executable (ABIN)
+struct Image {
+    std::vector<uint8_t> bytes;
+};
+
+struct RunResult {
+    bool ok = false;            // main returned without a fault
+    uint32_t result = 0;        // R0 on return
+    uint64_t instructions = 0;  // guest instructions retired
+};
+
+// C subset -> machine instructions
+bool compile(const std::string& name, const std::string& source, const Options& options, Assembly& assembly,
+             std::vector<std::string>& errors);
+
+// The assembly text htoa would write for a compiled unit (tc -S)
+std::string listing(const Assembly& assembly);
+
+// Compiled unit or assembly source text -> object; labels the unit does
+// not define become undefined symbols for the linker.
+bool assemble(const std::string& name, const Assembly& assembly, const Options& options, Object& object,
+              std::vector<std::string>& errors);
+bool assemble(const std::string& name, const std::string& source, const Options& options, Object& object,
+              std::vector<std::string>& errors);
+
+// Objects -> executable linked at the linker's default text base
+bool link(const std::vector<Object>& objects, const Options& options, Image& image,
+          std::vector<std::string>& errors);
+
+// Load the image into a fresh guest and run main to completion. Faults
+// are reported on stderr by the loader, as in the standalone tool.
+bool run(const Image& image, const Options& options, RunResult& result, std::vector<std::string>& errors);
+
+// Compile, assemble, link and run C-subset sources in one call
+bool build(const std::vector<std::pair<std::string, std::string>>& sources, const Options& options,
+           RunResult& result, std::vector<std::string>& errors);
+
+}  // namespace toolchain
+
+#endif
@@ -1,3 +1,4 @@
+factorial:
 MOV R0, 0
 CMP R0, 0
 JE factorial_base_case
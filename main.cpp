@@ -72,6 +72,112 @@ POP
 #include <thread>
 #include <stdexcept>
 #include <cstdint>
+#include <atomic>
+#include <csetjmp>
+#include <csignal>
+#include <sys/mman.h>
+#include <unistd.h>
+
+class GuestMemory;
+
+// Landing pad armed by CPU::run() on the current thread.
+struct FaultContext {
+    sigjmp_buf env;
+    const GuestMemory* mem;
+    volatile uint32_t address;
+};
+
+static thread_local FaultContext* activeFault = nullptr;
+
+// Guest memory is word-addressed with 32-bit indices, so reserving 2^32 words
+// up front means every index the CPU can form stays inside one mapping. Only
+// the pages backing MEMORY_SIZE words are accessible; everything past them is
+// a PROT_NONE guard, and a host fault there is reported as a guest exception.
+// Usable memory is MEMORY_SIZE rounded up to a whole host page.
+//
+// Hosts that refuse the 16 GB reservation (32-bit builds, a tight
+// RLIMIT_AS or overcommit policy) get only the usable pages, and every
+// access is bounds-checked instead.
+class GuestMemory {
+private:
+    static const uint64_t RESERVED_BYTES = (1ull << 32) * sizeof(uint32_t);
+    uint32_t* base;
+    uint64_t mapped;
+    uint64_t limit;  // words reachable without a fault; 0 when guard-paged
+
+    [[noreturn]] static void outOfRange(uint32_t index) {
+        FaultContext* ctx = activeFault;
+        if (!ctx) throw std::out_of_range("Guest memory access out of range");
+        ctx->address = index;
+        siglongjmp(ctx->env, 1);
+    }
+
+public:
+    explicit GuestMemory(uint64_t words) : limit(0) {
+        uint64_t page = sysconf(_SC_PAGESIZE);
+        uint64_t bytes = (words * sizeof(uint32_t) + page - 1) / page * page;
+
+        mapped = RESERVED_BYTES;
+        void* p = mmap(nullptr, mapped, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            mapped = bytes;
+            limit = bytes / sizeof(uint32_t);
+            p = mmap(nullptr, mapped, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                throw std::runtime_error("Failed to allocate guest memory");
+            }
+        }
+        base = static_cast<uint32_t*>(p);
+
+        if (mprotect(base, bytes, PROT_READ | PROT_WRITE) != 0) {
+            munmap(base, mapped);
+            throw std::runtime_error("Failed to commit guest memory");
+        }
+    }
+
+    ~GuestMemory() { munmap(base, mapped); }
+
+    GuestMemory(const GuestMemory&) = delete;
+    GuestMemory& operator=(const GuestMemory&) = delete;
+
+    uint32_t& operator[](uint32_t index) {
+        if (limit && index >= limit) outOfRange(index);
+        return base[index];
+    }
+
+    bool contains(const void* host) const {
+        const uint8_t* p = static_cast<const uint8_t*>(host);
+        const uint8_t* b = reinterpret_cast<const uint8_t*>(base);
+        return p >= b && p < b + mapped;
+    }
+
+    uint32_t indexOf(const void* host) const {
+        return (uint32_t)(static_cast<const uint32_t*>(host) - base);
+    }
+};
+
+static void guestFaultHandler(int sig, siginfo_t* info, void*) {
+    FaultContext* ctx = activeFault;
+    if (ctx && ctx->mem->contains(info->si_addr)) {
+        ctx->address = ctx->mem->indexOf(info->si_addr);
+        siglongjmp(ctx->env, 1);
+    }
+    signal(sig, SIG_DFL); // not a guest access: crash as usual
+}
+
+static void installFaultHandler() {
+    static bool installed = [] {
+        struct sigaction sa = {};
+        sa.sa_sigaction = guestFaultHandler;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, nullptr);
+        sigaction(SIGBUS, &sa, nullptr); // macOS reports PROT_NONE hits as SIGBUS
+        return true;
+    }();
+    (void)installed;
+}
 
 class CPU {
 private:
@@ -82,13 +188,14 @@ private:
     static const uint32_t CLOCK_SPEED_HZ = 1;         // 1Hz for visualization
 
     // Memory and Registers
-    std::vector<uint32_t> memory;
+    GuestMemory memory;           // guard-page protected, no bounds checks
     std::vector<uint32_t> gpr;    // General Purpose Registers
 
     // Special Purpose Registers
     uint32_t pc;                  // Program Counter
     uint32_t sp;                  // Stack Pointer
     uint32_t ir;                  // Instruction Register
+    uint32_t instrPc;             // address of the instruction being executed
 
     // Flags Register
     struct Flags {
@@ -153,12 +260,6 @@ private:
     }
 
     uint32_t fetch() {
-        if (pc >= MEMORY_SIZE) {
-            std::cerr << "Error: Program counter out of bounds: " << pc << std::endl;
-            running = false;
-            return 0;
-        }
-        
         ir = memory[pc];
         pc += 1;
         return ir;
@@ -390,8 +491,9 @@ private:
     }
 
 public:
-    CPU() : memory(MEMORY_SIZE, 0), gpr(NUM_GPR, 0), 
-            pc(0), sp(MEMORY_SIZE - 4), ir(0), running(false) {
+    CPU() : memory(MEMORY_SIZE), gpr(NUM_GPR, 0), 
+            pc(0), sp(MEMORY_SIZE - 4), ir(0), instrPc(0), running(false) {
+        installFaultHandler();
         std::cout << "CPU initialized with " << MEMORY_SIZE << " bytes of memory" << std::endl;
         resetFlags();
         lastClockPulse = std::chrono::steady_clock::now();
@@ -424,9 +526,22 @@ public:
         pc = 0;
 
         std::cout << "Starting program execution" << std::endl;
+
+        FaultContext fault;
+        fault.mem = &memory;
+        fault.address = 0;
+        activeFault = &fault;
+        if (sigsetjmp(fault.env, 1) != 0) {
+            pc = instrPc;
+            running = false;
+            std::cerr << "Error: Guest memory fault at PC = 0x" << std::hex << instrPc
+                      << ", address = 0x" << fault.address << std::endl;
+        }
         
-        while (running && pc < MEMORY_SIZE) {
+        while (running) {
             std::cout << "\nFetching instruction at PC = 0x" << std::hex << pc << std::endl;
+            instrPc = pc;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
             
             uint32_t instruction = fetch();
             if (!running) break;
@@ -438,6 +553,7 @@ public:
             displayState();
             clockPulse();
         }
+        activeFault = nullptr;
         
         std::cout << "Program execution completed" << std::endl;
     }
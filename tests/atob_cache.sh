@@ -0,0 +1,30 @@
+# The incremental cache reuses every unchanged function, re-assembles only
+# edited ones, and its output matches a build without the cache.
+. "$(dirname "$0")/common.sh"
+
+asm_program 300 > prog.asm
+"$bin/atob" --cache prog.cache prog.asm first.bin > first.out
+expect first.out "^Reused 0 of 300 units"
+"$bin/atob" --cache prog.cache prog.asm second.bin > second.out
+expect second.out "^Reused 300 of 300 units"
+"$bin/atob" prog.asm plain.bin > /dev/null
+cmp plain.bin first.bin || fail "cold cache build differs"
+cmp plain.bin second.bin || fail "warm cache build differs"
+
+# One line added to one function
+awk '{ print } $0 == "f10:" { print "MOV R5, 5" }' prog.asm > edited.asm
+"$bin/atob" --cache prog.cache -j 4 edited.asm edited.bin > edited.out
+expect edited.out "^Reused 299 of 300 units"
+"$bin/atob" edited.asm edited-plain.bin > /dev/null
+cmp edited-plain.bin edited.bin || fail "incremental build differs"
+
+# Different options never share entries
+"$bin/atob" --cache prog.cache -O edited.asm opt.bin > opt.out
+expect opt.out "^Reused 0 of 300 units"
+
+# A truncated cache keeps the entries before the cut and misses the rest
+size=$(wc -c < prog.cache)
+dd if=prog.cache of=cut.cache bs=$((size / 2)) count=1 2> /dev/null
+"$bin/atob" --cache cut.cache edited.asm cut.bin > cut.out
+expect cut.out "^Reused [0-9]+ of 300 units"
+cmp edited-plain.bin cut.bin || fail "build from a truncated cache differs"
@@ -0,0 +1,17 @@
+# Parallel assembly produces the same image and object as a serial build.
+. "$(dirname "$0")/common.sh"
+
+asm_program 300 > prog.asm
+"$bin/atob" prog.asm serial.bin > /dev/null
+"$bin/atob" -c prog.asm serial.o > /dev/null
+for j in 2 3 4 8; do
+    "$bin/atob" -j $j prog.asm j$j.bin > /dev/null
+    cmp serial.bin j$j.bin || fail "-j $j image differs"
+    "$bin/atob" -j $j -c prog.asm j$j.o > /dev/null
+    cmp serial.o j$j.o || fail "-j $j object differs"
+done
+
+# An undefined label is reported once, with its source line
+printf 'main:\nMOV R1, 1\nJMP nowhere\nRET\n' > bad.asm
+"$bin/atob" -j 2 bad.asm bad.bin 2> bad.err && fail "undefined label accepted"
+expect bad.err "^line 3: undefined label 'nowhere'$"
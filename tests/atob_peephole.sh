@@ -0,0 +1,48 @@
+# Pseudo-instructions and the peephole pass: the savings on a known block,
+# the same result when run, and -O under -j matching a serial -O build.
+. "$(dirname "$0")/common.sh"
+
+cat > block.asm <<'ASM'
+main:
+LI R0, 5
+MOVE R1, R0
+MOV R1, R1
+MOV R2, 4
+MUL R0, R0, R2
+MOV R3, 1
+MOV R3, 2
+PUSH R3
+POP R3
+CMP R2, 4
+JE .done
+MOV R0, 0
+.done:
+ADD R0, R0, R3
+RET
+ASM
+"$bin/atob" -c block.asm plain.o > /dev/null
+"$bin/atob" -O -c block.asm opt.o > opt.out
+# MOV R1, R1; the overwritten MOV R3, 1; PUSH/POP; the code after JE,
+# which the decided CMP turns into a JMP
+expect opt.out "^Peephole pass saved 5 instruction\(s\)"
+"$bin/linker" -o plain.bin plain.o > plain.run
+"$bin/linker" -o opt.bin opt.o > opt.run
+expect plain.run "executed 13 instruction\(s\).*R0 = 22$"
+expect opt.run "executed 9 instruction\(s\).*R0 = 22$"
+
+# Each function's PUSH R3; POP R4 becomes one MOV
+asm_program 300 > prog.asm
+"$bin/atob" -O prog.asm serial.bin > serial.out
+expect serial.out "^Peephole pass saved 300 instruction\(s\)"
+for j in 2 4 8; do
+    "$bin/atob" -O -j $j prog.asm j$j.bin > j$j.out
+    cmp serial.bin j$j.bin || fail "-O -j $j image differs"
+    expect j$j.out "^Peephole pass saved 300 instruction\(s\)"
+done
+
+# Without -O the cuts stay at line boundaries; a source with a single
+# label assembles the same
+awk '{ if (NR == 1 || $0 !~ /:$/) print }' prog.asm | grep -v '^J\|^CALL' > sparse.asm
+"$bin/atob" sparse.asm sparse.bin > /dev/null
+"$bin/atob" -j 4 sparse.asm sparse4.bin > /dev/null
+cmp sparse.bin sparse4.bin || fail "-j 4 image of a label-sparse source differs"
@@ -0,0 +1,55 @@
+# Sourced by the shell tests. $1 is the directory holding the built tools;
+# each test runs in a scratch directory of its own.
+set -e
+bin=$(cd "$1" && pwd)
+src=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work"
+
+fail() {
+    echo "FAIL: $*" >&2
+    exit 1
+}
+
+# words 2008FFFC FC000000 ... writes a raw image of big-endian instruction
+# words for the cpu to stdout
+words() {
+    for w in "$@"; do
+        for i in 1 3 5 7; do
+            printf "\\$(printf %03o "0x$(echo "$w" | cut -c$i-$((i + 1)))")"
+        done
+    done
+}
+
+# expect FILE PATTERN fails unless a line of FILE matches PATTERN (grep -E)
+expect() {
+    grep -Eq "$2" "$1" || fail "$1 does not match '$2'"
+}
+
+# asm_program N writes an assembly source of N small functions, which
+# call each other forwards and backwards and loop on local labels
+asm_program() {
+    awk -v n="$1" 'BEGIN {
+        for (f = 0; f < n; f++) {
+            printf "f%d:\nMOV R1, %d\nMOV R2, R1\n", f, f % 50
+            printf ".f%d_loop:\nADD R3, R1, R2\nDEC R1\nCMP R1, 0\nJE .f%d_done\nJMP .f%d_loop\n", f, f, f
+            printf ".f%d_done:\nPUSH R3\nPOP R4\nCALL f%d\nMUL R4, R4, R2\nRET\n", f, (f * 7 + 3) % n
+        }
+    }'
+}
+
+# link_program N PARTS writes main.asm, which calls N small functions and
+# returns the sum of (K % 50) over them in R0, and part0.asm up to
+# part<PARTS-1>.asm, which define the functions round robin
+link_program() {
+    awk -v n="$1" -v parts="$2" 'BEGIN {
+        print "main:\nMOV R0, 0" > "main.asm"
+        for (f = 0; f < n; f++) {
+            print "CALL f" f > "main.asm"
+            part = "part" (f % parts) ".asm"
+            printf "f%d:\nMOV R1, %d\nJMP .f%d_add\nMOV R1, 0\n.f%d_add:\nADD R0, R0, R1\nRET\n", f, f % 50, f, f > part
+        }
+        print "RET" > "main.asm"
+    }'
+}
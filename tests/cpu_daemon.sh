@@ -0,0 +1,31 @@
+# The simulation daemon: pipelined requests from two clients, inputs and
+# printed outputs, a faulting program, and the summary on shutdown.
+. "$(dirname "$0")/common.sh"
+
+# addi r2,r0,5; syscall (read int); add r4,r2,r2; addi r2,r0,1;
+# syscall (print int); halt
+words 20020005 0000000C 00422020 20020001 0000000C FC000000 > double.bin
+# addi r8,r0,-4; lw r9,0(r8); halt
+words 2008FFFC 8D090000 FC000000 > fault.bin
+
+"$bin/cpu" --serve "$work/d.sock" --workers 2 > daemon.out 2>&1 &
+daemon=$!
+tries=0
+until [ -S "$work/d.sock" ]; do
+    tries=$((tries + 1))
+    [ $tries -lt 100 ] || fail "daemon did not start"
+    sleep 0.1
+done
+
+"$bin/cpu" --submit "$work/d.sock" --requests 200 --window 16 --input 21 double.bin > double.out &
+"$bin/cpu" --submit "$work/d.sock" --requests 50 fault.bin > fault.out
+wait $!
+kill -INT $daemon
+wait $daemon
+
+expect double.out "^Request 0: halted after 6 instruction\(s\), PC=0x18, R2=0x1, printed 42$"
+expect double.out "^200 of 200 response\(s\)"
+expect fault.out "^Request 0: guest memory fault after 1 instruction\(s\), PC=0x4, "
+expect fault.out "^50 of 50 response\(s\)"
+expect daemon.out "^Serving on .* with 2 worker\(s\)\.$"
+expect daemon.out "^Served 250 request\(s\) in total"
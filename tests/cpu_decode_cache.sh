@@ -0,0 +1,35 @@
+# The on-disk decode cache: a cold run stores the table, a warm run maps
+# it with the same result, and a damaged or unwritable cache falls back to
+# decoding.
+. "$(dirname "$0")/common.sh"
+
+# addi r8,r0,3; loop: addi r8,r8,-1; bne r8,r0,loop; sw r8,0x100(r0); halt
+words 20080003 2108FFFF 1500FFFE AC080100 FC000000 > loop.bin
+mkdir cache
+"$bin/cpu" --decode-cache cache loop.bin > cold.out
+expect cold.out "^Decode cache stored: cache/"
+"$bin/cpu" --decode-cache cache loop.bin > warm.out
+expect warm.out "^Decode cache hit: cache/"
+"$bin/cpu" loop.bin > plain.out
+for f in cold warm plain; do grep -v "^Decode cache\|^Retired" $f.out > $f.state; done
+diff plain.state cold.state > /dev/null || fail "cold cached run differs"
+diff plain.state warm.state > /dev/null || fail "warm cached run differs"
+
+# A different image gets an entry of its own
+words 20080002 2108FFFF 1500FFFE AC080100 FC000000 > other.bin
+"$bin/cpu" --decode-cache cache other.bin > other.out
+expect other.out "^Decode cache stored: cache/"
+[ "$(ls cache | wc -l)" -eq 2 ] || fail "expected two cache entries"
+
+# A truncated entry is a miss and is replaced
+entry=$(sed -n 's/^Decode cache stored: //p' cold.out)
+dd if="$entry" of=cut bs=16 count=1 2> /dev/null
+mv cut "$entry"
+"$bin/cpu" --decode-cache cache loop.bin > cut.out
+expect cut.out "^Decode cache stored: "
+grep -v "^Decode cache\|^Retired" cut.out > cut.state
+diff plain.state cut.state > /dev/null || fail "run after a truncated entry differs"
+
+"$bin/cpu" --decode-cache missing/dir loop.bin > nodir.out 2> nodir.err
+expect nodir.err "^Cannot write decode cache missing/dir/"
+expect nodir.out "^Retired 9 instructions"
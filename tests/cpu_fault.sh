@@ -0,0 +1,26 @@
+# A guest fault stops before the faulting instruction retires: it is not
+# counted, and a faulting store touches nothing.
+. "$(dirname "$0")/common.sh"
+
+# addi r8,r0,-4; lw r9,0(r8); halt
+words 2008FFFC 8D090000 FC000000 > load.bin
+"$bin/cpu" --stats load load.bin > load.out 2>&1
+expect load.out "Guest memory fault at PC=0x4 address=0xfffffffc"
+expect load.out "^Retired 1 instructions"
+expect load.json '"instructions_retired": 1,'
+expect load.json '"loads": 0,'
+grep -q '"LW"' load.json && fail "faulting LW counted"
+
+# addi r8,r0,-4; sw r9,0(r8); halt
+words 2008FFFC AD090000 FC000000 > store.bin
+"$bin/cpu" --stats store store.bin > store.out 2>&1
+expect store.out "Guest memory fault at PC=0x4 address=0xfffffffc"
+expect store.json '"stores": 0,'
+expect store.json '"guest_memory_peak_bytes": 256,'
+
+# j 0x10000: the fetch faults, after the jump retired
+words 08004000 > fetch.bin
+"$bin/cpu" --stats fetch fetch.bin > fetch.out 2>&1
+expect fetch.out "Guest memory fault at PC=0x10000 address=0x10000"
+expect fetch.json '"instructions_retired": 1,'
+expect fetch.json '"J": 1'
@@ -0,0 +1,18 @@
+# Drive the gdb stub over a Unix socket: registers, memory, breakpoints and
+# watchpoints, and malformed packets, which get E01 and leave the target
+# as it was.
+. "$(dirname "$0")/common.sh"
+
+# addi r8,r0,0x100; addi r9,r0,5; sw r9,0(r8); addi r9,r0,7;
+# sw r9,0(r8); addi r10,r0,1; halt
+words 20080100 20090005 AD090000 20090007 AD090000 200A0001 FC000000 > gdb.bin
+"$bin/cpu" --gdb "$work/gdb.sock" gdb.bin > cpu.out 2>&1 &
+"$bin/gdb_client" "$work/gdb.sock" \
+    '?' p25 p pzz m0,4 m,4 M100,4:0000zz00 m100,4 Z0,,4 \
+    Z0,8,4 c p25 z0,8,4 Z2,100,4 c c m100,4 z2,100,4 c D > gdb.out
+wait $!
+
+printf '%s\n' S05 00000000 E01 E01 20080100 E01 E01 00000000 E01 \
+    OK S05 00000008 OK OK 'T05watch:100;' 'T05watch:100;' 00000007 OK W00 OK > want.out
+diff want.out gdb.out || fail "unexpected gdb replies"
+expect cpu.out "^gdb disconnected"
@@ -0,0 +1,17 @@
+# Record a run, then step backwards, reverse to the last write of an
+# address and replay forwards again.
+. "$(dirname "$0")/common.sh"
+
+# addi r8,r0,0x100; addi r9,r0,5; sw r9,0(r8); addi r9,r0,7;
+# sw r9,0(r8); addi r10,r0,1; halt
+words 20080100 20090005 AD090000 20090007 AD090000 200A0001 FC000000 > rr.bin
+printf 'c\nrs 2\nrw 100\nrs 1\nx 100 104\ns 3\nr\nq\n' |
+    "$bin/cpu" --debug --checkpoint-interval 2 rr.bin > rr.out
+expect rr.out '^\(cpu 0\) HALT instruction executed'
+expect rr.out '^\(cpu 7\) PC: 0x14$'
+# rw stops before the second store, which retires as instruction 5
+expect rr.out '^\(cpu 5\) PC: 0x10$'
+expect rr.out '^\(cpu 4\) PC: 0xc$'
+expect rr.out '^0x00000100 : 00 00 00 05 '
+expect rr.out '^\(cpu 3\) PC: 0x18$'
+expect rr.out '^R8:0x100 R9:0x7 Ra:0x1 '
@@ -0,0 +1,25 @@
+# Run statistics written as JSON and as Prometheus text.
+. "$(dirname "$0")/common.sh"
+
+# addi r8,r0,3; loop: addi r8,r8,-1; bne r8,r0,loop; lw r9,0x100(r0);
+# sw r9,0x104(r0); halt
+words 20080003 2108FFFF 1500FFFE 8C090100 AC090104 FC000000 > loop.bin
+"$bin/cpu" --stats run loop.bin > run.out
+expect run.out "^Retired 10 instructions"
+
+expect run.json '^  "core": 0,$'
+expect run.json '^  "instructions_retired": 10,$'
+expect run.json '^  "loads": 1,$'
+expect run.json '^  "stores": 1,$'
+expect run.json '^  "taken_branches": 2,$'
+expect run.json '^  "guest_memory_peak_bytes": 512,$'
+expect run.json '^    "ADDI": 4,$'
+expect run.json '^    "BNE": 3,$'
+expect run.json '^    "HALT": 1$'
+
+expect run.prom '^# TYPE cpu_instructions_retired_total counter$'
+expect run.prom '^cpu_instructions_retired_total\{core="0"\} 10$'
+expect run.prom '^cpu_taken_branches_total\{core="0"\} 2$'
+expect run.prom '^# TYPE cpu_simulated_mips gauge$'
+expect run.prom '^cpu_opcode_executed_total\{core="0",opcode="LW"\} 1$'
+expect run.prom '^cpu_opcode_executed_total\{core="0",opcode="SW"\} 1$'
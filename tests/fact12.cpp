@@ -0,0 +1,4 @@
+// Links against Factorial_Input.cpp; R0 = 12! = 479001600
+int fact(int n);
+
+int main() { return fact(12); }
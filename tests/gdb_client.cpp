@@ -0,0 +1,83 @@
+// Minimal gdb remote protocol client for the tests: connects to the stub
+// on a Unix socket, sends each argument as one packet and prints each reply
+// payload on a line of its own.
+//
+// Usage: gdb_client <socket-path> packet...
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+static int fd = -1;
+
+static bool readByte(char& c) {
+    return recv(fd, &c, 1, 0) == 1;
+}
+
+static bool sendAll(const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(fd, data.data() + off, data.size() - off, 0);
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+// The reply to one packet: the stub acks with '+', then sends $payload#xx
+static bool exchange(const std::string& packet, std::string& reply) {
+    unsigned sum = 0;
+    for (char c : packet) sum += (unsigned char)c;
+    char tail[4];
+    std::snprintf(tail, sizeof(tail), "#%02x", sum & 0xFF);
+    if (!sendAll("$" + packet + tail)) return false;
+    char c;
+    do {
+        if (!readByte(c)) return false;
+    } while (c != '$');
+    reply.clear();
+    while (readByte(c) && c != '#') reply += c;
+    char checksum[2];
+    if (!readByte(checksum[0]) || !readByte(checksum[1])) return false;
+    sendAll("+"); // after D the stub may already be gone
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <socket-path> packet..." << std::endl;
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+    // The stub may still be starting up
+    for (int attempt = 0; attempt < 100; attempt++) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) break;
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) break;
+        close(fd);
+        fd = -1;
+        usleep(50000);
+    }
+    if (fd < 0) {
+        std::cerr << "Cannot connect to " << argv[1] << std::endl;
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        std::string reply;
+        if (!exchange(argv[i], reply)) {
+            std::cerr << "Connection lost at packet " << argv[i] << std::endl;
+            return 1;
+        }
+        std::cout << reply << std::endl;
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,32 @@
+# Section GC drops an unreachable function and ICF folds two identical
+# ones, in one object and across objects, without changing the result.
+. "$(dirname "$0")/common.sh"
+
+cat > main.asm <<'ASM'
+main:
+MOV R0, 2
+CALL twice
+CALL double
+RET
+twice:
+ADD R0, R0, R0
+RET
+ASM
+printf 'double:\nADD R0, R0, R0\nRET\nunused:\nMOV R0, 0\nMOV R1, 0\nRET\n' > more.asm
+cat main.asm more.asm > one.asm
+for f in main more one; do "$bin/atob" -c $f.asm $f.o > /dev/null; done
+
+# 28-byte header, then text: main 16, twice 8, double 8, unused 12
+"$bin/linker" -o plain.bin one.o > plain.out
+expect plain.out "R0 = 8$"
+[ "$(wc -c < plain.bin)" -eq 72 ] || fail "plain image is $(wc -c < plain.bin) bytes"
+
+"$bin/linker" --gc-sections --icf -o one.bin one.o > one.out
+expect one.out "^Saved 20 byte\(s\): 12 unreachable, 8 folded; text is 24 byte\(s\)$"
+expect one.out "R0 = 8$"
+[ "$(wc -c < one.bin)" -eq 52 ] || fail "image is $(wc -c < one.bin) bytes"
+
+"$bin/linker" --gc-sections --icf -o two.bin main.o more.o > two.out
+expect two.out "^  more.o: 12 byte\(s\) unreachable, 8 byte\(s\) folded$"
+expect two.out "R0 = 8$"
+[ "$(wc -c < two.bin)" -eq 52 ] || fail "image is $(wc -c < two.bin) bytes"
@@ -0,0 +1,21 @@
+# Symbol resolution and relocation across objects, in any order, and the
+# undefined and duplicate symbol errors.
+. "$(dirname "$0")/common.sh"
+
+link_program 300 4
+for f in main part0 part1 part2 part3; do "$bin/atob" -c $f.asm $f.o > /dev/null; done
+"$bin/linker" -o app.bin main.o part0.o part1.o part2.o part3.o > app.out
+expect app.out "^Linked 5 object\(s\), 301 global symbol\(s\), 600 relocation\(s\)"
+expect app.out "executed 1502 instruction\(s\).*R0 = 7350$"
+"$bin/linker" -o rev.bin part3.o part2.o part1.o part0.o main.o > rev.out
+expect rev.out "R0 = 7350$"
+
+printf 'main:\nCALL missing\nRET\n' > undef.asm
+"$bin/atob" -c undef.asm undef.o > /dev/null
+"$bin/linker" undef.o 2> undef.err && fail "undefined symbol linked"
+expect undef.err "^error: undefined symbol 'missing' referenced from undef.o$"
+
+printf 'f7:\nRET\n' > dup.asm
+"$bin/atob" -c dup.asm dup.o > /dev/null
+"$bin/linker" main.o part0.o part1.o part2.o part3.o dup.o 2> dup.err && fail "duplicate symbol linked"
+expect dup.err "^error: duplicate symbol 'f7' in dup.o \(first defined in part3.o\)$"
@@ -0,0 +1,21 @@
+# The demand-paged loader populates only the pages a run touches, stops
+# precisely at the stack guard and rejects a truncated image.
+. "$(dirname "$0")/common.sh"
+
+# About 50 KB of text, of which main touches the first and the last page
+link_program 2500 1
+printf 'main:\nMOV R0, 0\nCALL f0\nCALL f2499\nRET\n' > ends.asm
+"$bin/atob" -c ends.asm ends.o > /dev/null
+"$bin/atob" -c part0.asm part0.o > /dev/null
+"$bin/linker" -o ends.bin ends.o part0.o > link.out
+"$bin/linker" --run ends.bin > run.out
+expect run.out "executed 12 instruction\(s\), 3 page\(s\) populated; R0 = 49$"
+
+printf 'main:\nPUSH R0\nCALL main\nRET\n' > deep.asm
+"$bin/atob" -c deep.asm deep.o > /dev/null
+"$bin/linker" -o deep.bin deep.o > deep.out 2> deep.err && fail "stack overflow not reported"
+expect deep.err "^Stack overflow at address 0xffefeffc \(PC = 0x1000\)$"
+
+dd if=ends.bin of=cut.bin bs=20 count=1 2> /dev/null
+"$bin/linker" --run cut.bin 2> cut.err && fail "truncated image loaded"
+expect cut.err "not an executable image"
@@ -0,0 +1,20 @@
+# The parallel link pipeline writes the same image with any thread count.
+. "$(dirname "$0")/common.sh"
+
+link_program 600 16
+objects=main.o
+"$bin/atob" -c main.asm main.o > /dev/null
+i=0
+while [ $i -lt 16 ]; do
+    "$bin/atob" -c part$i.asm part$i.o > /dev/null
+    objects="$objects part$i.o"
+    i=$((i + 1))
+done
+"$bin/linker" -j 1 -o j1.bin $objects > j1.out
+expect j1.out "^Linked 17 object\(s\), 601 global symbol\(s\), 1200 relocation\(s\)"
+expect j1.out "R0 = 14700$"
+for j in 2 4 8; do
+    "$bin/linker" -j $j -o j$j.bin $objects > j$j.out
+    cmp j1.bin j$j.bin || fail "-j $j image differs"
+    expect j$j.out "R0 = 14700$"
+done
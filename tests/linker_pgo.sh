@@ -0,0 +1,50 @@
+# Profile-guided layout: record a run, relink with the profile and check
+# that the hot function moves up next to its caller and the result holds.
+. "$(dirname "$0")/common.sh"
+
+cat > pgo.asm <<'ASM'
+main:
+MOV R0, 0
+MOV R2, 50
+CALL cold
+.main_loop:
+CALL hot
+DEC R2
+CMP R2, 0
+JE .main_done
+JMP .main_loop
+.main_done:
+RET
+cold:
+MOV R1, 100
+ADD R0, R0, R1
+RET
+filler:
+MOV R1, 1
+MOV R1, 2
+MOV R1, 3
+RET
+hot:
+MOV R1, 1
+ADD R0, R0, R1
+RET
+ASM
+"$bin/atob" -c pgo.asm pgo.o > /dev/null
+"$bin/linker" --profile-out run.prof -o plain.bin pgo.o > plain.out
+expect plain.out "R0 = 150$"
+expect run.prof "^call hot 50$"
+expect run.prof "^edge main hot 50$"
+expect run.prof "^block main.main_loop 50$"
+
+"$bin/linker" --profile run.prof -o laid.bin pgo.o > laid.out
+expect laid.out "^Profile layout: 1 cluster\(s\), 60 hot byte\(s\), 16 cold byte\(s\) moved behind them; I-cache footprint 2 -> 1 line\(s\)"
+expect laid.out "executed 406 instruction\(s\).*R0 = 150$"
+cmp -s plain.bin laid.bin && fail "profile did not change the layout"
+
+# Records for functions the program no longer has are skipped
+echo "call gone 5" >> run.prof
+"$bin/linker" --profile run.prof -o stale.bin pgo.o > /dev/null
+cmp laid.bin stale.bin || fail "stale record changed the layout"
+printf 'garbage\n' > bad.prof
+"$bin/linker" --profile bad.prof pgo.o 2> bad.err && fail "malformed profile accepted"
+expect bad.err "^error: bad.prof: malformed record 1$"
@@ -0,0 +1,21 @@
+# A shared library linked at a fixed base, an executable importing from it
+# through the lazily bound PLT, and two instances sharing one load.
+. "$(dirname "$0")/common.sh"
+
+printf 'cube:\nMOV R1, R0\nMUL R0, R0, R1\nMUL R0, R0, R1\nRET\nsquare:\nMUL R0, R0, R0\nRET\n' > lib.asm
+printf 'main:\nMOV R0, 3\nCALL cube\nRET\n' > app.asm
+"$bin/atob" -c lib.asm lib.o > /dev/null
+"$bin/atob" -c app.asm app.o > /dev/null
+"$bin/linker" --shared --base 0x8000 -o libmath.so lib.o > lib.out
+
+"$bin/linker" --library libmath.so -o app.bin app.o > app.out
+expect app.out "^1 import\(s\) bound lazily through the PLT at 0x"
+expect app.out "R0 = 27$"
+expect app.out "^1 of 1 import\(s\) bound"
+
+"$bin/linker" --run --instances 2 app.bin > two.out
+expect two.out "^Ran 2 instance\(s\) in .* from 1 shared load\(s\), 2 binding\(s\); R0 = 27$"
+
+rm libmath.so
+"$bin/linker" --run app.bin 2> gone.err && fail "ran without its library"
+expect gone.err "libmath.so: cannot open"
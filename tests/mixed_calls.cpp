@@ -0,0 +1,31 @@
+// Calls with permuted and reused arguments, values live across calls,
+// mutual recursion, loops and division by a constant; R0 = 1814
+int pick(int a, int b, int c) { return a * 100 + b * 10 + c; }
+
+int rotate(int a, int b, int c) { return pick(c, a, b); }
+
+int isEven(int n);
+
+int isOdd(int n) {
+    if (n == 0) return 0;
+    return isEven(n - 1);
+}
+
+int isEven(int n) {
+    if (n == 0) return 1;
+    return isOdd(n - 1);
+}
+
+int sumTo(int n) {
+    int s = 0;
+    for (int i = 1; i <= n; i++) s += i;
+    return s;
+}
+
+int mix(int x, int y) {
+    int a = rotate(x, y, x + y);
+    int b = sumTo(x) / 4 + sumTo(y) % 8;
+    return a + b * isEven(x + y) - isOdd(y);
+}
+
+int main() { return mix(4, 5) + mix(6, 2); }